@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+#include "object.hpp"
+
+namespace lox::bytecode {
+// Lowers a program parsed and resolved by the treewalk front end to a
+// script function. Unlike Compiler it sees every function body whole
+// before emitting code for it. Returns null after a compile error.
+ObjFunction* compile_ast(VM& vm, const std::string& source);
+}  // namespace lox::bytecode
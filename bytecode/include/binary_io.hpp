@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstring>
+#include <ostream>
+#include <string_view>
+
+#include "chunk.hpp"
+
+namespace lox::bytecode {
+// Native-endian encoding shared by precompiled scripts and heap snapshots.
+// Both are caches for the machine that wrote them.
+class BinaryWriter {
+ public:
+  explicit BinaryWriter(std::ostream& out) : out_{out} {}
+
+  template <typename T>
+  void write(T value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void write_string(std::string_view string) {
+    write(static_cast<uint32_t>(string.size()));
+    write_bytes(string);
+  }
+
+  void write_bytes(std::string_view bytes) {
+    out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+
+  // Writes a chunk's code and line table, but not its constants.
+  void write_code(const Chunk& chunk) {
+    const std::vector<uint8_t>& code = chunk.get_codes();
+    write(static_cast<uint32_t>(code.size()));
+    write_bytes({reinterpret_cast<const char*>(code.data()), code.size()});
+
+    // Lines repeat for every byte of an instruction and usually for several
+    // instructions, so they are stored as runs.
+    const std::vector<int>& lines = chunk.get_lines();
+    for (size_t start = 0; start < lines.size();) {
+      size_t end = start + 1;
+      while (end < lines.size() && lines[end] == lines[start]) {
+        end++;
+      }
+      write(static_cast<int32_t>(lines[start]));
+      write(static_cast<uint32_t>(end - start));
+      start = end;
+    }
+  }
+
+ private:
+  std::ostream& out_;
+};
+
+// Reads from a whole file held in memory. Any read past the end or of
+// inconsistent data sets the failed flag and yields zeroes instead of
+// throwing, so callers check once at the end.
+class BinaryReader {
+ public:
+  explicit BinaryReader(std::string_view data) : data_{data} {}
+
+  [[nodiscard]] bool failed() const { return failed_; }
+  void fail() { failed_ = true; }
+
+  template <typename T>
+  T read() {
+    T value{};
+    if (const char* bytes = take(sizeof(T))) {
+      memcpy(&value, bytes, sizeof(T));
+    }
+    return value;
+  }
+
+  std::string_view read_string() {
+    const auto size = read<uint32_t>();
+    const char* bytes = take(size);
+    return bytes != nullptr ? std::string_view{bytes, size}
+                            : std::string_view{};
+  }
+
+  void read_code(Chunk& chunk) {
+    const auto code_size = read<uint32_t>();
+    const char* code = take(code_size);
+    if (code == nullptr) {
+      return;
+    }
+
+    std::vector<int> lines;
+    lines.reserve(code_size);
+    while (lines.size() < code_size && !failed_) {
+      const auto line = read<int32_t>();
+      const auto run = read<uint32_t>();
+      if (run == 0 || run > code_size - lines.size()) {
+        failed_ = true;
+      } else {
+        lines.insert(lines.end(), run, line);
+      }
+    }
+    chunk.load({code, code + code_size}, std::move(lines));
+  }
+
+ private:
+  const char* take(size_t size) {
+    if (failed_ || data_.size() - position_ < size) {
+      failed_ = true;
+      return nullptr;
+    }
+    const char* bytes = data_.data() + position_;
+    position_ += size;
+    return bytes;
+  }
+
+  std::string_view data_;
+  size_t position_{};
+  bool failed_{};
+};
+}  // namespace lox::bytecode
@@ -1,8 +1,43 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
+
+#include "gc_config.hpp"
 
 namespace lox::bytecode {
-int run_file(const std::string& path);
-void run_prompt();
+enum Profile { PROFILE_NONE, PROFILE_OPCODES, PROFILE_SAMPLES };
+
+struct Options {
+  Profile profile{PROFILE_NONE};
+  // Defaults to profile.json or profile.folded depending on the profile.
+  std::string profile_output;
+  uint32_t sample_interval{1000};
+  bool gc_stats{};
+  // Compile through the treewalk parser and resolver instead of the
+  // single-pass compiler.
+  bool ast{};
+  // Write the compiled script to this file instead of running it.
+  std::string compile_output;
+  // Reuse the .loxc file next to the script if it was compiled from the
+  // same source, and write it otherwise.
+  bool cache{};
+  // Start from the globals saved in this snapshot.
+  std::string snapshot_input;
+  // Save the globals and everything they reach after the script runs.
+  std::string snapshot_output;
+  // Run several scripts at once on this many threads. Only the GC options
+  // may be combined with it.
+  uint32_t workers{};
+  GcConfig gc;
+};
+
+int run_file(const std::string& path, const Options& options = {});
+void run_prompt(const Options& options = {});
+// Runs every script on its own VM across options.workers threads and
+// prints their output in the order given. Returns the first failing
+// script's exit code.
+int run_files(const std::vector<std::string>& paths,
+              const Options& options = {});
 }  // namespace lox::bytecode
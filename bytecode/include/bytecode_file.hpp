@@ -0,0 +1,30 @@
+#pragma once
+
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+#include "object.hpp"
+
+namespace lox::bytecode {
+// Bump whenever the code generator changes what it emits for the same
+// source. Adding an opcode invalidates old files on its own.
+inline constexpr uint32_t COMPILER_VERSION = 1;
+inline constexpr uint32_t OPCODE_COUNT = OP_SET_INDEX + 1;
+
+// Precompiled scripts (.loxc) start with a header naming the format, the
+// version of the code generator and a hash of the source they came from,
+// followed by the script function. Nested functions are stored inline in
+// the constant tables of the functions that create them.
+uint64_t hash_bytes(std::string_view bytes);
+uint64_t hash_source(std::string_view source, bool ast);
+bool is_bytecode_file(std::string_view contents);
+
+void write_bytecode(std::ostream& out, const ObjFunction* script,
+                    uint64_t source_hash);
+// Returns null if the data is malformed, was written by another version of
+// the compiler or, when a source hash is given, was compiled from other
+// source.
+ObjFunction* read_bytecode(VM& vm, std::string_view data,
+                           std::optional<uint64_t> source_hash = {});
+}  // namespace lox::bytecode
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mpmc_queue.hpp"
+
+namespace lox::bytecode {
+class Channel;
+
+// A value packed by one VM for another to rebuild in its own heap. Channels
+// inside it are shared rather than copied, so they travel beside the bytes.
+struct Message {
+  std::string bytes;
+  std::vector<std::shared_ptr<Channel>> channels;
+};
+
+// A bounded queue of messages between VMs on different threads. Senders
+// wait while it is full and receivers while it is empty, spinning briefly
+// before they sleep.
+class Channel {
+ public:
+  static constexpr size_t MAX_CAPACITY = 1U << 16U;
+
+  explicit Channel(size_t capacity)
+      : capacity_{capacity}, messages_{capacity} {}
+
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+
+  void send(Message message);
+  Message receive();
+
+ private:
+  bool try_send(Message& message);
+  bool try_receive(Message& message);
+  void wake_waiters();
+
+  // The queue rounds its capacity up to a power of two, so senders claim
+  // one of exactly capacity_ slots before they push.
+  const size_t capacity_;
+  std::atomic<size_t> size_{};
+  MpmcQueue<Message> messages_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::atomic<size_t> waiting_{};
+};
+}  // namespace lox::bytecode
@@ -16,6 +16,8 @@ enum OpCode : uint8_t {
   OP_SET_GLOBAL,
   OP_GET_UPVALUE,
   OP_SET_UPVALUE,
+  OP_GET_CALLER_LOCAL,
+  OP_SET_CALLER_LOCAL,
   OP_GET_PROPERTY,
   OP_SET_PROPERTY,
   OP_GET_SUPER,
@@ -33,6 +35,7 @@ enum OpCode : uint8_t {
   OP_JUMP_IF_FALSE,
   OP_LOOP,
   OP_CALL,
+  OP_TAIL_CALL,
   OP_INVOKE,
   OP_SUPER_INVOKE,
   OP_CLOSURE,
@@ -40,13 +43,23 @@ enum OpCode : uint8_t {
   OP_RETURN,
   OP_CLASS,
   OP_INHERIT,
-  OP_METHOD
+  OP_METHOD,
+  OP_BUILD_LIST,
+  OP_GET_INDEX,
+  OP_SET_INDEX
 };
 
+std::string_view opcode_name(uint8_t opcode);
+
 class Chunk {
  public:
   void write(uint8_t byte, int line);
   size_t add_constant(Value value);
+  // Replaces the code of an empty chunk, as read from a precompiled file.
+  void load(std::vector<uint8_t> code, std::vector<int> lines) {
+    code_ = std::move(code);
+    lines_ = std::move(lines);
+  }
 
   void disassemble(std::string_view name) const;
   size_t disassemble_instruction(size_t offset) const;
@@ -8,6 +8,8 @@
 #include "scanner.hpp"
 
 namespace lox::bytecode {
+class VM;
+
 class Compiler {
   enum Precedence {
     PREC_NONE,
@@ -19,7 +21,7 @@ class Compiler {
     PREC_TERM,        // + -
     PREC_FACTOR,      // * /
     PREC_UNARY,       // ! -
-    PREC_CALL,        // . ()
+    PREC_CALL,        // . () []
     PREC_PRIMARY
   };
 
@@ -51,26 +53,36 @@ class Compiler {
 
   static std::array<ParseRule, TOKEN_COUNT> rules;
 
-  inline static Token previous, current;
-  inline static bool had_error{};
-  inline static bool panic_mode{};
-
   struct ClassCompiler {
     ClassCompiler* enclosing{};
     bool has_super_class{};
   };
 
-  inline static ClassCompiler* current_class_compiler{};
+  // Shared by a compiler and the compilers of the functions nested in it.
+  struct Parser {
+    Scanner* scanner{};
+    Token previous, current;
+    bool had_error{};
+    bool panic_mode{};
+    ClassCompiler* class_compiler{};
+  };
 
  public:
-  explicit Compiler(Scanner& scanner, FunctionType type = TYPE_SCRIPT,
-                    Compiler* enclosing = nullptr);
+  Compiler(VM& vm, Scanner& scanner);
+  ~Compiler();
+
+  Compiler(const Compiler&) = delete;
+  Compiler& operator=(const Compiler&) = delete;
+  Compiler(Compiler&&) = delete;
+  Compiler& operator=(Compiler&&) = delete;
 
   ObjFunction* compile();
 
   void mark_compiler_roots();
 
  private:
+  Compiler(Compiler& enclosing, FunctionType type);
+  void begin_function();
   ObjFunction* end_compiler();
 
   void emit_byte(uint8_t byte);
@@ -98,6 +110,8 @@ class Compiler {
   void expression();
   void call(bool can_assign);
   uint8_t argument_list();
+  void index(bool can_assign);
+  void list(bool can_assign);
   void super_(bool can_assign);
   void this_(bool can_assign);
   void dot(bool can_assign);
@@ -135,16 +149,20 @@ class Compiler {
 
   void advance();
   void consume(TokenType type, std::string_view message);
-  [[nodiscard]] static bool check(TokenType type) {
-    return current.type == type;
+  [[nodiscard]] bool check(TokenType type) const {
+    return parser_->current.type == type;
   }
   bool match(TokenType type);
 
   void synchronize();
 
-  static void error(std::string_view message);
-  static void error_at_current(std::string_view message);
-  static void error_at(const lox::Token& token, std::string_view message);
+  void error(std::string_view message);
+  void error_at_current(std::string_view message);
+  void error_at(const lox::Token& token, std::string_view message);
+
+  VM& vm_;
+  Parser own_parser_;
+  Parser* parser_;
 
   ObjFunction* function_{};
   FunctionType type_;
@@ -154,9 +172,8 @@ class Compiler {
   std::array<Upvalue, UINT8_COUNT> upvalues_;
   int scope_depth_{};
 
+  std::optional<uint32_t> last_call_;
+
   Compiler* enclosing_{};
-  Scanner* scanner_;
 };
-
-inline Compiler* g_current_compiler{};
 }  // namespace lox::bytecode
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lox::bytecode {
+// Waits for file reads and writes and for timers, one completion at a
+// time. Pipes, FIFOs and other streams are driven by epoll readiness.
+// Regular files are always "ready" to epoll, so they are read and written
+// on a few helper threads that post their results back.
+class EventLoop {
+ public:
+  using Id = uint32_t;
+
+  struct Completion {
+    Id id{};
+    // What a read returned, or why the operation failed.
+    std::string data;
+    bool ok{};
+  };
+
+  EventLoop();
+  // Waits for helper threads to finish their current file and abandons
+  // everything else.
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+  EventLoop(EventLoop&&) = delete;
+  EventLoop& operator=(EventLoop&&) = delete;
+
+  Id read(const std::string& path);
+  Id write(const std::string& path, std::string data);
+  Id timer(double milliseconds);
+
+  [[nodiscard]] bool pending() const { return pending_ > 0; }
+  // Blocks until an operation finishes. Only call while one is pending.
+  Completion wait();
+
+ private:
+  enum Kind { KIND_READ, KIND_WRITE, KIND_TIMER };
+
+  struct Stream {
+    Kind kind{};
+    int fd{-1};
+    std::string buffer;
+    size_t written{};
+  };
+
+  Id start(Kind kind, int fd, std::string data);
+  Id fail(std::string message);
+  void helper();
+  void advance(Id id);
+  // Reads or writes as far as the descriptor allows and returns whether
+  // the operation is over, filling in the completion if so.
+  static bool step(Stream& stream, Completion& completion);
+
+  int epoll_fd_{-1};
+  // Helpers write to it to wake wait.
+  int wake_fd_{-1};
+  Id next_id_{1};
+  size_t pending_{};
+
+  // Operations waiting on descriptors registered with epoll.
+  std::unordered_map<Id, Stream> streams_;
+  std::deque<Completion> ready_;
+
+  // Shared with the helpers.
+  std::mutex mutex_;
+  std::condition_variable tasks_changed_;
+  std::deque<std::pair<Id, Stream>> tasks_;
+  std::deque<Completion> posted_;
+  bool stopping_{};
+  std::vector<std::thread> helpers_;
+};
+}  // namespace lox::bytecode
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gc_config.hpp"
+#include "mpmc_queue.hpp"
+
+namespace lox::bytecode {
+struct JobResult {
+  // Same codes as running the script from the command line.
+  int exit_code{};
+  // What print wrote.
+  std::string output;
+  // Compile and runtime error reports.
+  std::string errors;
+};
+
+// Runs scripts on a fixed set of worker threads. Every job gets a fresh VM
+// on its worker, so jobs share neither heaps nor globals. Scripts are
+// compiled with the single-pass compiler; the treewalk front end behind
+// --ast reports parse errors through process-wide flags and std::cerr.
+class IsolatePool {
+  struct Job {
+    // Lox source or the contents of a .loxc file.
+    std::string script;
+    std::promise<JobResult> result;
+  };
+
+ public:
+  explicit IsolatePool(size_t workers, const GcConfig& gc = {},
+                       size_t queue_capacity = 1024);
+  // Finishes every submitted job before returning.
+  ~IsolatePool();
+
+  IsolatePool(const IsolatePool&) = delete;
+  IsolatePool& operator=(const IsolatePool&) = delete;
+  IsolatePool(IsolatePool&&) = delete;
+  IsolatePool& operator=(IsolatePool&&) = delete;
+
+  // Waits for room if the queue is full.
+  std::future<JobResult> submit(std::string script);
+
+ private:
+  void work();
+  bool next_job(std::unique_ptr<Job>& job);
+
+  const GcConfig gc_;
+  MpmcQueue<std::unique_ptr<Job>> jobs_;
+  // Jobs submitted but not yet taken by a worker.
+  std::atomic<size_t> pending_{};
+
+  // Idle workers sleep here rather than spin. Submitters only take the
+  // lock when someone is asleep.
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> sleeping_{};
+  // Submitters wait here while the queue is full.
+  std::condition_variable room_;
+  std::atomic<size_t> blocked_{};
+  bool stopping_{};
+
+  std::vector<std::thread> workers_;
+};
+}  // namespace lox::bytecode
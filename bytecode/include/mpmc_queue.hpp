@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace lox::bytecode {
+// Bounded multi-producer, multi-consumer queue after Dmitry Vyukov's
+// design. Every cell carries a sequence number saying whether it is free
+// for the producer or full for the consumer at a given position, so a push
+// or pop is one compare-and-swap on the shared position and never blocks.
+template <typename T>
+class MpmcQueue {
+  static constexpr size_t CACHE_LINE = 64;
+
+  struct alignas(CACHE_LINE) Cell {
+    std::atomic<size_t> sequence;
+    T value{};
+  };
+
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit MpmcQueue(size_t capacity)
+      : capacity_{round_up(capacity)},
+        mask_{capacity_ - 1},
+        cells_{std::make_unique<Cell[]>(capacity_)} {
+    for (size_t i = 0; i < capacity_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+
+  // Moves the value in and returns true, or leaves it alone and returns
+  // false if the queue is full.
+  bool try_push(T& value) {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[position & mask_];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lag = static_cast<intptr_t>(sequence) -
+                       static_cast<intptr_t>(position);
+      if (lag == 0) {
+        if (enqueue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Moves the oldest value out, or returns false if the queue is empty.
+  bool try_pop(T& value) {
+    size_t position = dequeue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[position & mask_];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lag = static_cast<intptr_t>(sequence) -
+                       static_cast<intptr_t>(position + 1);
+      if (lag == 0) {
+        if (dequeue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.value);
+          cell.sequence.store(position + capacity_,
+                              std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = dequeue_position_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  static size_t round_up(size_t capacity) {
+    size_t rounded = 2;
+    while (rounded < capacity) {
+      rounded *= 2;
+    }
+    return rounded;
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(CACHE_LINE) std::atomic<size_t> enqueue_position_{};
+  alignas(CACHE_LINE) std::atomic<size_t> dequeue_position_{};
+};
+}  // namespace lox::bytecode
@@ -1,35 +1,56 @@
 #pragma once
 
+#include <memory>
+
 #include "chunk.hpp"
 #include "table.hpp"
 
 #define OBJ_TYPE(value) (AS_OBJ(value)->type)
 
 #define IS_BOUND_METHOD(value) (is_obj_type(value, OBJ_BOUND_METHOD))
+#define IS_CHANNEL(value) (is_obj_type(value, OBJ_CHANNEL))
 #define IS_CLASS(value) (is_obj_type(value, OBJ_CLASS))
 #define IS_CLOSURE(value) (is_obj_type(value, OBJ_CLOSURE))
+#define IS_FIBER(value) (is_obj_type(value, OBJ_FIBER))
+#define IS_FLOAT64_ARRAY(value) (is_obj_type(value, OBJ_FLOAT64_ARRAY))
 #define IS_FUNCTION(value) (is_obj_type(value, OBJ_FUNCTION))
 #define IS_INSTANCE(value) (is_obj_type(value, OBJ_INSTANCE))
+#define IS_LIST(value) (is_obj_type(value, OBJ_LIST))
+#define IS_MAP(value) (is_obj_type(value, OBJ_MAP))
 #define IS_NATIVE(value) (is_obj_type(value, OBJ_NATIVE))
 #define IS_STRING(value) (is_obj_type(value, OBJ_STRING))
 
 #define AS_BOUND_METHOD(value) (static_cast<ObjBoundMethod*>(AS_OBJ(value)))
+#define AS_CHANNEL(value) (static_cast<ObjChannel*>(AS_OBJ(value))->channel)
 #define AS_CLASS(value) (static_cast<ObjClass*>(AS_OBJ(value)))
 #define AS_CLOSURE(value) (static_cast<ObjClosure*>(AS_OBJ(value)))
+#define AS_FIBER(value) (static_cast<ObjFiber*>(AS_OBJ(value)))
+#define AS_FLOAT64_ARRAY(value) \
+  (static_cast<ObjFloat64Array*>(AS_OBJ(value)))
 #define AS_FUNCTION(value) (static_cast<ObjFunction*>(AS_OBJ(value)))
 #define AS_INSTANCE(value) (static_cast<ObjInstance*>(AS_OBJ(value)))
+#define AS_LIST(value) (static_cast<ObjList*>(AS_OBJ(value)))
+#define AS_MAP(value) (static_cast<ObjMap*>(AS_OBJ(value)))
 #define AS_NATIVE(value) (static_cast<ObjNative*>(AS_OBJ(value))->function)
 #define AS_STRING(value) (static_cast<ObjString*>(AS_OBJ(value)))
 
 namespace lox::bytecode {
+class Channel;
+class VM;
+struct ObjFiber;
 struct ObjString;
 
 enum ObjType {
   OBJ_BOUND_METHOD,
+  OBJ_CHANNEL,
   OBJ_CLASS,
   OBJ_CLOSURE,
+  OBJ_FIBER,
+  OBJ_FLOAT64_ARRAY,
   OBJ_FUNCTION,
   OBJ_INSTANCE,
+  OBJ_LIST,
+  OBJ_MAP,
   OBJ_NATIVE,
   OBJ_STRING,
   OBJ_UPVALUE
@@ -60,7 +81,7 @@ struct ObjFunction : Obj {
   ObjString* name{};
 };
 
-using NativeFn = Value (*)(int arg_count, Value* args);
+using NativeFn = Value (*)(VM& vm, int arg_count, Value* args);
 
 struct ObjNative : Obj {
   explicit ObjNative(NativeFn function) : Obj{OBJ_NATIVE}, function{function} {}
@@ -82,6 +103,8 @@ struct ObjUpvalue : Obj {
   Value* location;
   Value closed{NIL_VAL};
   ObjUpvalue* next_upvalue{};
+  // The suspended fiber whose saved stack an open upvalue points into.
+  ObjFiber* fiber{};
 };
 
 struct ObjClosure : Obj {
@@ -99,6 +122,28 @@ struct ObjClosure : Obj {
   uint16_t upvalue_count;
 };
 
+enum FiberState { FIBER_NEW, FIBER_SUSPENDED, FIBER_RUNNING, FIBER_DONE };
+
+// A call stack that can stop and carry on later. While the fiber runs, its
+// values and frames sit on top of the VM's, and a yield moves them back
+// here.
+struct ObjFiber : Obj {
+  struct Frame {
+    ObjClosure* closure;
+    const uint8_t* ip;
+    size_t slots;
+  };
+
+  explicit ObjFiber(ObjClosure* closure) : Obj{OBJ_FIBER}, closure{closure} {}
+
+  ObjClosure* closure;
+  FiberState state{FIBER_NEW};
+  std::vector<Value> stack;
+  std::vector<Frame> frames;
+  // Upvalues still open on the saved stack, from the top down.
+  ObjUpvalue* open_upvalues{};
+};
+
 struct ObjClass : Obj {
   explicit ObjClass(ObjString* name) : Obj{OBJ_CLASS}, name{name} {}
 
@@ -121,6 +166,39 @@ struct ObjBoundMethod : Obj {
   ObjClosure* method;
 };
 
+struct ObjList : Obj {
+  ObjList() : Obj{OBJ_LIST} {}
+
+  std::vector<Value> elements;
+  // Bytes of element storage counted toward the VM's heap.
+  size_t charged{};
+};
+
+struct ObjMap : Obj {
+  ObjMap() : Obj{OBJ_MAP} {}
+
+  ValueTable entries;
+  // Bytes of entry storage counted toward the VM's heap.
+  size_t charged{};
+};
+
+// Doubles stored unboxed and side by side, so the bulk natives can run
+// vector loops over them. The length is fixed when the array is made.
+struct ObjFloat64Array : Obj {
+  explicit ObjFloat64Array(size_t length)
+      : Obj{OBJ_FLOAT64_ARRAY}, values(length) {}
+
+  std::vector<double> values;
+};
+
+// Shared by every VM that has been sent the channel.
+struct ObjChannel : Obj {
+  explicit ObjChannel(std::shared_ptr<Channel> channel)
+      : Obj{OBJ_CHANNEL}, channel{std::move(channel)} {}
+
+  std::shared_ptr<Channel> channel;
+};
+
 inline bool is_obj_type(Value value, ObjType type) {
   return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
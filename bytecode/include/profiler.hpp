@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "object.hpp"
+
+namespace lox::bytecode {
+class OpcodeProfiler {
+  using Clock = std::chrono::steady_clock;
+
+  struct Counter {
+    uint64_t count{};
+    Clock::duration time{};
+  };
+
+ public:
+  void record(const ObjFunction* function, const uint8_t* ip);
+  void stop();
+
+  void print_report(std::ostream& out) const;
+  void write_json(std::ostream& out) const;
+
+ private:
+  std::array<Counter, UINT8_COUNT> opcodes_{};
+  std::unordered_map<std::string, Counter> functions_;
+  std::vector<Counter> lines_;
+
+  const ObjFunction* function_{};
+  Counter* function_counter_{};
+  Counter* opcode_counter_{};
+  size_t line_{};
+  Clock::time_point last_;
+};
+
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(uint32_t interval) : interval_{interval} {}
+
+  [[nodiscard]] uint32_t interval() const { return interval_; }
+
+  void push_frame(const ObjFunction* function, size_t offset);
+  void commit_sample();
+
+  void write_folded(std::ostream& out) const;
+
+ private:
+  uint32_t interval_;
+  std::string stack_;
+  std::unordered_map<std::string, uint64_t> samples_;
+};
+}  // namespace lox::bytecode
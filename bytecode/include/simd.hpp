@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+namespace lox::bytecode {
+// Loops over arrays of doubles, vectorized for the widest instruction set
+// the processor has. Every variant adds and compares in the same order, so
+// results are identical to the last bit whichever one runs.
+struct SimdKernels {
+  void (*add)(const double* a, const double* b, double* out, size_t count);
+  void (*multiply)(const double* a, const double* b, double* out,
+                   size_t count);
+  void (*scale)(const double* a, double factor, double* out, size_t count);
+  double (*dot)(const double* a, const double* b, size_t count);
+  double (*sum)(const double* a, size_t count);
+  // The count must not be zero.
+  double (*min)(const double* a, size_t count);
+  double (*max)(const double* a, size_t count);
+  void (*prefix_sum)(const double* a, double* out, size_t count);
+};
+
+// Chosen on first use by asking the processor.
+const SimdKernels& simd_kernels();
+}  // namespace lox::bytecode
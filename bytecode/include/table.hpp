@@ -39,4 +39,41 @@ class Table {
   uint32_t size_{}, capacity_{INITIAL_CAPACITY};
   Entries entries_;
 };
+
+struct ValueEntry {
+  Value key{NIL_VAL};
+  Value value{NIL_VAL};
+};
+
+// A Table keyed by any value except nil, which marks empty entries. Keys
+// match when they are the same number, bool or object; strings match by
+// content since they are interned. Integral doubles are stored as ints so
+// that 1 and 1.0 are one key.
+class ValueTable {
+  static constexpr float MAX_LOAD = 0.75F;
+
+  using Entries = std::unique_ptr<ValueEntry[]>;
+
+ public:
+  static constexpr int INITIAL_CAPACITY = 8;
+
+  ValueTable() : entries_{std::make_unique<ValueEntry[]>(INITIAL_CAPACITY)} {}
+
+  bool set(Value key, Value value);
+  bool get(Value key, Value* value) const;
+  bool del(Value key);
+
+  [[nodiscard]] uint32_t count() const { return count_; }
+  [[nodiscard]] const Entries& get_entries() const { return entries_; }
+  [[nodiscard]] uint32_t get_capacity() const { return capacity_; }
+
+ private:
+  static ValueEntry* find_entry(const Entries& entries, uint32_t capacity,
+                                Value key);
+  void adjust_capacity(uint32_t capacity);
+
+  // The size counts tombstones, which lengthen probes like live entries.
+  uint32_t size_{}, count_{}, capacity_{INITIAL_CAPACITY};
+  Entries entries_;
+};
 }  // namespace lox::bytecode
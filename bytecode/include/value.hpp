@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <iostream>
+#include <limits>
 
 #include "common.hpp"
 
@@ -8,6 +12,7 @@
 
 #define SIGN_BIT (0x8000000000000000U)
 #define QNAN (0x7ffc000000000000U)
+#define INT_BIT (0x0001000000000000U)
 
 #define TAG_NIL 1U
 #define TAG_FALSE 2U
@@ -18,14 +23,20 @@
 #define TRUE_VAL (QNAN | TAG_TRUE)
 #define NIL_VAL (QNAN | TAG_NIL)
 #define NUMBER_VAL(number) (number_to_value(number))
+#define INT_VAL(integer) (QNAN | INT_BIT | static_cast<uint32_t>(integer))
 #define OBJ_VAL(obj) (SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(obj))
 
 #define IS_BOOL(value) (((value) | 1U) == TRUE_VAL)
 #define IS_NIL(value) ((value) == NIL_VAL)
-#define IS_NUMBER(value) (((value)&QNAN) != QNAN)
+#define IS_DOUBLE(value) (((value)&QNAN) != QNAN)
+#define IS_INT(value) \
+  (((value) & (SIGN_BIT | QNAN | INT_BIT)) == (QNAN | INT_BIT))
+#define IS_NUMBER(value) (IS_DOUBLE(value) || IS_INT(value))
+#define ARE_INTS(left, right) (IS_INT((left) & (right)))
 #define IS_OBJ(value) (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
 
 #define AS_BOOL(value) ((value) == TRUE_VAL)
+#define AS_INT(value) (static_cast<int32_t>(static_cast<uint32_t>(value)))
 #define AS_NUMBER(value) (value_to_number(value))
 #define AS_OBJ(value) (reinterpret_cast<Obj*>((value) & ~(SIGN_BIT | QNAN)))
 
@@ -36,14 +47,19 @@
 #define TRUE_VAL (Value{true})
 #define NIL_VAL (Value{})
 #define NUMBER_VAL(number) (Value{number})
+#define INT_VAL(integer) (Value{static_cast<double>(integer)})
 #define OBJ_VAL(obj) (Value{obj})
 
 #define IS_BOOL(value) ((value).type == VAL_BOOL)
 #define IS_NIL(value) ((value).type == VAL_NIL)
+#define IS_DOUBLE(value) ((value).type == VAL_NUMBER)
+#define IS_INT(value) (false)
 #define IS_NUMBER(value) ((value).type == VAL_NUMBER)
+#define ARE_INTS(left, right) (false)
 #define IS_OBJ(value) ((value).type == VAL_OBJ)
 
 #define AS_BOOL(value) ((value).boolean)
+#define AS_INT(value) (static_cast<int32_t>((value).number))
 #define AS_NUMBER(value) ((value).number)
 #define AS_OBJ(value) ((value).obj)
 
@@ -61,6 +77,10 @@ static inline Value number_to_value(double number) {
 }
 
 static inline double value_to_number(Value value) {
+  if (IS_INT(value)) {
+    return static_cast<double>(AS_INT(value));
+  }
+
   double number{};
   memcpy(&number, &value, sizeof(Value));
   return number;
@@ -88,12 +108,67 @@ struct Value {
 
 #endif
 
-void print_value(Value value);
-bool values_equal(Value left, Value right);
+void print_value(Value value, std::ostream& out = std::cout);
+
+static inline bool numbers_equal(double left, double right) {
+  return std::abs(left - right) <=
+         std::max(std::abs(left), std::abs(right)) *
+             std::numeric_limits<double>::epsilon();
+}
+
+static inline bool values_equal(Value left, Value right) {
+#ifdef NAN_BOXING
+  if (!IS_DOUBLE(left) && !IS_DOUBLE(right)) {
+    return left == right;
+  }
+  if (IS_NUMBER(left) && IS_NUMBER(right)) {
+    return numbers_equal(AS_NUMBER(left), AS_NUMBER(right));
+  }
+  return false;
+#else
+  if (left.type != right.type) {
+    return false;
+  }
+
+  switch (left.type) {
+    case VAL_BOOL:
+      return AS_BOOL(left) == AS_BOOL(right);
+    case VAL_NIL:
+      return true;
+    case VAL_NUMBER:
+      return numbers_equal(AS_NUMBER(left), AS_NUMBER(right));
+    case VAL_OBJ:
+      return AS_OBJ(left) == AS_OBJ(right);
+    default:
+      return false;
+  }
+#endif
+}
 
 static inline bool is_falsey(Value value) {
   return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
+// Results of integer arithmetic are computed in 64 bits and stay tagged
+// integers while they fit, otherwise they are widened to doubles.
+static inline Value integer_to_value(int64_t integer) {
+  if (integer < std::numeric_limits<int32_t>::min() ||
+      integer > std::numeric_limits<int32_t>::max()) {
+    return NUMBER_VAL(static_cast<double>(integer));
+  }
+  return INT_VAL(integer);
+}
+
+// Integer literals and integral doubles use the tagged representation. -0 has
+// no integer form and stays a double.
+static inline Value number_or_int_to_value(double number) {
+  if (number >= std::numeric_limits<int32_t>::min() &&
+      number <= std::numeric_limits<int32_t>::max() &&
+      std::trunc(number) == number && !(number == 0 && std::signbit(number))) {
+    return INT_VAL(static_cast<int32_t>(number));
+  }
+  return NUMBER_VAL(number);
+}
+
 using ValueArray = std::vector<Value>;
 }  // namespace lox::bytecode
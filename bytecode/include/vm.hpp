@@ -3,9 +3,19 @@
 #include <array>
 #include <cstddef>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <stack>
+#include <thread>
+#include <unordered_map>
 
+#include "channel.hpp"
 #include "compiler.hpp"
+#include "event_loop.hpp"
+#include "gc_config.hpp"
+#include "gc_stats.hpp"
+#include "profiler.hpp"
 #include "table.hpp"
 
 namespace lox::bytecode {
@@ -25,14 +35,83 @@ class VM {
   static constexpr int FRAMES_MAX = 64;
   static constexpr int STACK_MAX = FRAMES_MAX * UINT8_COUNT;
 
-  static constexpr size_t GC_HEAP_GROW_FACTOR = 2;
-
  public:
   VM();
+  ~VM() {
+    join_isolates();
+    free_objects();
+  }
+
+  VM(const VM&) = delete;
+  VM& operator=(const VM&) = delete;
+  VM(VM&&) = delete;
+  VM& operator=(VM&&) = delete;
 
   InterpretResult interpret(ObjFunction* function);
 
   void define_native(std::string_view name, NativeFn function);
+  // Makes the native call that is running fail with a runtime error once
+  // it returns.
+  Value native_error(std::string message) {
+    native_error_ = std::move(message);
+    return NIL_VAL;
+  }
+
+  // Copies the value and everything it reaches into a message another VM
+  // can rebuild. Channels are shared rather than copied.
+  Message pack(Value value);
+  Value unpack(const Message& message);
+  // Calls the closure with no arguments on a new thread, in a VM that
+  // starts with copies of this VM's globals and of the closure. interpret
+  // waits for these isolates before it returns and then writes what they
+  // printed.
+  void spawn(ObjClosure* closure);
+
+  // The switch happens once the native asking for it has returned and its
+  // result is on the stack. Resuming passes that result into the fiber;
+  // yielding, with a null fiber, passes it back to the resumer.
+  void switch_fiber(ObjFiber* resumed) {
+    fiber_switch_ = true;
+    resumed_fiber_ = resumed;
+  }
+  [[nodiscard]] bool in_fiber() const { return !fibers_.empty(); }
+
+  // Started on first use, so scripts without I/O open no descriptors.
+  EventLoop& event_loop() {
+    if (event_loop_ == nullptr) {
+      event_loop_ = std::make_unique<EventLoop>();
+    }
+    return *event_loop_;
+  }
+  // Calls the function with the operation's first arg_count results once
+  // it completes. Callbacks run one at a time after the script finishes.
+  void add_callback(EventLoop::Id id, Value function, uint8_t arg_count) {
+    io_callbacks_[id] = {function, arg_count};
+  }
+
+  // Writes every object reachable from the globals. Only valid between
+  // runs, when nothing is left on the stack.
+  void write_snapshot(std::ostream& out);
+  // Defines the globals saved in a snapshot, rebuilding the objects they
+  // reach in this heap. Returns false, defining nothing, if the data is
+  // malformed or was written by another version of the VM.
+  bool restore_snapshot(std::string_view data);
+
+  // Where print statements and error reports go; the standard streams
+  // unless redirected.
+  void set_output(std::ostream& out, std::ostream& err) {
+    out_ = &out;
+    err_ = &err;
+  }
+  std::ostream& error_output() { return *err_; }
+
+  void set_opcode_profiler(OpcodeProfiler* profiler) {
+    opcode_profiler_ = profiler;
+  }
+  void set_sampling_profiler(SamplingProfiler* profiler) {
+    sampling_profiler_ = profiler;
+    sample_countdown_ = profiler != nullptr ? profiler->interval() : 0;
+  }
 
  private:
   InterpretResult run();
@@ -43,6 +122,7 @@ class VM {
   bool invoke(ObjString* name, int arg_count);
   bool call_value(Value callee, int arg_count);
   bool call(ObjClosure* closure, int arg_count);
+  bool tail_call(ObjClosure* closure, int arg_count);
 
   void reset_stack();
   void push(Value value) { *stack_top_++ = value; }
@@ -58,15 +138,60 @@ class VM {
     return frame_top_->closure->function->chunk.get_constants()[read_byte()];
   }
 
+  ObjUpvalue*& open_upvalue_at(const Value* slot) {
+    return open_upvalue_slots_[static_cast<size_t>(slot - stack_.data())];
+  }
   ObjUpvalue* capture_upvalue(Value* local);
   void close_upvalues(const Value* last);
 
   void runtime_error(const std::string& message);
 
+  void take_sample();
+
+  struct Isolate {
+    std::thread thread;
+    std::ostringstream out;
+    std::ostringstream err;
+    InterpretResult result{};
+  };
+  struct RunningFiber {
+    ObjFiber* fiber;
+    Value* base;
+    uint8_t frame_base;
+  };
+  bool enter_fiber(ObjFiber* fiber, Value value);
+  void leave_fiber(Value value, FiberState state);
+
+  struct IoCallback {
+    Value function;
+    uint8_t arg_count;
+  };
+  InterpretResult run_events();
+
+  InterpretResult run_isolate(const Message& message);
+  // Returns whether every isolate ran without error.
+  bool join_isolates();
+
+  // Writes the objects reachable from the globals and the value, then the
+  // globals and the value as references to them. Channels are added to
+  // the list if there is one, and restored as new empty channels if not.
+  void write_heap(std::ostream& out, const Table& globals, Value value,
+                  std::vector<std::shared_ptr<Channel>>* channels);
+  bool read_heap(std::string_view data, Table& globals, Value& value,
+                 const std::vector<std::shared_ptr<Channel>>& channels);
+
   Obj* objects_{};
   Table globals_;
   Table strings_;
   ObjString* init_string_{};
+  // Natives in definition order, which a snapshot refers to them by.
+  std::vector<NativeFn> natives_;
+  // Objects rebuilt so far by restore_snapshot or unpack.
+  std::vector<Obj*> restored_objects_;
+  std::optional<std::string> native_error_;
+  std::vector<std::unique_ptr<Isolate>> isolates_;
+  std::unique_ptr<EventLoop> event_loop_;
+  std::unordered_map<EventLoop::Id, IoCallback> io_callbacks_;
 
   std::array<CallFrame, FRAMES_MAX> frames_;
   CallFrame* frame_top_{};
@@ -76,17 +201,31 @@ class VM {
   Value* stack_top_{};
 
   ObjUpvalue* open_upvalues_{};
+  std::array<ObjUpvalue*, STACK_MAX> open_upvalue_slots_{};
+
+  // Fibers running now, innermost last. Returning to the frame count its
+  // first call started from finishes the innermost one.
+  std::vector<RunningFiber> fibers_;
+  uint8_t fiber_frame_base_{};
+  bool fiber_switch_{};
+  ObjFiber* resumed_fiber_{};
+
+  std::ostream* out_{&std::cout};
+  std::ostream* err_{&std::cerr};
+
+  OpcodeProfiler* opcode_profiler_{};
+  SamplingProfiler* sampling_profiler_{};
+  uint32_t sample_countdown_{};
 
  public:
   template <typename ObjT, typename... Args>
   ObjT* allocate_object(Args&&... args) {
-#ifdef DEBUG_STRESS_GC
-    collect_garbage();
-#endif
-
-    if (bytes_allocated_ > next_gc_) {
-      collect_garbage();
+    // Strings count their characters too.
+    size_t size = sizeof(ObjT);
+    if constexpr (std::is_same_v<ObjT, ObjString>) {
+      size += std::string_view{args...}.size();
     }
+    reserve_heap(size);
 
     ObjT* object{};
     if constexpr (std::is_same_v<ObjT, ObjString>) {
@@ -112,20 +251,53 @@ class VM {
       pop();
     }
 
-    bytes_allocated_ += sizeof(ObjT);
+    bytes_allocated_ += size;
+    gc_stats_.record_allocation(object->type);
 
 #ifdef DEBUG_LOG_GC
-    std::cout << static_cast<void*>(object) << " allocate " << sizeof(ObjT)
+    std::cout << static_cast<void*>(object) << " allocate " << size
               << " for " << object->type << "\n";
 #endif
 
     return object;
   }
 
+  // Counts the elements toward the heap as well as the object, so large
+  // arrays bring collections forward and respect the heap limit.
+  ObjFloat64Array* allocate_float64_array(size_t length);
+  // The elements must stay reachable some other way until this returns.
+  ObjList* allocate_list(std::vector<Value> elements);
+  ObjMap* allocate_map();
+  // Counts storage the list or map grew since it was last counted. It must
+  // be reachable, since this can collect.
+  void track_storage(ObjList* list);
+  void track_storage(ObjMap* map);
+
   void collect_garbage();
   void free_objects();
 
+  // Keeps objects the program cannot reach yet, such as functions being
+  // compiled or loaded, alive across collections.
+  void push_root(Obj* object) { roots_.push_back(object); }
+  void pop_root() { roots_.pop_back(); }
+
+  [[nodiscard]] std::optional<double> gc_stat(std::string_view key) const {
+    return gc_stats_.query(key, bytes_allocated_, next_gc_);
+  }
+  void print_gc_stats(std::ostream& out) const {
+    gc_stats_.print_report(out, bytes_allocated_, next_gc_);
+  }
+  void configure_gc(const GcConfig& config) {
+    gc_heuristics_ = GcHeuristics{config};
+    next_gc_ = gc_heuristics_.initial_threshold();
+  }
+
  private:
+  // Collects if the bytes would take the heap past the next threshold or
+  // the limit, and throws HeapLimitError if they still pass the limit.
+  void reserve_heap(size_t bytes);
+  void charge(size_t& charged, size_t bytes);
+
   void mark_object(Obj* object);
   void mark_value(Value value);
   void mark_table(const Table& table);
@@ -136,12 +308,16 @@ class VM {
   void sweep();
 
   size_t bytes_allocated_{};
-  size_t next_gc_{static_cast<size_t>(1024 * 1024)};
+  GcHeuristics gc_heuristics_;
+  size_t next_gc_{gc_heuristics_.initial_threshold()};
   std::stack<Obj*> gray_stack_;
+  std::vector<Obj*> roots_;
+  Compiler* compiler_{};
 
-  friend size_t Chunk::add_constant(Value value);
-  friend void Compiler::mark_compiler_roots();
-};
+  GcStats gc_stats_{{"bound method", "channel", "class", "closure", "fiber",
+                     "float64 array", "function", "instance", "list", "map",
+                     "native", "string", "upvalue"}};
 
-inline VM g_vm;
+  friend class Compiler;
+};
 }  // namespace lox::bytecode
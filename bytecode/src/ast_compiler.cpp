@@ -0,0 +1,927 @@
+// Both front ends define the same value macros. The treewalk headers are
+// included first and their macros dropped before the bytecode headers
+// define their own; treewalk values are only read through their members.
+#include "treewalk/include/treewalk.hpp"
+
+#undef IS_BOOL
+#undef IS_NIL
+#undef IS_NUMBER
+#undef IS_OBJ
+#undef IS_CLASS
+#undef IS_FUNCTION
+#undef IS_INSTANCE
+#undef IS_NATIVE
+#undef IS_STRING
+#undef AS_BOOL
+#undef AS_NUMBER
+#undef AS_OBJ
+#undef AS_CLASS
+#undef AS_FUNCTION
+#undef AS_INSTANCE
+#undef AS_NATIVE
+#undef AS_STRING
+
+#include "ast_compiler.hpp"
+
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "vm.hpp"
+
+namespace lox::bytecode {
+namespace {
+namespace tw = lox::treewalk;
+
+// Finds local function declarations whose closures never outlive the frame
+// that declares them: the name is only ever the callee of a call made
+// directly from the declaring function. Such a function can read and write
+// that frame's locals in place instead of capturing them as upvalues.
+class EscapeAnalysis : public tw::expr::Visitor, public tw::stmt::Visitor {
+  struct Declaration {
+    const tw::stmt::Function* function;
+    int function_depth;
+  };
+
+ public:
+  std::unordered_set<const tw::stmt::Function*> run(
+      tw::NodeList<tw::Stmt*> statements) {
+    walk(statements);
+    return std::move(in_frame_);
+  }
+
+ private:
+  void walk(tw::NodeList<tw::Stmt*> statements) {
+    for (tw::Stmt* statement : statements) {
+      statement->accept(*this);
+    }
+  }
+  void walk(tw::Expr* expr) { expr->accept(*this); }
+
+  void visit(tw::stmt::Block& block) override {
+    scopes_.emplace_back();
+    walk(block.statements);
+    scopes_.pop_back();
+  }
+  void visit(tw::stmt::Class& class_) override {
+    declare(class_.name.lexeme, nullptr);
+    if (class_.superclass != nullptr) {
+      walk(class_.superclass);
+    }
+    for (tw::stmt::Function* method : class_.methods) {
+      body(*method);
+    }
+  }
+  void visit(tw::stmt::Expression& expression) override {
+    walk(expression.expr);
+  }
+  void visit(tw::stmt::Function& function) override {
+    declare(function.name.lexeme, &function);
+    body(function);
+  }
+  void visit(tw::stmt::If& if_) override {
+    walk(if_.condition);
+    if_.then_branch->accept(*this);
+    if (if_.else_branch != nullptr) {
+      if_.else_branch->accept(*this);
+    }
+  }
+  void visit(tw::stmt::Print& print) override { walk(print.expr); }
+  void visit(tw::stmt::Return& return_) override {
+    if (return_.value != nullptr) {
+      walk(return_.value);
+    }
+  }
+  void visit(tw::stmt::Var& var) override {
+    if (var.initializer != nullptr) {
+      walk(var.initializer);
+    }
+    declare(var.name.lexeme, nullptr);
+  }
+  void visit(tw::stmt::While& while_) override {
+    walk(while_.condition);
+    while_.body->accept(*this);
+  }
+
+  void visit(tw::expr::Assign& assign) override {
+    walk(assign.value);
+    use(assign.name.lexeme, false);
+  }
+  void visit(tw::expr::Binary& binary) override {
+    walk(binary.left);
+    walk(binary.right);
+  }
+  void visit(tw::expr::Call& call) override {
+    if (auto* callee = dynamic_cast<tw::expr::Variable*>(call.callee)) {
+      use(callee->name.lexeme, true);
+    } else {
+      walk(call.callee);
+    }
+    for (tw::Expr* argument : call.arguments) {
+      walk(argument);
+    }
+  }
+  void visit(tw::expr::Get& get) override { walk(get.object); }
+  void visit(tw::expr::GetIndex& get_index) override {
+    walk(get_index.object);
+    walk(get_index.index);
+  }
+  void visit(tw::expr::Grouping& grouping) override { walk(grouping.expr); }
+  void visit(tw::expr::List& list) override {
+    for (tw::Expr* element : list.elements) {
+      walk(element);
+    }
+  }
+  void visit(tw::expr::Literal& /*literal*/) override {}
+  void visit(tw::expr::Logical& logical) override {
+    walk(logical.left);
+    walk(logical.right);
+  }
+  void visit(tw::expr::Set& set) override {
+    walk(set.object);
+    walk(set.value);
+  }
+  void visit(tw::expr::SetIndex& set_index) override {
+    walk(set_index.object);
+    walk(set_index.index);
+    walk(set_index.value);
+  }
+  void visit(tw::expr::This& /*this_*/) override {}
+  void visit(tw::expr::Super& /*super*/) override {}
+  void visit(tw::expr::Unary& unary) override { walk(unary.right); }
+  void visit(tw::expr::Variable& variable) override {
+    use(variable.name.lexeme, false);
+  }
+
+  void body(const tw::stmt::Function& function) {
+    function_depth_++;
+    scopes_.emplace_back();
+    for (const tw::AstToken& param : function.params) {
+      declare(param.lexeme, nullptr);
+    }
+    walk(function.body);
+    scopes_.pop_back();
+    function_depth_--;
+  }
+
+  // Globals can be reached from anywhere, so only locals are tracked.
+  void declare(std::string_view name, const tw::stmt::Function* function) {
+    if (scopes_.empty()) {
+      return;
+    }
+    scopes_.back()[name] = {function, function_depth_};
+    if (function != nullptr) {
+      in_frame_.insert(function);
+    }
+  }
+
+  void use(std::string_view name, bool is_callee) {
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+      const auto found = scope->find(name);
+      if (found == scope->end()) {
+        continue;
+      }
+      const Declaration& declaration = found->second;
+      if (declaration.function != nullptr &&
+          (!is_callee || declaration.function_depth != function_depth_)) {
+        in_frame_.erase(declaration.function);
+      }
+      return;
+    }
+  }
+
+  std::vector<std::unordered_map<std::string_view, Declaration>> scopes_;
+  int function_depth_{};
+  std::unordered_set<const tw::stmt::Function*> in_frame_;
+};
+
+class AstCompiler : public tw::expr::Visitor, public tw::stmt::Visitor {
+  struct Local {
+    std::string_view name;
+    int depth{};
+    bool is_captured{};
+    // Holds a function that runs on top of this frame; see EscapeAnalysis.
+    bool in_frame{};
+  };
+
+  struct Upvalue {
+    uint8_t index{};
+    bool is_local{};
+  };
+
+  struct Access {
+    uint8_t get_op;
+    uint8_t set_op;
+    uint8_t arg;
+  };
+
+ public:
+  enum FunctionType {
+    TYPE_FUNCTION,
+    TYPE_INITIALIZER,
+    TYPE_METHOD,
+    TYPE_SCRIPT
+  };
+
+  // Shared by a compiler and the compilers of the functions nested in it.
+  struct Context {
+    VM& vm;
+    std::unordered_set<const tw::stmt::Function*> in_frame_functions;
+    bool had_error{};
+  };
+
+  AstCompiler(Context& context, FunctionType type, AstCompiler* enclosing,
+              const tw::AstToken* name);
+  ~AstCompiler() override { context_.vm.pop_root(); }
+
+  AstCompiler(const AstCompiler&) = delete;
+  AstCompiler& operator=(const AstCompiler&) = delete;
+  AstCompiler(AstCompiler&&) = delete;
+  AstCompiler& operator=(AstCompiler&&) = delete;
+
+  void lower(tw::NodeList<tw::Stmt*> statements);
+  ObjFunction* end_compiler();
+
+ private:
+  void lower(tw::Expr* expr) { expr->accept(*this); }
+  void visit(tw::stmt::Block& block) override;
+  void visit(tw::stmt::Class& class_) override;
+  void visit(tw::stmt::Expression& expression) override;
+  void visit(tw::stmt::Function& function) override;
+  void visit(tw::stmt::If& if_) override;
+  void visit(tw::stmt::Print& print) override;
+  void visit(tw::stmt::Return& return_) override;
+  void visit(tw::stmt::Var& var) override;
+  void visit(tw::stmt::While& while_) override;
+
+  void visit(tw::expr::Assign& assign) override;
+  void visit(tw::expr::Binary& binary) override;
+  void visit(tw::expr::Call& call) override;
+  void visit(tw::expr::Get& get) override;
+  void visit(tw::expr::GetIndex& get_index) override;
+  void visit(tw::expr::Grouping& grouping) override;
+  void visit(tw::expr::List& list) override;
+  void visit(tw::expr::Literal& literal) override;
+  void visit(tw::expr::Logical& logical) override;
+  void visit(tw::expr::Set& set) override;
+  void visit(tw::expr::SetIndex& set_index) override;
+  void visit(tw::expr::This& this_) override;
+  void visit(tw::expr::Super& super) override;
+  void visit(tw::expr::Unary& unary) override;
+  void visit(tw::expr::Variable& variable) override;
+
+  void function(tw::stmt::Function& declaration, FunctionType type,
+                bool in_frame = false);
+  uint8_t argument_list(tw::NodeList<tw::Expr*> arguments);
+
+  void emit_byte(uint8_t byte);
+  void emit_bytes(uint8_t byte1, uint8_t byte2);
+  void emit_constant(Value value);
+  void emit_return();
+  uint32_t emit_jump(uint8_t instruction);
+  void patch_jump(uint32_t offset);
+  void emit_loop(uint32_t loop_start);
+
+  uint8_t declare_variable(std::string_view name);
+  void define_variable(uint8_t global);
+  void load(std::string_view name);
+  Access resolve(std::string_view name);
+  bool is_in_frame_call(const tw::expr::Call& call);
+  std::optional<uint8_t> resolve_local(std::string_view name);
+  std::optional<uint8_t> resolve_upvalue(std::string_view name);
+  void add_local(std::string_view name);
+  std::optional<uint8_t> add_upvalue(uint8_t index, bool is_local);
+  void mark_initialized();
+  uint8_t make_constant(Value value);
+  uint8_t identifier_constant(std::string_view name);
+  void begin_scope() { scope_depth_++; }
+  void end_scope();
+
+  Chunk* current_chunk() { return &function_->chunk; }
+  uint32_t current_chunk_size() {
+    return static_cast<uint32_t>(current_chunk()->get_codes().size());
+  }
+
+  void error(std::string_view message) const;
+
+  ObjFunction* function_{};
+  FunctionType type_;
+
+  std::array<Local, UINT8_COUNT> locals_;
+  uint16_t local_count_{};
+  std::array<Upvalue, UINT8_COUNT> upvalues_;
+  int scope_depth_{};
+
+  std::optional<uint32_t> last_call_;
+  // Line of the most recent token seen; literals carry none of their own.
+  int line_{};
+
+  AstCompiler* enclosing_{};
+  // Reads the enclosing function's locals from its frame, which is always
+  // the caller's.
+  bool in_frame_{};
+  Context& context_;
+};
+
+AstCompiler::AstCompiler(Context& context, FunctionType type,
+                         AstCompiler* enclosing, const tw::AstToken* name)
+    : type_{type}, enclosing_{enclosing}, context_{context} {
+  if (enclosing != nullptr) {
+    line_ = enclosing->line_;
+  }
+
+  function_ = context_.vm.allocate_object<ObjFunction>();
+  context_.vm.push_root(function_);
+  if (name != nullptr) {
+    function_->name = context_.vm.allocate_object<ObjString>(name->lexeme);
+  }
+
+  locals_[0].name = type != TYPE_FUNCTION ? "this" : "";
+  local_count_++;
+}
+
+void AstCompiler::lower(tw::NodeList<tw::Stmt*> statements) {
+  for (tw::Stmt* statement : statements) {
+    statement->accept(*this);
+  }
+}
+
+ObjFunction* AstCompiler::end_compiler() {
+  emit_return();
+#ifdef DEBUG_PRINT_CODE
+  if (!context_.had_error) {
+    current_chunk()->disassemble(
+        function_->name != nullptr ? function_->name->string : "<script>");
+  }
+#endif
+
+  return context_.had_error ? nullptr : function_;
+}
+
+void AstCompiler::visit(tw::stmt::Block& block) {
+  begin_scope();
+  lower(block.statements);
+  end_scope();
+}
+
+void AstCompiler::visit(tw::stmt::Class& class_) {
+  line_ = class_.name.line;
+  const uint8_t name_constant = identifier_constant(class_.name.lexeme);
+  declare_variable(class_.name.lexeme);
+
+  emit_bytes(OP_CLASS, name_constant);
+  define_variable(name_constant);
+
+  if (class_.superclass != nullptr) {
+    lower(class_.superclass);
+    begin_scope();
+    add_local("super");
+    mark_initialized();
+    load(class_.name.lexeme);
+    emit_byte(OP_INHERIT);
+  }
+
+  load(class_.name.lexeme);
+  for (tw::stmt::Function* method : class_.methods) {
+    line_ = method->name.line;
+    const uint8_t constant = identifier_constant(method->name.lexeme);
+    function(*method,
+             method->name.lexeme == "init" ? TYPE_INITIALIZER : TYPE_METHOD);
+    emit_bytes(OP_METHOD, constant);
+  }
+  emit_byte(OP_POP);
+
+  if (class_.superclass != nullptr) {
+    end_scope();
+  }
+}
+
+void AstCompiler::visit(tw::stmt::Expression& expression) {
+  lower(expression.expr);
+  emit_byte(OP_POP);
+}
+
+void AstCompiler::visit(tw::stmt::Function& function) {
+  line_ = function.name.line;
+  const uint8_t global = declare_variable(function.name.lexeme);
+  mark_initialized();
+
+  const bool in_frame = scope_depth_ > 0 &&
+                        context_.in_frame_functions.count(&function) != 0;
+  if (in_frame) {
+    locals_[local_count_ - 1].in_frame = true;
+  }
+  this->function(function, TYPE_FUNCTION, in_frame);
+  define_variable(global);
+}
+
+void AstCompiler::visit(tw::stmt::If& if_) {
+  lower(if_.condition);
+
+  const uint32_t then_jump = emit_jump(OP_JUMP_IF_FALSE);
+  emit_byte(OP_POP);
+  if_.then_branch->accept(*this);
+
+  const uint32_t else_jump = emit_jump(OP_JUMP);
+
+  patch_jump(then_jump);
+  emit_byte(OP_POP);
+
+  if (if_.else_branch != nullptr) {
+    if_.else_branch->accept(*this);
+  }
+
+  patch_jump(else_jump);
+}
+
+void AstCompiler::visit(tw::stmt::Print& print) {
+  lower(print.expr);
+  emit_byte(OP_PRINT);
+}
+
+void AstCompiler::visit(tw::stmt::Return& return_) {
+  line_ = return_.keyword.line;
+  if (return_.value == nullptr) {
+    emit_return();
+    return;
+  }
+
+  lower(return_.value);
+  if (last_call_ && *last_call_ == current_chunk_size() - 2) {
+    current_chunk()->set_code(*last_call_, OP_TAIL_CALL);
+  }
+  emit_byte(OP_RETURN);
+}
+
+void AstCompiler::visit(tw::stmt::Var& var) {
+  line_ = var.name.line;
+  const uint8_t global = declare_variable(var.name.lexeme);
+
+  if (var.initializer != nullptr) {
+    lower(var.initializer);
+  } else {
+    emit_byte(OP_NIL);
+  }
+
+  define_variable(global);
+}
+
+void AstCompiler::visit(tw::stmt::While& while_) {
+  const uint32_t loop_start = current_chunk_size();
+  lower(while_.condition);
+
+  const uint32_t exit_jump = emit_jump(OP_JUMP_IF_FALSE);
+  emit_byte(OP_POP);
+  while_.body->accept(*this);
+  emit_loop(loop_start);
+
+  patch_jump(exit_jump);
+  emit_byte(OP_POP);
+}
+
+void AstCompiler::visit(tw::expr::Assign& assign) {
+  lower(assign.value);
+  line_ = assign.name.line;
+  const Access access = resolve(assign.name.lexeme);
+  emit_bytes(access.set_op, access.arg);
+}
+
+void AstCompiler::visit(tw::expr::Binary& binary) {
+  lower(binary.left);
+  lower(binary.right);
+  line_ = binary.op.line;
+
+  switch (binary.op.type) {
+    case TOKEN_BANG_EQUAL:
+      emit_bytes(OP_EQUAL, OP_NOT);
+      break;
+    case TOKEN_EQUAL_EQUAL:
+      emit_byte(OP_EQUAL);
+      break;
+    case TOKEN_GREATER:
+      emit_byte(OP_GREATER);
+      break;
+    case TOKEN_GREATER_EQUAL:
+      emit_bytes(OP_LESS, OP_NOT);
+      break;
+    case TOKEN_LESS:
+      emit_byte(OP_LESS);
+      break;
+    case TOKEN_LESS_EQUAL:
+      emit_bytes(OP_GREATER, OP_NOT);
+      break;
+    case TOKEN_PLUS:
+      emit_byte(OP_ADD);
+      break;
+    case TOKEN_MINUS:
+      emit_byte(OP_SUBTRACT);
+      break;
+    case TOKEN_STAR:
+      emit_byte(OP_MULTIPLY);
+      break;
+    case TOKEN_SLASH:
+      emit_byte(OP_DIVIDE);
+      break;
+    default:
+      return;
+  }
+}
+
+void AstCompiler::visit(tw::expr::Call& call) {
+  if (call.property != nullptr) {
+    lower(call.property->object);
+    const uint8_t name = identifier_constant(call.property->name.lexeme);
+    const uint8_t arg_count = argument_list(call.arguments);
+    line_ = call.paren.line;
+    emit_bytes(OP_INVOKE, name);
+    emit_byte(arg_count);
+    return;
+  }
+
+  if (auto* super = dynamic_cast<tw::expr::Super*>(call.callee)) {
+    const uint8_t name = identifier_constant(super->method.lexeme);
+    load("this");
+    const uint8_t arg_count = argument_list(call.arguments);
+    load("super");
+    line_ = call.paren.line;
+    emit_bytes(OP_SUPER_INVOKE, name);
+    emit_byte(arg_count);
+    return;
+  }
+
+  lower(call.callee);
+  const uint8_t arg_count = argument_list(call.arguments);
+  line_ = call.paren.line;
+  // A function running in this frame must not replace it with a tail call.
+  if (is_in_frame_call(call)) {
+    last_call_.reset();
+  } else {
+    last_call_ = current_chunk_size();
+  }
+  emit_bytes(OP_CALL, arg_count);
+}
+
+void AstCompiler::visit(tw::expr::Get& get) {
+  lower(get.object);
+  line_ = get.name.line;
+  emit_bytes(OP_GET_PROPERTY, identifier_constant(get.name.lexeme));
+}
+
+void AstCompiler::visit(tw::expr::GetIndex& get_index) {
+  lower(get_index.object);
+  lower(get_index.index);
+  line_ = get_index.bracket.line;
+  emit_byte(OP_GET_INDEX);
+}
+
+void AstCompiler::visit(tw::expr::Grouping& grouping) {
+  lower(grouping.expr);
+}
+
+void AstCompiler::visit(tw::expr::List& list) {
+  const uint8_t element_count = argument_list(list.elements);
+  line_ = list.bracket.line;
+  emit_bytes(OP_BUILD_LIST, element_count);
+}
+
+void AstCompiler::visit(tw::expr::Literal& literal) {
+  const tw::Value& value = literal.value;
+  if (literal.is_string) {
+    emit_constant(
+        OBJ_VAL(context_.vm.allocate_object<ObjString>(literal.string)));
+  } else if (value.is_nil()) {
+    emit_byte(OP_NIL);
+  } else if (value.is_bool()) {
+    emit_byte(value.as_bool() ? OP_TRUE : OP_FALSE);
+  } else if (value.is_number()) {
+    emit_constant(number_or_int_to_value(value.as_number()));
+  }
+}
+
+void AstCompiler::visit(tw::expr::Logical& logical) {
+  lower(logical.left);
+  line_ = logical.op.line;
+
+  if (logical.op.type == TOKEN_OR) {
+    const uint32_t else_jump = emit_jump(OP_JUMP_IF_FALSE);
+    const uint32_t end_jump = emit_jump(OP_JUMP);
+
+    patch_jump(else_jump);
+    emit_byte(OP_POP);
+
+    lower(logical.right);
+    patch_jump(end_jump);
+    return;
+  }
+
+  const uint32_t end_jump = emit_jump(OP_JUMP_IF_FALSE);
+
+  emit_byte(OP_POP);
+  lower(logical.right);
+
+  patch_jump(end_jump);
+}
+
+void AstCompiler::visit(tw::expr::Set& set) {
+  lower(set.object);
+  lower(set.value);
+  line_ = set.name.line;
+  emit_bytes(OP_SET_PROPERTY, identifier_constant(set.name.lexeme));
+}
+
+void AstCompiler::visit(tw::expr::SetIndex& set_index) {
+  lower(set_index.object);
+  lower(set_index.index);
+  lower(set_index.value);
+  line_ = set_index.bracket.line;
+  emit_byte(OP_SET_INDEX);
+}
+
+void AstCompiler::visit(tw::expr::This& this_) {
+  line_ = this_.keyword.line;
+  load("this");
+}
+
+void AstCompiler::visit(tw::expr::Super& super) {
+  line_ = super.keyword.line;
+  const uint8_t name = identifier_constant(super.method.lexeme);
+  load("this");
+  load("super");
+  emit_bytes(OP_GET_SUPER, name);
+}
+
+void AstCompiler::visit(tw::expr::Unary& unary) {
+  lower(unary.right);
+  line_ = unary.op.line;
+
+  switch (unary.op.type) {
+    case TOKEN_BANG:
+      emit_byte(OP_NOT);
+      break;
+    case TOKEN_MINUS:
+      emit_byte(OP_NEGATE);
+      break;
+    default:
+      return;
+  }
+}
+
+void AstCompiler::visit(tw::expr::Variable& variable) {
+  line_ = variable.name.line;
+  load(variable.name.lexeme);
+}
+
+void AstCompiler::function(tw::stmt::Function& declaration,
+                           FunctionType type, bool in_frame) {
+  AstCompiler compiler{context_, type, this, &declaration.name};
+  compiler.in_frame_ = in_frame;
+  compiler.begin_scope();
+
+  compiler.function_->arity = static_cast<int>(declaration.params.size());
+  for (const tw::AstToken& param : declaration.params) {
+    compiler.add_local(param.lexeme);
+    compiler.mark_initialized();
+  }
+  compiler.lower(declaration.body);
+
+  ObjFunction* function = compiler.end_compiler();
+  if (function == nullptr) {
+    return;
+  }
+
+  emit_bytes(OP_CLOSURE, make_constant(OBJ_VAL(function)));
+
+  for (size_t i = 0; i < function->upvalue_count; i++) {
+    emit_byte(compiler.upvalues_[i].is_local ? 1 : 0);
+    emit_byte(compiler.upvalues_[i].index);
+  }
+}
+
+uint8_t AstCompiler::argument_list(tw::NodeList<tw::Expr*> arguments) {
+  // The parser already rejects more than 255 arguments.
+  for (tw::Expr* argument : arguments) {
+    lower(argument);
+  }
+  return static_cast<uint8_t>(arguments.size());
+}
+
+void AstCompiler::emit_byte(uint8_t byte) {
+  current_chunk()->write(byte, line_);
+}
+
+void AstCompiler::emit_bytes(uint8_t byte1, uint8_t byte2) {
+  emit_byte(byte1);
+  emit_byte(byte2);
+}
+
+void AstCompiler::emit_constant(Value value) {
+  emit_bytes(OP_CONSTANT, make_constant(value));
+}
+
+void AstCompiler::emit_return() {
+  if (type_ == TYPE_INITIALIZER) {
+    emit_bytes(OP_GET_LOCAL, 0);
+  } else {
+    emit_byte(OP_NIL);
+  }
+
+  emit_byte(OP_RETURN);
+}
+
+uint32_t AstCompiler::emit_jump(uint8_t instruction) {
+  emit_byte(instruction);
+  emit_byte(0xFF);
+  emit_byte(0xFF);
+  return current_chunk_size() - 2;
+}
+
+void AstCompiler::patch_jump(uint32_t offset) {
+  const uint32_t jump = current_chunk_size() - offset - 2;
+
+  if (jump > std::numeric_limits<uint16_t>::max()) {
+    error("Too much code to jump over.");
+  }
+
+  current_chunk()->set_code(offset, (jump >> 8U) & 0xFFU);
+  current_chunk()->set_code(offset + 1, jump & 0xFFU);
+}
+
+void AstCompiler::emit_loop(uint32_t loop_start) {
+  emit_byte(OP_LOOP);
+
+  const uint32_t offset = current_chunk_size() - loop_start + 2;
+  if (offset > std::numeric_limits<uint16_t>::max()) {
+    error("Loop body too large.");
+  }
+
+  emit_byte((offset >> 8U) & 0xFFU);
+  emit_byte(offset & 0xFFU);
+}
+
+// The resolver has already rejected redeclarations and reads of a local in
+// its own initializer, so declaring only has to pick a slot or a global.
+uint8_t AstCompiler::declare_variable(std::string_view name) {
+  if (scope_depth_ == 0) {
+    return identifier_constant(name);
+  }
+
+  add_local(name);
+  return 0;
+}
+
+void AstCompiler::define_variable(uint8_t global) {
+  if (scope_depth_ > 0) {
+    mark_initialized();
+    return;
+  }
+
+  emit_bytes(OP_DEFINE_GLOBAL, global);
+}
+
+void AstCompiler::load(std::string_view name) {
+  const Access access = resolve(name);
+  emit_bytes(access.get_op, access.arg);
+}
+
+AstCompiler::Access AstCompiler::resolve(std::string_view name) {
+  if (const auto local = resolve_local(name)) {
+    return {OP_GET_LOCAL, OP_SET_LOCAL, *local};
+  }
+  if (in_frame_) {
+    if (const auto local = enclosing_->resolve_local(name)) {
+      return {OP_GET_CALLER_LOCAL, OP_SET_CALLER_LOCAL, *local};
+    }
+  }
+  if (const auto upvalue = resolve_upvalue(name)) {
+    return {OP_GET_UPVALUE, OP_SET_UPVALUE, *upvalue};
+  }
+  return {OP_GET_GLOBAL, OP_SET_GLOBAL, identifier_constant(name)};
+}
+
+bool AstCompiler::is_in_frame_call(const tw::expr::Call& call) {
+  const auto* callee = dynamic_cast<const tw::expr::Variable*>(call.callee);
+  if (callee == nullptr) {
+    return false;
+  }
+  const auto local = resolve_local(callee->name.lexeme);
+  return local && locals_[*local].in_frame;
+}
+
+std::optional<uint8_t> AstCompiler::resolve_local(std::string_view name) {
+  for (size_t i = local_count_; i-- > 0;) {
+    if (locals_[i].name == name) {
+      return i;
+    }
+  }
+
+  return {};
+}
+
+std::optional<uint8_t> AstCompiler::resolve_upvalue(std::string_view name) {
+  if (enclosing_ == nullptr) {
+    return {};
+  }
+
+  const auto local = enclosing_->resolve_local(name);
+  if (local) {
+    enclosing_->locals_[*local].is_captured = true;
+    return add_upvalue(*local, true);
+  }
+
+  const auto upvalue = enclosing_->resolve_upvalue(name);
+  if (upvalue) {
+    return add_upvalue(*upvalue, false);
+  }
+
+  return {};
+}
+
+void AstCompiler::add_local(std::string_view name) {
+  if (local_count_ == UINT8_COUNT) {
+    error("Too many local variables in function.");
+    return;
+  }
+
+  Local& local = locals_[local_count_++];
+  local.name = name;
+  local.depth = -1;
+  local.is_captured = false;
+  local.in_frame = false;
+}
+
+std::optional<uint8_t> AstCompiler::add_upvalue(uint8_t index,
+                                                bool is_local) {
+  const uint16_t upvalue_count = function_->upvalue_count;
+
+  for (size_t i = 0; i < upvalue_count; i++) {
+    const Upvalue& upvalue = upvalues_[i];
+    if (upvalue.index == index && upvalue.is_local == is_local) {
+      return i;
+    }
+  }
+
+  if (upvalue_count == UINT8_COUNT) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+
+  upvalues_[upvalue_count].is_local = is_local;
+  upvalues_[upvalue_count].index = index;
+  return function_->upvalue_count++;
+}
+
+void AstCompiler::mark_initialized() {
+  if (scope_depth_ == 0) {
+    return;
+  }
+
+  locals_[local_count_ - 1].depth = scope_depth_;
+}
+
+uint8_t AstCompiler::make_constant(Value value) {
+  const size_t index = current_chunk()->add_constant(value);
+  if (index >= UINT8_COUNT) {
+    error("Too many constants in one chunk.");
+    return 0;
+  }
+
+  return static_cast<uint8_t>(index);
+}
+
+uint8_t AstCompiler::identifier_constant(std::string_view name) {
+  return make_constant(OBJ_VAL(context_.vm.allocate_object<ObjString>(name)));
+}
+
+void AstCompiler::end_scope() {
+  scope_depth_--;
+  while (local_count_ > 0 && locals_[local_count_ - 1].depth > scope_depth_) {
+    if (locals_[local_count_ - 1].is_captured) {
+      emit_byte(OP_CLOSE_UPVALUE);
+    } else {
+      emit_byte(OP_POP);
+    }
+    local_count_--;
+  }
+}
+
+void AstCompiler::error(std::string_view message) const {
+  context_.vm.error_output() << "[line " << line_ << "] Error: " << message
+                             << '\n';
+  context_.had_error = true;
+}
+}  // namespace
+
+ObjFunction* compile_ast(VM& vm, const std::string& source) {
+  tw::Arena arena;
+  const std::optional<tw::NodeList<tw::Stmt*>> statements =
+      tw::parse(source, arena);
+  if (!statements) {
+    return nullptr;
+  }
+
+  AstCompiler::Context context{vm, EscapeAnalysis{}.run(*statements)};
+  AstCompiler compiler{context, AstCompiler::TYPE_SCRIPT, nullptr, nullptr};
+  compiler.lower(*statements);
+  return compiler.end_compiler();
+}
+}  // namespace lox::bytecode
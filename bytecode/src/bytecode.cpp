@@ -1,34 +1,230 @@
 #include "bytecode.hpp"
 
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
+#include "ast_compiler.hpp"
+#include "bytecode_file.hpp"
 #include "compiler.hpp"
+#include "isolate_pool.hpp"
 #include "vm.hpp"
 
 namespace lox::bytecode {
 namespace {
-InterpretResult run(const std::string& source) {
+ObjFunction* compile(VM& vm, const std::string& source,
+                     const Options& options) {
+  if (options.ast) {
+    return compile_ast(vm, source);
+  }
   Scanner scanner{source};
-  Compiler compiler{scanner};
+  Compiler compiler{vm, scanner};
+  return compiler.compile();
+}
+
+bool write_bytecode_file(const std::string& path, const ObjFunction* script,
+                         uint64_t source_hash) {
+  std::ofstream out{path, std::ios::binary};
+  write_bytecode(out, script, source_hash);
+  return static_cast<bool>(out);
+}
+
+std::optional<std::string> read_file(const std::string& path) {
+  std::ifstream file_stream{path, std::ios::binary};
+  if (!file_stream) {
+    return {};
+  }
+  return std::string{std::istreambuf_iterator<char>{file_stream},
+                     std::istreambuf_iterator<char>{}};
+}
+
+// Compiles the source, unless it is a precompiled script or cache_path
+// holds one compiled from the same source. A fresh compile is written back
+// to cache_path.
+ObjFunction* load(VM& vm, const std::string& source, const Options& options,
+                  const std::string& cache_path) {
+  if (is_bytecode_file(source)) {
+    ObjFunction* function = read_bytecode(vm, source);
+    if (function == nullptr) {
+      std::cerr << "Invalid or outdated bytecode file.\n";
+    }
+    return function;
+  }
+  if (cache_path.empty()) {
+    return compile(vm, source, options);
+  }
+
+  const uint64_t source_hash = hash_source(source, options.ast);
+  if (const auto cached = read_file(cache_path)) {
+    if (ObjFunction* function = read_bytecode(vm, *cached, source_hash)) {
+      return function;
+    }
+  }
 
-  ObjFunction* function = compiler.compile();
+  ObjFunction* function = compile(vm, source, options);
+  if (function != nullptr) {
+    write_bytecode_file(cache_path, function, source_hash);
+  }
+  return function;
+}
+
+InterpretResult run(VM& vm, const std::string& source,
+                    const Options& options,
+                    const std::string& cache_path = {}) {
+  ObjFunction* function{};
+  try {
+    function = load(vm, source, options, cache_path);
+  } catch (const HeapLimitError& error) {
+    std::cerr << error.what() << '\n';
+    return INTERPRET_RUNTIME_ERROR;
+  }
   if (function == nullptr) {
     return INTERPRET_COMPILE_ERROR;
   }
 
-  return g_vm.interpret(function);
+  return vm.interpret(function);
+}
+
+class ProfilerSession {
+ public:
+  ProfilerSession(VM& vm, const Options& options)
+      : vm_{vm},
+        options_{options},
+        sampling_profiler_{options.sample_interval} {
+    if (options_.profile == PROFILE_OPCODES) {
+      vm_.set_opcode_profiler(&opcode_profiler_);
+    } else if (options_.profile == PROFILE_SAMPLES) {
+      vm_.set_sampling_profiler(&sampling_profiler_);
+    }
+  }
+
+  ProfilerSession(const ProfilerSession&) = delete;
+  ProfilerSession& operator=(const ProfilerSession&) = delete;
+
+  ProfilerSession(ProfilerSession&&) = delete;
+  ProfilerSession& operator=(ProfilerSession&&) = delete;
+
+  ~ProfilerSession() {
+    if (options_.profile == PROFILE_NONE) {
+      return;
+    }
+
+    vm_.set_opcode_profiler(nullptr);
+    vm_.set_sampling_profiler(nullptr);
+
+    if (options_.profile == PROFILE_OPCODES) {
+      opcode_profiler_.print_report(std::cerr);
+    }
+
+    const std::string path =
+        !options_.profile_output.empty() ? options_.profile_output
+        : options_.profile == PROFILE_OPCODES ? "profile.json"
+                                              : "profile.folded";
+    std::ofstream out{path};
+    if (!out) {
+      std::cerr << "Could not write profile to '" << path << "'.\n";
+    } else if (options_.profile == PROFILE_OPCODES) {
+      opcode_profiler_.write_json(out);
+    } else {
+      sampling_profiler_.write_folded(out);
+    }
+  }
+
+ private:
+  VM& vm_;
+  const Options& options_;
+  OpcodeProfiler opcode_profiler_;
+  SamplingProfiler sampling_profiler_;
+};
+
+bool restore_snapshot(VM& vm, const Options& options) {
+  if (options.snapshot_input.empty()) {
+    return true;
+  }
+
+  bool restored = false;
+  try {
+    const auto data = read_file(options.snapshot_input);
+    restored = data && vm.restore_snapshot(*data);
+  } catch (const HeapLimitError& error) {
+    std::cerr << error.what() << '\n';
+    return false;
+  }
+  if (!restored) {
+    std::cerr << "Invalid or outdated snapshot '" << options.snapshot_input
+              << "'.\n";
+  }
+  return restored;
+}
+
+bool write_snapshot(VM& vm, const Options& options) {
+  std::ofstream out{options.snapshot_output, std::ios::binary};
+  vm.write_snapshot(out);
+  if (!out) {
+    std::cerr << "Could not write snapshot to '" << options.snapshot_output
+              << "'.\n";
+    return false;
+  }
+  return true;
+}
+
+int compile_file(const std::string& source, const Options& options) {
+  const auto vm_owner = std::make_unique<VM>();
+  VM& vm = *vm_owner;
+  int exit_code = 0;
+  try {
+    const ObjFunction* function = compile(vm, source, options);
+    if (function == nullptr) {
+      exit_code = 65;
+    } else if (!write_bytecode_file(options.compile_output, function,
+                                    hash_source(source, options.ast))) {
+      std::cerr << "Could not write bytecode to '" << options.compile_output
+                << "'.\n";
+      exit_code = 74;
+    }
+  } catch (const HeapLimitError& error) {
+    std::cerr << error.what() << '\n';
+    exit_code = 70;
+  }
+  return exit_code;
 }
 }  // namespace
 
-int run_file(const std::string& path) {
+int run_file(const std::string& path, const Options& options) {
   std::ifstream file_stream{path};
   file_stream.exceptions(std::ifstream::badbit | std::ifstream::failbit);
   const std::string source{std::istreambuf_iterator<char>{file_stream},
                            std::istreambuf_iterator<char>{}};
 
-  const InterpretResult result = run(source);
-  g_vm.free_objects();
+  if (!options.compile_output.empty()) {
+    return compile_file(source, options);
+  }
+
+  const std::string cache_path =
+      options.cache && !is_bytecode_file(source)
+          ? std::filesystem::path{path}.replace_extension(".loxc").string()
+          : std::string{};
+
+  // Heap allocated because the VM's stack and frames are too large for
+  // the native stack.
+  const auto vm = std::make_unique<VM>();
+  vm->configure_gc(options.gc);
+  if (!restore_snapshot(*vm, options)) {
+    return 65;
+  }
+
+  InterpretResult result{};
+  {
+    const ProfilerSession profiler_session{*vm, options};
+    result = run(*vm, source, options, cache_path);
+  }
+  const bool saved = result != INTERPRET_OK ||
+                     options.snapshot_output.empty() ||
+                     write_snapshot(*vm, options);
+  if (options.gc_stats) {
+    vm->print_gc_stats(std::cerr);
+  }
 
   if (result == INTERPRET_COMPILE_ERROR) {
     return 65;
@@ -37,10 +233,17 @@ int run_file(const std::string& path) {
     return 70;
   }
 
-  return 0;
+  return saved ? 0 : 74;
 }
 
-void run_prompt() {
+void run_prompt(const Options& options) {
+  const auto vm = std::make_unique<VM>();
+  vm->configure_gc(options.gc);
+  if (!restore_snapshot(*vm, options)) {
+    return;
+  }
+  const ProfilerSession profiler_session{*vm, options};
+
   std::string source_line;
   for (;;) {
     std::cout << "> ";
@@ -50,8 +253,34 @@ void run_prompt() {
       break;
     }
 
-    run(source_line);
+    run(*vm, source_line, options);
+  }
+  if (options.gc_stats) {
+    vm->print_gc_stats(std::cerr);
+  }
+}
+
+int run_files(const std::vector<std::string>& paths, const Options& options) {
+  std::vector<std::future<JobResult>> results;
+  results.reserve(paths.size());
+  IsolatePool pool{options.workers, options.gc};
+  for (const std::string& path : paths) {
+    std::ifstream file_stream{path, std::ios::binary};
+    file_stream.exceptions(std::ifstream::badbit | std::ifstream::failbit);
+    results.push_back(
+        pool.submit({std::istreambuf_iterator<char>{file_stream},
+                     std::istreambuf_iterator<char>{}}));
+  }
+
+  int exit_code = 0;
+  for (std::future<JobResult>& future : results) {
+    const JobResult result = future.get();
+    std::cout << result.output;
+    std::cerr << result.errors;
+    if (exit_code == 0) {
+      exit_code = result.exit_code;
+    }
   }
-  g_vm.free_objects();
+  return exit_code;
 }
 }  // namespace lox::bytecode
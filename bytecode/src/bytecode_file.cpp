@@ -0,0 +1,189 @@
+#include "bytecode_file.hpp"
+
+#include <sstream>
+
+#include "binary_io.hpp"
+#include "vm.hpp"
+
+namespace lox::bytecode {
+namespace {
+constexpr std::string_view MAGIC = "LOXC";
+
+enum ConstantTag : uint8_t {
+  CONSTANT_NIL,
+  CONSTANT_FALSE,
+  CONSTANT_TRUE,
+  CONSTANT_INT,
+  CONSTANT_NUMBER,
+  CONSTANT_STRING,
+  CONSTANT_FUNCTION
+};
+
+class Writer : public BinaryWriter {
+ public:
+  using BinaryWriter::BinaryWriter;
+
+  void write_function(const ObjFunction* function) {
+    write(static_cast<uint8_t>(function->name != nullptr ? 1 : 0));
+    if (function->name != nullptr) {
+      write_string(function->name->string);
+    }
+    write(function->arity);
+    write(function->upvalue_count);
+    write_code(function->chunk);
+
+    const ValueArray& constants = function->chunk.get_constants();
+    write(static_cast<uint32_t>(constants.size()));
+    for (const Value constant : constants) {
+      write_constant(constant);
+    }
+  }
+
+ private:
+  void write_constant(Value value) {
+    if (IS_NIL(value)) {
+      write(CONSTANT_NIL);
+    } else if (IS_BOOL(value)) {
+      write(AS_BOOL(value) ? CONSTANT_TRUE : CONSTANT_FALSE);
+    } else if (IS_INT(value)) {
+      write(CONSTANT_INT);
+      write(AS_INT(value));
+    } else if (IS_NUMBER(value)) {
+      write(CONSTANT_NUMBER);
+      write(AS_NUMBER(value));
+    } else if (IS_STRING(value)) {
+      write(CONSTANT_STRING);
+      write_string(AS_STRING(value)->string);
+    } else {
+      // The compilers only put numbers, strings and functions in constant
+      // tables.
+      write(CONSTANT_FUNCTION);
+      write_function(AS_FUNCTION(value));
+    }
+  }
+};
+
+class Reader : public BinaryReader {
+ public:
+  Reader(VM& vm, std::string_view data) : BinaryReader{data}, vm_{vm} {}
+
+  ObjFunction* read_function(int depth = 0) {
+    // No real script nests functions this deep; the data is corrupt.
+    if (depth > UINT8_COUNT) {
+      fail();
+      return nullptr;
+    }
+
+    auto* function = vm_.allocate_object<ObjFunction>();
+    vm_.push_root(function);
+    // Unroots the function however the read ends, including when an
+    // allocation throws.
+    struct Unroot {
+      VM& vm;
+      ~Unroot() { vm.pop_root(); }
+    } unroot{vm_};
+
+    if (read<uint8_t>() != 0) {
+      function->name = vm_.allocate_object<ObjString>(read_string());
+    }
+    function->arity = read<int32_t>();
+    function->upvalue_count = read<uint16_t>();
+    read_code(function->chunk);
+
+    const auto constant_count = read<uint32_t>();
+    for (uint32_t i = 0; i < constant_count && !failed(); i++) {
+      function->chunk.add_constant(read_constant(depth));
+    }
+
+    return failed() ? nullptr : function;
+  }
+
+ private:
+  Value read_constant(int depth) {
+    switch (read<uint8_t>()) {
+      case CONSTANT_NIL:
+        return NIL_VAL;
+      case CONSTANT_FALSE:
+        return FALSE_VAL;
+      case CONSTANT_TRUE:
+        return TRUE_VAL;
+      case CONSTANT_INT:
+        return INT_VAL(read<int32_t>());
+      case CONSTANT_NUMBER:
+        return NUMBER_VAL(read<double>());
+      case CONSTANT_STRING:
+        return OBJ_VAL(vm_.allocate_object<ObjString>(read_string()));
+      case CONSTANT_FUNCTION:
+        if (ObjFunction* function = read_function(depth + 1)) {
+          return OBJ_VAL(function);
+        }
+        return NIL_VAL;
+      default:
+        fail();
+        return NIL_VAL;
+    }
+  }
+
+  VM& vm_;
+};
+}  // namespace
+
+uint64_t hash_bytes(std::string_view bytes) {
+  uint64_t hash = 14695981039346656037U;
+  for (const char c : bytes) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211U;
+  }
+  return hash;
+}
+
+uint64_t hash_source(std::string_view source, bool ast) {
+  return hash_bytes(source) ^ (ast ? 1U : 0U);
+}
+
+bool is_bytecode_file(std::string_view contents) {
+  return contents.substr(0, MAGIC.size()) == MAGIC;
+}
+
+void write_bytecode(std::ostream& out, const ObjFunction* script,
+                    uint64_t source_hash) {
+  // The VM does not verify bytecode, so the payload carries a checksum to
+  // catch files damaged on disk.
+  std::ostringstream payload;
+  Writer{payload}.write_function(script);
+  const std::string bytes = payload.str();
+
+  Writer writer{out};
+  writer.write_bytes(MAGIC);
+  writer.write(COMPILER_VERSION);
+  writer.write(OPCODE_COUNT);
+  writer.write(source_hash);
+  writer.write(hash_bytes(bytes));
+  writer.write_bytes(bytes);
+}
+
+ObjFunction* read_bytecode(VM& vm, std::string_view data,
+                           std::optional<uint64_t> source_hash) {
+  if (!is_bytecode_file(data)) {
+    return nullptr;
+  }
+
+  Reader reader{vm, data.substr(MAGIC.size())};
+  if (reader.read<uint32_t>() != COMPILER_VERSION ||
+      reader.read<uint32_t>() != OPCODE_COUNT) {
+    return nullptr;
+  }
+  const auto hash = reader.read<uint64_t>();
+  const auto checksum = reader.read<uint64_t>();
+  if (reader.failed() || (source_hash && *source_hash != hash)) {
+    return nullptr;
+  }
+  constexpr size_t HEADER_SIZE = MAGIC.size() + 2 * sizeof(uint32_t) +
+                                 2 * sizeof(uint64_t);
+  if (hash_bytes(data.substr(HEADER_SIZE)) != checksum) {
+    return nullptr;
+  }
+
+  return reader.read_function();
+}
+}  // namespace lox::bytecode
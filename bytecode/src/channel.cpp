@@ -0,0 +1,97 @@
+#include "channel.hpp"
+
+#include <thread>
+
+namespace lox::bytecode {
+namespace {
+constexpr int SPINS_BEFORE_SLEEP = 64;
+}  // namespace
+
+void Channel::send(Message message) {
+  for (int spins = 0;; spins++) {
+    if (try_send(message)) {
+      break;
+    }
+    if (spins < SPINS_BEFORE_SLEEP) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock lock{mutex_};
+    waiting_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!try_send(message)) {
+      changed_.wait(lock);
+      waiting_.fetch_sub(1);
+      spins = 0;
+      continue;
+    }
+    waiting_.fetch_sub(1);
+    break;
+  }
+  wake_waiters();
+}
+
+Message Channel::receive() {
+  Message message;
+  for (int spins = 0;; spins++) {
+    if (try_receive(message)) {
+      break;
+    }
+    if (spins < SPINS_BEFORE_SLEEP) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock lock{mutex_};
+    waiting_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!try_receive(message)) {
+      changed_.wait(lock);
+      waiting_.fetch_sub(1);
+      spins = 0;
+      continue;
+    }
+    waiting_.fetch_sub(1);
+    break;
+  }
+  wake_waiters();
+  return message;
+}
+
+bool Channel::try_send(Message& message) {
+  size_t size = size_.load(std::memory_order_relaxed);
+  do {
+    if (size == capacity_) {
+      return false;
+    }
+  } while (!size_.compare_exchange_weak(size, size + 1,
+                                        std::memory_order_relaxed));
+  // The claimed slot is free once the receiver that released it finishes
+  // its pop.
+  while (!messages_.try_push(message)) {
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+bool Channel::try_receive(Message& message) {
+  if (!messages_.try_pop(message)) {
+    return false;
+  }
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+// A waiter counts itself, fences and retries before it sleeps, and this
+// fences before it looks at the count, so either the waiter sees the
+// change or this sees the waiter. Taking the lock means the waiter is
+// already asleep when it is notified.
+void Channel::wake_waiters() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_relaxed) > 0) {
+    const std::lock_guard lock{mutex_};
+    changed_.notify_all();
+  }
+}
+}  // namespace lox::bytecode
@@ -4,18 +4,108 @@
 #include <iostream>
 
 #include "object.hpp"
-#include "vm.hpp"
 
 namespace lox::bytecode {
+std::string_view opcode_name(uint8_t opcode) {
+  switch (opcode) {
+    case OP_CONSTANT:
+      return "OP_CONSTANT";
+    case OP_NIL:
+      return "OP_NIL";
+    case OP_TRUE:
+      return "OP_TRUE";
+    case OP_FALSE:
+      return "OP_FALSE";
+    case OP_POP:
+      return "OP_POP";
+    case OP_GET_LOCAL:
+      return "OP_GET_LOCAL";
+    case OP_SET_LOCAL:
+      return "OP_SET_LOCAL";
+    case OP_GET_GLOBAL:
+      return "OP_GET_GLOBAL";
+    case OP_DEFINE_GLOBAL:
+      return "OP_DEFINE_GLOBAL";
+    case OP_SET_GLOBAL:
+      return "OP_SET_GLOBAL";
+    case OP_GET_UPVALUE:
+      return "OP_GET_UPVALUE";
+    case OP_SET_UPVALUE:
+      return "OP_SET_UPVALUE";
+    case OP_GET_CALLER_LOCAL:
+      return "OP_GET_CALLER_LOCAL";
+    case OP_SET_CALLER_LOCAL:
+      return "OP_SET_CALLER_LOCAL";
+    case OP_GET_PROPERTY:
+      return "OP_GET_PROPERTY";
+    case OP_SET_PROPERTY:
+      return "OP_SET_PROPERTY";
+    case OP_GET_SUPER:
+      return "OP_GET_SUPER";
+    case OP_EQUAL:
+      return "OP_EQUAL";
+    case OP_GREATER:
+      return "OP_GREATER";
+    case OP_LESS:
+      return "OP_LESS";
+    case OP_ADD:
+      return "OP_ADD";
+    case OP_SUBTRACT:
+      return "OP_SUBTRACT";
+    case OP_MULTIPLY:
+      return "OP_MULTIPLY";
+    case OP_DIVIDE:
+      return "OP_DIVIDE";
+    case OP_NOT:
+      return "OP_NOT";
+    case OP_NEGATE:
+      return "OP_NEGATE";
+    case OP_PRINT:
+      return "OP_PRINT";
+    case OP_JUMP:
+      return "OP_JUMP";
+    case OP_JUMP_IF_FALSE:
+      return "OP_JUMP_IF_FALSE";
+    case OP_LOOP:
+      return "OP_LOOP";
+    case OP_CALL:
+      return "OP_CALL";
+    case OP_TAIL_CALL:
+      return "OP_TAIL_CALL";
+    case OP_INVOKE:
+      return "OP_INVOKE";
+    case OP_SUPER_INVOKE:
+      return "OP_SUPER_INVOKE";
+    case OP_CLOSURE:
+      return "OP_CLOSURE";
+    case OP_CLOSE_UPVALUE:
+      return "OP_CLOSE_UPVALUE";
+    case OP_RETURN:
+      return "OP_RETURN";
+    case OP_CLASS:
+      return "OP_CLASS";
+    case OP_INHERIT:
+      return "OP_INHERIT";
+    case OP_METHOD:
+      return "OP_METHOD";
+    case OP_BUILD_LIST:
+      return "OP_BUILD_LIST";
+    case OP_GET_INDEX:
+      return "OP_GET_INDEX";
+    case OP_SET_INDEX:
+      return "OP_SET_INDEX";
+    default:
+      return "OP_UNKNOWN";
+  }
+}
+
 void Chunk::write(uint8_t byte, int line) {
   code_.push_back(byte);
   lines_.push_back(line);
 }
 
 size_t Chunk::add_constant(Value value) {
-  g_vm.push(value);
   constants_.push_back(value);
-  g_vm.pop();
   return constants_.size() - 1;
 }
 
@@ -61,6 +151,10 @@ size_t Chunk::disassemble_instruction(size_t offset) const {
       return byte_instruction("OP_GET_UPVALUE", offset);
     case OP_SET_UPVALUE:
       return byte_instruction("OP_SET_UPVALUE", offset);
+    case OP_GET_CALLER_LOCAL:
+      return byte_instruction("OP_GET_CALLER_LOCAL", offset);
+    case OP_SET_CALLER_LOCAL:
+      return byte_instruction("OP_SET_CALLER_LOCAL", offset);
     case OP_GET_PROPERTY:
       return constant_instruction("OP_GET_PROPERTY", offset);
     case OP_SET_PROPERTY:
@@ -95,6 +189,8 @@ size_t Chunk::disassemble_instruction(size_t offset) const {
       return jump_instruction("OP_LOOP", -1, offset);
     case OP_CALL:
       return byte_instruction("OP_CALL", offset);
+    case OP_TAIL_CALL:
+      return byte_instruction("OP_TAIL_CALL", offset);
     case OP_INVOKE:
       return invoke_instruction("OP_INVOKE", offset);
     case OP_SUPER_INVOKE:
@@ -130,6 +226,12 @@ size_t Chunk::disassemble_instruction(size_t offset) const {
       return simple_instruction("OP_INHERIT", offset);
     case OP_METHOD:
       return constant_instruction("OP_METHOD", offset);
+    case OP_BUILD_LIST:
+      return byte_instruction("OP_BUILD_LIST", offset);
+    case OP_GET_INDEX:
+      return simple_instruction("OP_GET_INDEX", offset);
+    case OP_SET_INDEX:
+      return simple_instruction("OP_SET_INDEX", offset);
     default:
       std::cout << "Unknown opcode " << instruction << '\n';
       return offset + 1;
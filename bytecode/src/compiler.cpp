@@ -11,6 +11,9 @@ std::array<Compiler::ParseRule, TOKEN_COUNT> Compiler::rules{{
     {nullptr, nullptr, Compiler::PREC_NONE},         // TOKEN_RIGHT_PAREN
     {nullptr, nullptr, Compiler::PREC_NONE},         // TOKEN_LEFT_BRACE
     {nullptr, nullptr, Compiler::PREC_NONE},         // TOKEN_RIGHT_BRACE
+    {&Compiler::list, &Compiler::index,
+     Compiler::PREC_CALL},                           // TOKEN_LEFT_BRACKET
+    {nullptr, nullptr, Compiler::PREC_NONE},         // TOKEN_RIGHT_BRACKET
     {nullptr, nullptr, Compiler::PREC_NONE},         // TOKEN_COMMA
     {nullptr, &Compiler::dot, Compiler::PREC_CALL},  // TOKEN_DOT
     {&Compiler::unary, &Compiler::binary, Compiler::PREC_TERM},  // TOKEN_MINUS
@@ -51,16 +54,33 @@ std::array<Compiler::ParseRule, TOKEN_COUNT> Compiler::rules{{
     {nullptr, nullptr, Compiler::PREC_NONE}               // TOKEN_EOF
 }};
 
-Compiler::Compiler(Scanner& scanner, FunctionType type, Compiler* enclosing)
-    : type_{type}, enclosing_{enclosing}, scanner_{&scanner} {
-  g_current_compiler = this;
+Compiler::Compiler(VM& vm, Scanner& scanner)
+    : vm_{vm}, parser_{&own_parser_}, type_{TYPE_SCRIPT} {
+  parser_->scanner = &scanner;
+  begin_function();
+}
+
+Compiler::Compiler(Compiler& enclosing, FunctionType type)
+    : vm_{enclosing.vm_},
+      parser_{enclosing.parser_},
+      type_{type},
+      enclosing_{&enclosing} {
+  begin_function();
+}
 
-  function_ = g_vm.allocate_object<ObjFunction>();
+// The compiler stays a root of the VM until it is destroyed, even if
+// compiling throws.
+Compiler::~Compiler() { vm_.compiler_ = enclosing_; }
+
+void Compiler::begin_function() {
+  vm_.compiler_ = this;
+
+  function_ = vm_.allocate_object<ObjFunction>();
   if (type_ != TYPE_SCRIPT) {
-    function_->name = g_vm.allocate_object<ObjString>(previous.lexeme);
+    function_->name = vm_.allocate_object<ObjString>(parser_->previous.lexeme);
   }
 
-  if (type != TYPE_FUNCTION) {
+  if (type_ != TYPE_FUNCTION) {
     locals_[0].name.lexeme = "this";
   } else {
     locals_[0].name.lexeme = "";
@@ -70,8 +90,8 @@ Compiler::Compiler(Scanner& scanner, FunctionType type, Compiler* enclosing)
 }
 
 ObjFunction* Compiler::compile() {
-  had_error = false;
-  panic_mode = false;
+  parser_->had_error = false;
+  parser_->panic_mode = false;
 
   advance();
 
@@ -86,27 +106,25 @@ ObjFunction* Compiler::compile() {
 ObjFunction* Compiler::end_compiler() {
   emit_return();
 #ifdef DEBUG_PRINT_CODE
-  if (!had_error) {
+  if (!parser_->had_error) {
     current_chunk()->disassemble(
         function_->name != nullptr ? function_->name->string : "<script>");
   }
 #endif
 
-  g_current_compiler = enclosing_;
-
-  return had_error ? nullptr : function_;
+  return parser_->had_error ? nullptr : function_;
 }
 
 void Compiler::mark_compiler_roots() {
   Compiler* compiler = this;
   do {
-    g_vm.mark_object(compiler->function_);
+    vm_.mark_object(compiler->function_);
     compiler = compiler->enclosing_;
   } while (compiler != nullptr);
 }
 
 void Compiler::emit_byte(uint8_t byte) {
-  current_chunk()->write(byte, previous.line);
+  current_chunk()->write(byte, parser_->previous.line);
 }
 
 void Compiler::emit_bytes(uint8_t byte1, uint8_t byte2) {
@@ -169,28 +187,28 @@ void Compiler::declaration() {
     statement();
   }
 
-  if (panic_mode) {
+  if (parser_->panic_mode) {
     synchronize();
   }
 }
 
 void Compiler::class_declaration() {
   consume(TOKEN_IDENTIFIER, "Expect class name.");
-  const Token class_name = previous;
-  const uint8_t name_constant = identifier_constant(previous);
+  const Token class_name = parser_->previous;
+  const uint8_t name_constant = identifier_constant(parser_->previous);
   declare_variable();
 
   emit_bytes(OP_CLASS, name_constant);
   define_variable(name_constant);
 
   ClassCompiler class_compiler;
-  class_compiler.enclosing = current_class_compiler;
-  current_class_compiler = &class_compiler;
+  class_compiler.enclosing = parser_->class_compiler;
+  parser_->class_compiler = &class_compiler;
 
   if (match(TOKEN_LESS)) {
     consume(TOKEN_IDENTIFIER, "Expect superclass name.");
     variable(false);
-    if (class_name.lexeme == previous.lexeme) {
+    if (class_name.lexeme == parser_->previous.lexeme) {
       error("A class can't inherit from itself.");
     }
     begin_scope();
@@ -213,14 +231,14 @@ void Compiler::class_declaration() {
     end_scope();
   }
 
-  current_class_compiler = current_class_compiler->enclosing;
+  parser_->class_compiler = parser_->class_compiler->enclosing;
 }
 
 void Compiler::method() {
   consume(TOKEN_IDENTIFIER, "Expect method name.");
-  const uint8_t constant = identifier_constant(previous);
+  const uint8_t constant = identifier_constant(parser_->previous);
   FunctionType type = TYPE_METHOD;
-  if (previous.lexeme == "init") {
+  if (parser_->previous.lexeme == "init") {
     type = TYPE_INITIALIZER;
   }
   function(type);
@@ -235,7 +253,7 @@ void Compiler::fun_declaration() {
 }
 
 void Compiler::function(FunctionType type) {
-  Compiler compiler{*scanner_, type, this};
+  Compiler compiler{*this, type};
   compiler.begin_scope();
 
   compiler.consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
@@ -340,6 +358,10 @@ void Compiler::return_statement() {
 
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+
+    if (last_call_ && *last_call_ == current_chunk_size() - 2) {
+      current_chunk()->set_code(*last_call_, OP_TAIL_CALL);
+    }
     emit_byte(OP_RETURN);
   }
 }
@@ -424,6 +446,7 @@ void Compiler::expression() { parse_precedence(PREC_ASSIGNMENT); }
 
 void Compiler::call(bool /*can_assign*/) {
   const uint8_t arg_count = argument_list();
+  last_call_ = current_chunk_size();
   emit_bytes(OP_CALL, arg_count);
 }
 
@@ -442,16 +465,43 @@ uint8_t Compiler::argument_list() {
   return arg_count;
 }
 
+void Compiler::index(bool can_assign) {
+  expression();
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+  if (can_assign && match(TOKEN_EQUAL)) {
+    expression();
+    emit_byte(OP_SET_INDEX);
+  } else {
+    emit_byte(OP_GET_INDEX);
+  }
+}
+
+void Compiler::list(bool /*can_assign*/) {
+  uint8_t element_count = 0;
+  if (!check(TOKEN_RIGHT_BRACKET)) {
+    do {
+      expression();
+      if (element_count == 255) {
+        error("Can't have more than 255 elements in a list literal.");
+      }
+      element_count++;
+    } while (match(TOKEN_COMMA));
+  }
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list elements.");
+  emit_bytes(OP_BUILD_LIST, element_count);
+}
+
 void Compiler::super_(bool /*can_assign*/) {
-  if (current_class_compiler == nullptr) {
+  if (parser_->class_compiler == nullptr) {
     error("Can't use 'super' outside of a class.");
-  } else if (!current_class_compiler->has_super_class) {
+  } else if (!parser_->class_compiler->has_super_class) {
     error("Can't use 'super' in a class with no superclass.");
   }
 
   consume(TOKEN_DOT, "Expect '.' after 'super'.");
   consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
-  const uint8_t name = identifier_constant(previous);
+  const uint8_t name = identifier_constant(parser_->previous);
 
   named_variable(Token{TOKEN_THIS, "this", 0}, false);
   if (match(TOKEN_LEFT_PAREN)) {
@@ -466,7 +516,7 @@ void Compiler::super_(bool /*can_assign*/) {
 }
 
 void Compiler::this_(bool /*can_assign*/) {
-  if (current_class_compiler == nullptr) {
+  if (parser_->class_compiler == nullptr) {
     error("Can't use 'this' outside of a class.");
     return;
   }
@@ -476,7 +526,7 @@ void Compiler::this_(bool /*can_assign*/) {
 
 void Compiler::dot(bool can_assign) {
   consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-  const uint8_t name = identifier_constant(previous);
+  const uint8_t name = identifier_constant(parser_->previous);
 
   if (can_assign && match(TOKEN_EQUAL)) {
     expression();
@@ -511,7 +561,7 @@ void Compiler::or_(bool /*can_assign*/) {
 }
 
 void Compiler::binary(bool /*can_assign*/) {
-  const TokenType op = previous.type;
+  const TokenType op = parser_->previous.type;
   parse_precedence(static_cast<Precedence>(get_rule(op)->precedence + 1));
 
   switch (op) {
@@ -551,7 +601,7 @@ void Compiler::binary(bool /*can_assign*/) {
 }
 
 void Compiler::unary(bool /*can_assign*/) {
-  const TokenType op = previous.type;
+  const TokenType op = parser_->previous.type;
   parse_precedence(PREC_UNARY);
 
   switch (op) {
@@ -572,7 +622,7 @@ void Compiler::grouping(bool /*can_assign*/) {
 }
 
 void Compiler::literal(bool /*can_assign*/) {
-  switch (previous.type) {
+  switch (parser_->previous.type) {
     case TOKEN_FALSE:
       emit_byte(OP_FALSE);
       break;
@@ -588,13 +638,14 @@ void Compiler::literal(bool /*can_assign*/) {
 }
 
 void Compiler::string(bool /*can_assign*/) {
-  previous.lexeme.pop_back();
-  previous.lexeme.erase(previous.lexeme.begin());
-  emit_constant(OBJ_VAL(g_vm.allocate_object<ObjString>(previous.lexeme)));
+  parser_->previous.lexeme.pop_back();
+  parser_->previous.lexeme.erase(parser_->previous.lexeme.begin());
+  emit_constant(
+      OBJ_VAL(vm_.allocate_object<ObjString>(parser_->previous.lexeme)));
 }
 
 void Compiler::variable(bool can_assign) {
-  named_variable(previous, can_assign);
+  named_variable(parser_->previous, can_assign);
 }
 
 void Compiler::named_variable(const lox::Token& name, bool can_assign) {
@@ -621,8 +672,8 @@ void Compiler::named_variable(const lox::Token& name, bool can_assign) {
 }
 
 void Compiler::number(bool /*can_assign*/) {
-  const double value = strtod(previous.lexeme.data(), nullptr);
-  emit_constant(NUMBER_VAL(value));
+  const double value = strtod(parser_->previous.lexeme.data(), nullptr);
+  emit_constant(number_or_int_to_value(value));
 }
 
 uint8_t Compiler::parse_variable(std::string_view error_message) {
@@ -633,7 +684,7 @@ uint8_t Compiler::parse_variable(std::string_view error_message) {
     return 0;
   }
 
-  return identifier_constant(previous);
+  return identifier_constant(parser_->previous);
 }
 
 void Compiler::declare_variable() {
@@ -647,12 +698,12 @@ void Compiler::declare_variable() {
       break;
     }
 
-    if (local.name.lexeme == previous.lexeme) {
+    if (local.name.lexeme == parser_->previous.lexeme) {
       error("Already a variable with this name in this scope.");
     }
   }
 
-  add_local(previous);
+  add_local(parser_->previous);
 }
 
 void Compiler::define_variable(uint8_t global) {
@@ -747,7 +798,7 @@ uint8_t Compiler::make_constant(Value value) {
 }
 
 uint8_t Compiler::identifier_constant(const lox::Token& name) {
-  return make_constant(OBJ_VAL(g_vm.allocate_object<ObjString>(name.lexeme)));
+  return make_constant(OBJ_VAL(vm_.allocate_object<ObjString>(name.lexeme)));
 }
 
 void Compiler::end_scope() {
@@ -764,7 +815,7 @@ void Compiler::end_scope() {
 
 void Compiler::parse_precedence(Precedence precedence) {
   advance();
-  const ParseFn prefix_rule = get_rule(previous.type)->prefix;
+  const ParseFn prefix_rule = get_rule(parser_->previous.type)->prefix;
   if (prefix_rule == nullptr) {
     error("Expect expression.");
     return;
@@ -773,9 +824,9 @@ void Compiler::parse_precedence(Precedence precedence) {
   const bool can_assign = precedence <= PREC_ASSIGNMENT;
   (this->*prefix_rule)(can_assign);
 
-  while (precedence <= get_rule(current.type)->precedence) {
+  while (precedence <= get_rule(parser_->current.type)->precedence) {
     advance();
-    const ParseFn infix_rule = get_rule(previous.type)->infix;
+    const ParseFn infix_rule = get_rule(parser_->previous.type)->infix;
     (this->*infix_rule)(can_assign);
   }
 
@@ -785,15 +836,15 @@ void Compiler::parse_precedence(Precedence precedence) {
 }
 
 void Compiler::advance() {
-  previous = current;
+  parser_->previous = parser_->current;
 
   for (;;) {
-    current = scanner_->scan_token();
-    if (current.type != TOKEN_ERROR) {
+    parser_->current = parser_->scanner->scan_token();
+    if (parser_->current.type != TOKEN_ERROR) {
       break;
     }
 
-    error_at_current(current.lexeme);
+    error_at_current(parser_->current.lexeme);
   }
 }
 
@@ -816,13 +867,13 @@ bool Compiler::match(TokenType type) {
 }
 
 void Compiler::synchronize() {
-  panic_mode = false;
+  parser_->panic_mode = false;
 
-  while (current.type != TOKEN_EOF) {
-    if (previous.type == TOKEN_SEMICOLON) {
+  while (parser_->current.type != TOKEN_EOF) {
+    if (parser_->previous.type == TOKEN_SEMICOLON) {
       return;
     }
-    switch (current.type) {
+    switch (parser_->current.type) {
       case TOKEN_CLASS:
       case TOKEN_FUN:
       case TOKEN_VAR:
@@ -840,28 +891,31 @@ void Compiler::synchronize() {
   }
 }
 
-void Compiler::error(std::string_view message) { error_at(previous, message); }
+void Compiler::error(std::string_view message) {
+  error_at(parser_->previous, message);
+}
 
 void Compiler::error_at_current(std::string_view message) {
-  error_at(current, message);
+  error_at(parser_->current, message);
 }
 
 void Compiler::error_at(const lox::Token& token, std::string_view message) {
-  if (panic_mode) {
+  if (parser_->panic_mode) {
     return;
   }
-  panic_mode = true;
-  std::cerr << "[line " << token.line << "] Error";
+  parser_->panic_mode = true;
+  std::ostream& err = vm_.error_output();
+  err << "[line " << token.line << "] Error";
 
   if (token.type == TOKEN_EOF) {
-    std::cerr << " at end";
+    err << " at end";
   } else if (token.type == TOKEN_ERROR) {
     // Nothing.
   } else {
-    std::cerr << " at '" << token.lexeme << "'";
+    err << " at '" << token.lexeme << "'";
   }
 
-  std::cerr << ": " << message << '\n';
-  had_error = true;
+  err << ": " << message << '\n';
+  parser_->had_error = true;
 }
 }  // namespace lox::bytecode
@@ -0,0 +1,299 @@
+#include "event_loop.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <iterator>
+#include <limits>
+#include <system_error>
+#endif
+
+namespace lox::bytecode {
+#ifdef __linux__
+namespace {
+constexpr size_t HELPER_THREADS = 4;
+constexpr size_t READ_CHUNK = 64 * 1024;
+constexpr int MAX_EVENTS = 64;
+// Operation ids start at one, leaving zero for the wake descriptor.
+constexpr uint64_t WAKE_ID = 0;
+
+std::string open_error(const std::string& path) {
+  return "Could not open '" + path +
+         "': " + std::generic_category().message(errno) + ".";
+}
+}  // namespace
+
+EventLoop::EventLoop()
+    : epoll_fd_{epoll_create1(EPOLL_CLOEXEC)},
+      wake_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)} {
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = WAKE_ID;
+  if (epoll_fd_ < 0 || wake_fd_ < 0 ||
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) != 0) {
+    const int error = errno;
+    close(epoll_fd_);
+    close(wake_fd_);
+    throw std::system_error{error, std::generic_category(),
+                            "Could not start the event loop"};
+  }
+  // Writing to a pipe whose reader has gone then fails with EPIPE instead
+  // of killing the process.
+  std::signal(SIGPIPE, SIG_IGN);
+}
+
+EventLoop::~EventLoop() {
+  {
+    const std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  tasks_changed_.notify_all();
+  for (std::thread& helper : helpers_) {
+    helper.join();
+  }
+
+  for (const auto& [id, stream] : tasks_) {
+    close(stream.fd);
+  }
+  for (const auto& [id, stream] : streams_) {
+    close(stream.fd);
+  }
+  close(wake_fd_);
+  close(epoll_fd_);
+}
+
+EventLoop::Id EventLoop::read(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  return fd >= 0 ? start(KIND_READ, fd, {}) : fail(open_error(path));
+}
+
+EventLoop::Id EventLoop::write(const std::string& path, std::string data) {
+  constexpr mode_t mode = 0666;
+  const int fd = open(path.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC,
+                      mode);
+  return fd >= 0 ? start(KIND_WRITE, fd, std::move(data))
+                 : fail(open_error(path));
+}
+
+EventLoop::Id EventLoop::timer(double milliseconds) {
+  const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return fail("Could not create a timer.");
+  }
+
+  constexpr double nanoseconds_per_millisecond = 1e6;
+  constexpr long nanoseconds_per_second = 1'000'000'000;
+  // A zero expiry would disarm the timer, so the shortest wait is 1ns.
+  // Waits too long for a long to count are cut to about 146 years.
+  constexpr auto longest =
+      static_cast<double>(std::numeric_limits<long>::max() / 2);
+  const double wanted = milliseconds * nanoseconds_per_millisecond;
+  long nanoseconds = 1;
+  if (wanted >= longest) {
+    nanoseconds = static_cast<long>(longest);
+  } else if (wanted > 1) {
+    nanoseconds = static_cast<long>(wanted);
+  }
+
+  itimerspec spec{};
+  spec.it_value.tv_sec = nanoseconds / nanoseconds_per_second;
+  spec.it_value.tv_nsec = nanoseconds % nanoseconds_per_second;
+  timerfd_settime(fd, 0, &spec, nullptr);
+  return start(KIND_TIMER, fd, {});
+}
+
+EventLoop::Completion EventLoop::wait() {
+  while (ready_.empty()) {
+    std::array<epoll_event, MAX_EVENTS> events{};
+    const int count = epoll_wait(epoll_fd_, events.data(), MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error{errno, std::generic_category(), "epoll_wait"};
+    }
+
+    for (size_t i = 0; i < static_cast<size_t>(count); i++) {
+      if (events[i].data.u64 != WAKE_ID) {
+        advance(static_cast<Id>(events[i].data.u64));
+        continue;
+      }
+      uint64_t wakes{};
+      [[maybe_unused]] const ssize_t drained =
+          ::read(wake_fd_, &wakes, sizeof(wakes));
+      const std::lock_guard lock{mutex_};
+      std::move(posted_.begin(), posted_.end(), std::back_inserter(ready_));
+      posted_.clear();
+    }
+  }
+
+  Completion completion = std::move(ready_.front());
+  ready_.pop_front();
+  pending_--;
+  return completion;
+}
+
+EventLoop::Id EventLoop::start(Kind kind, int fd, std::string data) {
+  const Id id = next_id_++;
+  pending_++;
+  Stream stream{kind, fd, std::move(data)};
+
+  epoll_event event{};
+  event.events = kind == KIND_WRITE ? EPOLLOUT : EPOLLIN;
+  event.data.u64 = id;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0) {
+    streams_.emplace(id, std::move(stream));
+    return id;
+  }
+
+  // Regular files and devices epoll cannot watch block on a helper
+  // instead.
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  {
+    const std::lock_guard lock{mutex_};
+    if (helpers_.empty()) {
+      for (size_t i = 0; i < HELPER_THREADS; i++) {
+        helpers_.emplace_back([this] { helper(); });
+      }
+    }
+    tasks_.emplace_back(id, std::move(stream));
+  }
+  tasks_changed_.notify_one();
+  return id;
+}
+
+EventLoop::Id EventLoop::fail(std::string message) {
+  const Id id = next_id_++;
+  pending_++;
+  ready_.push_back({id, std::move(message), false});
+  return id;
+}
+
+void EventLoop::helper() {
+  for (;;) {
+    std::pair<Id, Stream> task;
+    {
+      std::unique_lock lock{mutex_};
+      tasks_changed_.wait(lock,
+                          [this] { return stopping_ || !tasks_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    Completion completion{task.first, {}, false};
+    step(task.second, completion);
+    close(task.second.fd);
+    {
+      const std::lock_guard lock{mutex_};
+      posted_.push_back(std::move(completion));
+    }
+    const uint64_t wake = 1;
+    [[maybe_unused]] const ssize_t written =
+        ::write(wake_fd_, &wake, sizeof(wake));
+  }
+}
+
+void EventLoop::advance(Id id) {
+  const auto found = streams_.find(id);
+  Completion completion{id, {}, false};
+  if (found == streams_.end() || !step(found->second, completion)) {
+    return;
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, found->second.fd, nullptr);
+  close(found->second.fd);
+  streams_.erase(found);
+  ready_.push_back(std::move(completion));
+}
+
+bool EventLoop::step(Stream& stream, Completion& completion) {
+  if (stream.kind == KIND_TIMER) {
+    uint64_t expirations{};
+    if (::read(stream.fd, &expirations, sizeof(expirations)) < 0 &&
+        errno == EAGAIN) {
+      return false;
+    }
+    completion.ok = true;
+    return true;
+  }
+
+  for (;;) {
+    ssize_t count{};
+    if (stream.kind == KIND_READ) {
+      std::array<char, READ_CHUNK> chunk;
+      count = ::read(stream.fd, chunk.data(), chunk.size());
+      if (count > 0) {
+        stream.buffer.append(chunk.data(), static_cast<size_t>(count));
+        continue;
+      }
+      if (count == 0) {
+        completion.data = std::move(stream.buffer);
+        completion.ok = true;
+        return true;
+      }
+    } else {
+      if (stream.written == stream.buffer.size()) {
+        completion.ok = true;
+        return true;
+      }
+      count = ::write(stream.fd, stream.buffer.data() + stream.written,
+                      stream.buffer.size() - stream.written);
+      if (count >= 0) {
+        stream.written += static_cast<size_t>(count);
+        continue;
+      }
+    }
+
+    if (errno == EAGAIN) {
+      return false;
+    }
+    if (errno != EINTR) {
+      completion.data = std::generic_category().message(errno) + ".";
+      return true;
+    }
+  }
+}
+#else
+// Everything fails at once where there is no epoll.
+EventLoop::EventLoop() = default;
+EventLoop::~EventLoop() = default;
+
+EventLoop::Id EventLoop::read(const std::string& /*path*/) {
+  return fail("Asynchronous I/O needs Linux.");
+}
+
+EventLoop::Id EventLoop::write(const std::string& /*path*/,
+                               std::string /*data*/) {
+  return fail("Asynchronous I/O needs Linux.");
+}
+
+EventLoop::Id EventLoop::timer(double /*milliseconds*/) {
+  return fail("Asynchronous I/O needs Linux.");
+}
+
+EventLoop::Completion EventLoop::wait() {
+  Completion completion = std::move(ready_.front());
+  ready_.pop_front();
+  pending_--;
+  return completion;
+}
+
+EventLoop::Id EventLoop::fail(std::string message) {
+  const Id id = next_id_++;
+  pending_++;
+  ready_.push_back({id, std::move(message), false});
+  return id;
+}
+#endif
+}  // namespace lox::bytecode
@@ -0,0 +1,140 @@
+#include "isolate_pool.hpp"
+
+#include <sstream>
+
+#include "bytecode_file.hpp"
+#include "compiler.hpp"
+#include "vm.hpp"
+
+namespace lox::bytecode {
+namespace {
+constexpr int SPINS_BEFORE_SLEEP = 64;
+
+ObjFunction* load(VM& vm, const std::string& script) {
+  if (is_bytecode_file(script)) {
+    ObjFunction* function = read_bytecode(vm, script);
+    if (function == nullptr) {
+      vm.error_output() << "Invalid or outdated bytecode file.\n";
+    }
+    return function;
+  }
+  Scanner scanner{script};
+  Compiler compiler{vm, scanner};
+  return compiler.compile();
+}
+
+JobResult run_job(const std::string& script, const GcConfig& gc) {
+  std::ostringstream out;
+  std::ostringstream err;
+  InterpretResult result{};
+  {
+    const auto vm = std::make_unique<VM>();
+    vm->set_output(out, err);
+    vm->configure_gc(gc);
+    try {
+      ObjFunction* function = load(*vm, script);
+      result = function != nullptr ? vm->interpret(function)
+                                   : INTERPRET_COMPILE_ERROR;
+    } catch (const HeapLimitError& error) {
+      err << error.what() << '\n';
+      result = INTERPRET_RUNTIME_ERROR;
+    }
+  }
+
+  int exit_code = 0;
+  if (result == INTERPRET_COMPILE_ERROR) {
+    exit_code = 65;
+  } else if (result == INTERPRET_RUNTIME_ERROR) {
+    exit_code = 70;
+  }
+  return {exit_code, out.str(), err.str()};
+}
+}  // namespace
+
+IsolatePool::IsolatePool(size_t workers, const GcConfig& gc,
+                         size_t queue_capacity)
+    : gc_{gc}, jobs_{queue_capacity} {
+  workers_.reserve(workers);
+  for (size_t i = 0; i < workers; i++) {
+    workers_.emplace_back([this] { work(); });
+  }
+}
+
+IsolatePool::~IsolatePool() {
+  {
+    const std::lock_guard lock{wake_mutex_};
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+std::future<JobResult> IsolatePool::submit(std::string script) {
+  auto job = std::make_unique<Job>();
+  job->script = std::move(script);
+  std::future<JobResult> result = job->result.get_future();
+
+  // Counted before it is visible so a worker never sees the queue hold
+  // more than pending_ says.
+  pending_.fetch_add(1);
+  if (!jobs_.try_push(job)) {
+    // Counted, fenced and retried before sleeping, as Channel::send does,
+    // so a worker that frees a slot either is seen here or sees this.
+    std::unique_lock lock{wake_mutex_};
+    blocked_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    room_.wait(lock, [&] { return jobs_.try_push(job); });
+    blocked_.fetch_sub(1);
+  }
+  // Either a worker going to sleep sees the new pending count, or this
+  // sees it asleep and wakes it.
+  if (sleeping_.load() > 0) {
+    const std::lock_guard lock{wake_mutex_};
+    wake_.notify_one();
+  }
+  return result;
+}
+
+void IsolatePool::work() {
+  std::unique_ptr<Job> job;
+  while (next_job(job)) {
+    try {
+      job->result.set_value(run_job(job->script, gc_));
+    } catch (...) {
+      job->result.set_exception(std::current_exception());
+    }
+    job.reset();
+  }
+}
+
+bool IsolatePool::next_job(std::unique_ptr<Job>& job) {
+  for (int spins = 0;; spins++) {
+    if (jobs_.try_pop(job)) {
+      pending_.fetch_sub(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (blocked_.load(std::memory_order_relaxed) > 0) {
+        const std::lock_guard lock{wake_mutex_};
+        room_.notify_all();
+      }
+      return true;
+    }
+    if (spins < SPINS_BEFORE_SLEEP) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock lock{wake_mutex_};
+    sleeping_.fetch_add(1);
+    wake_.wait(lock, [this] { return pending_.load() > 0 || stopping_; });
+    sleeping_.fetch_sub(1);
+    // Another worker may have taken the job that woke this one, so only an
+    // empty queue during shutdown ends the worker.
+    if (stopping_ && pending_.load() == 0) {
+      return false;
+    }
+    spins = 0;
+  }
+}
+}  // namespace lox::bytecode
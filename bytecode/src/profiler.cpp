@@ -0,0 +1,176 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace lox::bytecode {
+namespace {
+std::string_view function_name(const ObjFunction* function) {
+  if (function->name == nullptr) {
+    return "<script>";
+  }
+  return function->name->string;
+}
+
+std::string function_key(const ObjFunction* function) {
+  const std::vector<int>& lines = function->chunk.get_lines();
+  return std::string{function_name(function)} + ':' +
+         std::to_string(lines.empty() ? 0 : lines.front());
+}
+
+double to_ms(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+template <typename Key, typename Counter>
+void print_table(std::ostream& out, std::string_view title,
+                 std::vector<std::pair<Key, Counter>> rows, double total_ms) {
+  std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+    return a.second.time > b.second.time;
+  });
+
+  out << "== " << title << " ==\n";
+  out << std::setfill(' ') << std::left << std::setw(24) << "name"
+      << std::right << std::setw(14) << "count" << std::setw(14) << "time ms"
+      << std::setw(9) << "% time" << '\n';
+
+  for (const auto& [key, counter] : rows) {
+    const double ms = to_ms(counter.time);
+    out << std::left << std::setw(24) << key << std::right << std::setw(14)
+        << counter.count << std::setw(14) << std::fixed << std::setprecision(3)
+        << ms << std::setw(9) << std::setprecision(2)
+        << (total_ms > 0 ? ms * 100 / total_ms : 0) << '\n';
+  }
+  out << std::defaultfloat;
+}
+}  // namespace
+
+void OpcodeProfiler::record(const ObjFunction* function, const uint8_t* ip) {
+  const Clock::time_point now = Clock::now();
+  if (opcode_counter_ != nullptr) {
+    const Clock::duration elapsed = now - last_;
+    opcode_counter_->time += elapsed;
+    function_counter_->time += elapsed;
+    lines_[line_].time += elapsed;
+  }
+
+  if (function != function_) {
+    function_ = function;
+    function_counter_ = &functions_[function_key(function)];
+  }
+
+  const Chunk& chunk = function->chunk;
+  const auto offset = static_cast<size_t>(ip - chunk.get_codes().data());
+  line_ = static_cast<size_t>(chunk.get_lines()[offset]);
+  if (line_ >= lines_.size()) {
+    lines_.resize(line_ + 1);
+  }
+
+  opcode_counter_ = &opcodes_[*ip];
+  opcode_counter_->count++;
+  function_counter_->count++;
+  lines_[line_].count++;
+
+  last_ = now;
+}
+
+void OpcodeProfiler::stop() {
+  if (opcode_counter_ != nullptr) {
+    const Clock::duration elapsed = Clock::now() - last_;
+    opcode_counter_->time += elapsed;
+    function_counter_->time += elapsed;
+    lines_[line_].time += elapsed;
+  }
+
+  function_ = nullptr;
+  function_counter_ = nullptr;
+  opcode_counter_ = nullptr;
+}
+
+void OpcodeProfiler::print_report(std::ostream& out) const {
+  double total_ms = 0;
+  std::vector<std::pair<std::string_view, Counter>> opcodes;
+  for (size_t i = 0; i < opcodes_.size(); i++) {
+    if (opcodes_[i].count != 0) {
+      opcodes.emplace_back(opcode_name(static_cast<uint8_t>(i)), opcodes_[i]);
+      total_ms += to_ms(opcodes_[i].time);
+    }
+  }
+
+  std::vector<std::pair<std::string_view, Counter>> functions{
+      functions_.begin(), functions_.end()};
+
+  std::vector<std::pair<std::string, Counter>> lines;
+  for (size_t i = 0; i < lines_.size(); i++) {
+    if (lines_[i].count != 0) {
+      lines.emplace_back("line " + std::to_string(i), lines_[i]);
+    }
+  }
+
+  print_table(out, "opcodes", std::move(opcodes), total_ms);
+  print_table(out, "functions", std::move(functions), total_ms);
+  print_table(out, "lines", std::move(lines), total_ms);
+}
+
+void OpcodeProfiler::write_json(std::ostream& out) const {
+  auto write_counter = [&out](const Counter& counter) {
+    out << "\"count\": " << counter.count
+        << ", \"time_ns\": " << std::chrono::nanoseconds{counter.time}.count();
+  };
+
+  out << "{\n  \"opcodes\": [";
+  bool first = true;
+  for (size_t i = 0; i < opcodes_.size(); i++) {
+    if (opcodes_[i].count == 0) {
+      continue;
+    }
+    out << (first ? "\n" : ",\n") << "    {\"name\": \""
+        << opcode_name(static_cast<uint8_t>(i)) << "\", ";
+    write_counter(opcodes_[i]);
+    out << '}';
+    first = false;
+  }
+
+  out << "\n  ],\n  \"functions\": [";
+  first = true;
+  for (const auto& [name, counter] : functions_) {
+    out << (first ? "\n" : ",\n") << "    {\"name\": \"" << name << "\", ";
+    write_counter(counter);
+    out << '}';
+    first = false;
+  }
+
+  out << "\n  ],\n  \"lines\": [";
+  first = true;
+  for (size_t i = 0; i < lines_.size(); i++) {
+    if (lines_[i].count == 0) {
+      continue;
+    }
+    out << (first ? "\n" : ",\n") << "    {\"line\": " << i << ", ";
+    write_counter(lines_[i]);
+    out << '}';
+    first = false;
+  }
+  out << "\n  ]\n}\n";
+}
+
+void SamplingProfiler::push_frame(const ObjFunction* function, size_t offset) {
+  if (!stack_.empty()) {
+    stack_ += ';';
+  }
+  stack_ += function_name(function);
+  stack_ += ':';
+  stack_ += std::to_string(function->chunk.get_lines()[offset]);
+}
+
+void SamplingProfiler::commit_sample() {
+  samples_[stack_]++;
+  stack_.clear();
+}
+
+void SamplingProfiler::write_folded(std::ostream& out) const {
+  for (const auto& [stack, count] : samples_) {
+    out << stack << ' ' << count << '\n';
+  }
+}
+}  // namespace lox::bytecode
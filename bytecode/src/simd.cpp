@@ -0,0 +1,539 @@
+#include "simd.hpp"
+
+#include <array>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LOX_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Sums keep eight running totals, one for each position modulo eight, and
+// combine them in a fixed tree. Minimums and maximums do the same with the
+// comparison MINPD and MAXPD make. Prefix sums scan blocks of four in two
+// steps as a vector would, then add the total carried from the last block.
+// Elements left over after the last whole group are handled one by one.
+namespace lox::bytecode {
+namespace {
+constexpr size_t LANES = 8;
+constexpr size_t BLOCK = 4;
+
+using Partials = std::array<double, LANES>;
+
+double min_of(double a, double b) { return a < b ? a : b; }
+double max_of(double a, double b) { return a > b ? a : b; }
+
+double add_partials(const Partials& partials) {
+  return ((partials[0] + partials[1]) + (partials[2] + partials[3])) +
+         ((partials[4] + partials[5]) + (partials[6] + partials[7]));
+}
+
+template <typename Pick>
+double pick_partials(const Partials& partials, Pick pick) {
+  double result = partials[0];
+  for (size_t j = 1; j < LANES; j++) {
+    result = pick(result, partials[j]);
+  }
+  return result;
+}
+
+double sum_rest(double total, const double* a, size_t start, size_t count) {
+  for (size_t i = start; i < count; i++) {
+    total += a[i];
+  }
+  return total;
+}
+
+double dot_rest(double total, const double* a, const double* b, size_t start,
+                size_t count) {
+  for (size_t i = start; i < count; i++) {
+    total += a[i] * b[i];
+  }
+  return total;
+}
+
+template <typename Pick>
+double pick_rest(double result, const double* a, size_t start, size_t count,
+                 Pick pick) {
+  for (size_t i = start; i < count; i++) {
+    result = pick(result, a[i]);
+  }
+  return result;
+}
+
+void prefix_sum_rest(double carry, const double* a, double* out,
+                     size_t start, size_t count) {
+  for (size_t i = start; i < count; i++) {
+    carry = a[i] + carry;
+    out[i] = carry;
+  }
+}
+
+void add_scalar(const double* a, const double* b, double* out,
+                size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+void multiply_scalar(const double* a, const double* b, double* out,
+                     size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+void scale_scalar(const double* a, double factor, double* out,
+                  size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = a[i] * factor;
+  }
+}
+
+double dot_scalar(const double* a, const double* b, size_t count) {
+  Partials partials{};
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (size_t j = 0; j < LANES; j++) {
+      partials[j] += a[i + j] * b[i + j];
+    }
+  }
+  return dot_rest(add_partials(partials), a, b, i, count);
+}
+
+double sum_scalar(const double* a, size_t count) {
+  Partials partials{};
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (size_t j = 0; j < LANES; j++) {
+      partials[j] += a[i + j];
+    }
+  }
+  return sum_rest(add_partials(partials), a, i, count);
+}
+
+template <typename Pick>
+double pick_scalar(const double* a, size_t count, Pick pick) {
+  if (count < LANES) {
+    return pick_rest(a[0], a, 1, count, pick);
+  }
+  Partials partials{};
+  for (size_t j = 0; j < LANES; j++) {
+    partials[j] = a[j];
+  }
+  size_t i = LANES;
+  for (; i + LANES <= count; i += LANES) {
+    for (size_t j = 0; j < LANES; j++) {
+      partials[j] = pick(partials[j], a[i + j]);
+    }
+  }
+  return pick_rest(pick_partials(partials, pick), a, i, count, pick);
+}
+
+double min_scalar(const double* a, size_t count) {
+  return pick_scalar(a, count, min_of);
+}
+
+double max_scalar(const double* a, size_t count) {
+  return pick_scalar(a, count, max_of);
+}
+
+// The additions of zero are kept because a vector adds them too, and they
+// turn -0.0 into 0.0.
+void prefix_sum_scalar(const double* a, double* out, size_t count) {
+  double carry = 0.0;
+  size_t i = 0;
+  for (; i + BLOCK <= count; i += BLOCK) {
+    const double t0 = a[i] + 0.0;
+    const double t1 = a[i + 1] + a[i];
+    const double t2 = a[i + 2] + 0.0;
+    const double t3 = a[i + 3] + a[i + 2];
+    out[i] = (t0 + 0.0) + carry;
+    out[i + 1] = (t1 + 0.0) + carry;
+    out[i + 2] = (t2 + t1) + carry;
+    out[i + 3] = (t3 + t1) + carry;
+    carry = out[i + 3];
+  }
+  prefix_sum_rest(carry, a, out, i, count);
+}
+
+constexpr SimdKernels SCALAR_KERNELS{
+    add_scalar, multiply_scalar, scale_scalar,      dot_scalar,
+    sum_scalar, min_scalar,      max_scalar,        prefix_sum_scalar};
+
+#ifdef LOX_SIMD_X86
+// SSE2 is part of x86-64, so these need no check.
+constexpr size_t SSE2_WIDTH = 2;
+
+void add_sse2(const double* a, const double* b, double* out, size_t count) {
+  size_t i = 0;
+  for (; i + SSE2_WIDTH <= count; i += SSE2_WIDTH) {
+    _mm_storeu_pd(out + i,
+                  _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  }
+  add_scalar(a + i, b + i, out + i, count - i);
+}
+
+void multiply_sse2(const double* a, const double* b, double* out,
+                   size_t count) {
+  size_t i = 0;
+  for (; i + SSE2_WIDTH <= count; i += SSE2_WIDTH) {
+    _mm_storeu_pd(out + i,
+                  _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  }
+  multiply_scalar(a + i, b + i, out + i, count - i);
+}
+
+void scale_sse2(const double* a, double factor, double* out, size_t count) {
+  const __m128d factors = _mm_set1_pd(factor);
+  size_t i = 0;
+  for (; i + SSE2_WIDTH <= count; i += SSE2_WIDTH) {
+    _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), factors));
+  }
+  scale_scalar(a + i, factor, out + i, count - i);
+}
+
+double dot_sse2(const double* a, const double* b, size_t count) {
+  __m128d p0 = _mm_setzero_pd();
+  __m128d p1 = _mm_setzero_pd();
+  __m128d p2 = _mm_setzero_pd();
+  __m128d p3 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = _mm_add_pd(p0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    p1 = _mm_add_pd(
+        p1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    p2 = _mm_add_pd(
+        p2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+    p3 = _mm_add_pd(
+        p3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+  }
+  Partials partials;
+  _mm_storeu_pd(&partials[0], p0);
+  _mm_storeu_pd(&partials[2], p1);
+  _mm_storeu_pd(&partials[4], p2);
+  _mm_storeu_pd(&partials[6], p3);
+  return dot_rest(add_partials(partials), a, b, i, count);
+}
+
+double sum_sse2(const double* a, size_t count) {
+  __m128d p0 = _mm_setzero_pd();
+  __m128d p1 = _mm_setzero_pd();
+  __m128d p2 = _mm_setzero_pd();
+  __m128d p3 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = _mm_add_pd(p0, _mm_loadu_pd(a + i));
+    p1 = _mm_add_pd(p1, _mm_loadu_pd(a + i + 2));
+    p2 = _mm_add_pd(p2, _mm_loadu_pd(a + i + 4));
+    p3 = _mm_add_pd(p3, _mm_loadu_pd(a + i + 6));
+  }
+  Partials partials;
+  _mm_storeu_pd(&partials[0], p0);
+  _mm_storeu_pd(&partials[2], p1);
+  _mm_storeu_pd(&partials[4], p2);
+  _mm_storeu_pd(&partials[6], p3);
+  return sum_rest(add_partials(partials), a, i, count);
+}
+
+template <typename Pick, typename PickVector>
+double pick_sse2(const double* a, size_t count, Pick pick,
+                 PickVector pick_vector) {
+  if (count < LANES) {
+    return pick_rest(a[0], a, 1, count, pick);
+  }
+  __m128d p0 = _mm_loadu_pd(a);
+  __m128d p1 = _mm_loadu_pd(a + 2);
+  __m128d p2 = _mm_loadu_pd(a + 4);
+  __m128d p3 = _mm_loadu_pd(a + 6);
+  size_t i = LANES;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = pick_vector(p0, _mm_loadu_pd(a + i));
+    p1 = pick_vector(p1, _mm_loadu_pd(a + i + 2));
+    p2 = pick_vector(p2, _mm_loadu_pd(a + i + 4));
+    p3 = pick_vector(p3, _mm_loadu_pd(a + i + 6));
+  }
+  Partials partials;
+  _mm_storeu_pd(&partials[0], p0);
+  _mm_storeu_pd(&partials[2], p1);
+  _mm_storeu_pd(&partials[4], p2);
+  _mm_storeu_pd(&partials[6], p3);
+  return pick_rest(pick_partials(partials, pick), a, i, count, pick);
+}
+
+double min_sse2(const double* a, size_t count) {
+  return pick_sse2(a, count, min_of,
+                   [](__m128d x, __m128d y) { return _mm_min_pd(x, y); });
+}
+
+double max_sse2(const double* a, size_t count) {
+  return pick_sse2(a, count, max_of,
+                   [](__m128d x, __m128d y) { return _mm_max_pd(x, y); });
+}
+
+// A block of four is two vectors, low and high.
+void prefix_sum_sse2(const double* a, double* out, size_t count) {
+  const __m128d zero = _mm_setzero_pd();
+  __m128d carry = zero;
+  size_t i = 0;
+  for (; i + BLOCK <= count; i += BLOCK) {
+    const __m128d low = _mm_loadu_pd(a + i);
+    const __m128d high = _mm_loadu_pd(a + i + 2);
+    const __m128d t_low = _mm_add_pd(low, _mm_unpacklo_pd(zero, low));
+    const __m128d t_high = _mm_add_pd(high, _mm_unpacklo_pd(zero, high));
+    const __m128d u_low = _mm_add_pd(t_low, zero);
+    const __m128d u_high = _mm_add_pd(t_high, _mm_unpackhi_pd(t_low, t_low));
+    const __m128d out_high = _mm_add_pd(u_high, carry);
+    _mm_storeu_pd(out + i, _mm_add_pd(u_low, carry));
+    _mm_storeu_pd(out + i + 2, out_high);
+    carry = _mm_unpackhi_pd(out_high, out_high);
+  }
+  prefix_sum_rest(_mm_cvtsd_f64(carry), a, out, i, count);
+}
+
+constexpr SimdKernels SSE2_KERNELS{add_sse2, multiply_sse2, scale_sse2,
+                                   dot_sse2, sum_sse2,      min_sse2,
+                                   max_sse2, prefix_sum_sse2};
+
+#define LOX_TARGET_AVX2 __attribute__((target("avx2")))
+constexpr size_t AVX2_WIDTH = 4;
+
+LOX_TARGET_AVX2 void add_avx2(const double* a, const double* b, double* out,
+                              size_t count) {
+  size_t i = 0;
+  for (; i + AVX2_WIDTH <= count; i += AVX2_WIDTH) {
+    _mm256_storeu_pd(
+        out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  add_scalar(a + i, b + i, out + i, count - i);
+}
+
+LOX_TARGET_AVX2 void multiply_avx2(const double* a, const double* b,
+                                   double* out, size_t count) {
+  size_t i = 0;
+  for (; i + AVX2_WIDTH <= count; i += AVX2_WIDTH) {
+    _mm256_storeu_pd(
+        out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  multiply_scalar(a + i, b + i, out + i, count - i);
+}
+
+LOX_TARGET_AVX2 void scale_avx2(const double* a, double factor, double* out,
+                                size_t count) {
+  const __m256d factors = _mm256_set1_pd(factor);
+  size_t i = 0;
+  for (; i + AVX2_WIDTH <= count; i += AVX2_WIDTH) {
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factors));
+  }
+  scale_scalar(a + i, factor, out + i, count - i);
+}
+
+LOX_TARGET_AVX2 double dot_avx2(const double* a, const double* b,
+                                size_t count) {
+  __m256d p0 = _mm256_setzero_pd();
+  __m256d p1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = _mm256_add_pd(
+        p0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    p1 = _mm256_add_pd(p1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                         _mm256_loadu_pd(b + i + 4)));
+  }
+  Partials partials;
+  _mm256_storeu_pd(&partials[0], p0);
+  _mm256_storeu_pd(&partials[4], p1);
+  return dot_rest(add_partials(partials), a, b, i, count);
+}
+
+LOX_TARGET_AVX2 double sum_avx2(const double* a, size_t count) {
+  __m256d p0 = _mm256_setzero_pd();
+  __m256d p1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = _mm256_add_pd(p0, _mm256_loadu_pd(a + i));
+    p1 = _mm256_add_pd(p1, _mm256_loadu_pd(a + i + 4));
+  }
+  Partials partials;
+  _mm256_storeu_pd(&partials[0], p0);
+  _mm256_storeu_pd(&partials[4], p1);
+  return sum_rest(add_partials(partials), a, i, count);
+}
+
+LOX_TARGET_AVX2 double min_avx2(const double* a, size_t count) {
+  if (count < LANES) {
+    return pick_rest(a[0], a, 1, count, min_of);
+  }
+  __m256d p0 = _mm256_loadu_pd(a);
+  __m256d p1 = _mm256_loadu_pd(a + 4);
+  size_t i = LANES;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = _mm256_min_pd(p0, _mm256_loadu_pd(a + i));
+    p1 = _mm256_min_pd(p1, _mm256_loadu_pd(a + i + 4));
+  }
+  Partials partials;
+  _mm256_storeu_pd(&partials[0], p0);
+  _mm256_storeu_pd(&partials[4], p1);
+  return pick_rest(pick_partials(partials, min_of), a, i, count, min_of);
+}
+
+LOX_TARGET_AVX2 double max_avx2(const double* a, size_t count) {
+  if (count < LANES) {
+    return pick_rest(a[0], a, 1, count, max_of);
+  }
+  __m256d p0 = _mm256_loadu_pd(a);
+  __m256d p1 = _mm256_loadu_pd(a + 4);
+  size_t i = LANES;
+  for (; i + LANES <= count; i += LANES) {
+    p0 = _mm256_max_pd(p0, _mm256_loadu_pd(a + i));
+    p1 = _mm256_max_pd(p1, _mm256_loadu_pd(a + i + 4));
+  }
+  Partials partials;
+  _mm256_storeu_pd(&partials[0], p0);
+  _mm256_storeu_pd(&partials[4], p1);
+  return pick_rest(pick_partials(partials, max_of), a, i, count, max_of);
+}
+
+// A block of four is one vector. The first step adds each even element to
+// the odd one after it and the second adds the second sum to the upper
+// half.
+LOX_TARGET_AVX2 void prefix_sum_avx2(const double* a, double* out,
+                                     size_t count) {
+  constexpr int odd_lanes = 0b1010;
+  constexpr int upper_lanes = 0b1100;
+  constexpr int all_second = 0b01010101;
+  constexpr int all_fourth = 0b11111111;
+  const __m256d zero = _mm256_setzero_pd();
+  __m256d carry = zero;
+  size_t i = 0;
+  for (; i + BLOCK <= count; i += BLOCK) {
+    const __m256d x = _mm256_loadu_pd(a + i);
+    const __m256d t = _mm256_add_pd(
+        x, _mm256_blend_pd(zero, _mm256_permute_pd(x, 0), odd_lanes));
+    const __m256d u = _mm256_add_pd(
+        t, _mm256_blend_pd(zero, _mm256_permute4x64_pd(t, all_second),
+                           upper_lanes));
+    const __m256d sums = _mm256_add_pd(u, carry);
+    _mm256_storeu_pd(out + i, sums);
+    carry = _mm256_permute4x64_pd(sums, all_fourth);
+  }
+  prefix_sum_rest(_mm256_cvtsd_f64(carry), a, out, i, count);
+}
+
+constexpr SimdKernels AVX2_KERNELS{add_avx2, multiply_avx2, scale_avx2,
+                                   dot_avx2, sum_avx2,      min_avx2,
+                                   max_avx2, prefix_sum_avx2};
+
+#define LOX_TARGET_AVX512 __attribute__((target("avx512f")))
+
+LOX_TARGET_AVX512 void add_avx512(const double* a, const double* b,
+                                  double* out, size_t count) {
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    _mm512_storeu_pd(
+        out + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+  }
+  add_scalar(a + i, b + i, out + i, count - i);
+}
+
+LOX_TARGET_AVX512 void multiply_avx512(const double* a, const double* b,
+                                       double* out, size_t count) {
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    _mm512_storeu_pd(
+        out + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+  }
+  multiply_scalar(a + i, b + i, out + i, count - i);
+}
+
+LOX_TARGET_AVX512 void scale_avx512(const double* a, double factor,
+                                    double* out, size_t count) {
+  const __m512d factors = _mm512_set1_pd(factor);
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    _mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), factors));
+  }
+  scale_scalar(a + i, factor, out + i, count - i);
+}
+
+LOX_TARGET_AVX512 double dot_avx512(const double* a, const double* b,
+                                    size_t count) {
+  __m512d p = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    p = _mm512_add_pd(
+        p, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+  }
+  Partials partials;
+  _mm512_storeu_pd(partials.data(), p);
+  return dot_rest(add_partials(partials), a, b, i, count);
+}
+
+LOX_TARGET_AVX512 double sum_avx512(const double* a, size_t count) {
+  __m512d p = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    p = _mm512_add_pd(p, _mm512_loadu_pd(a + i));
+  }
+  Partials partials;
+  _mm512_storeu_pd(partials.data(), p);
+  return sum_rest(add_partials(partials), a, i, count);
+}
+
+// Comparing and blending picks the same element MINPD and MAXPD would.
+LOX_TARGET_AVX512 double min_avx512(const double* a, size_t count) {
+  if (count < LANES) {
+    return pick_rest(a[0], a, 1, count, min_of);
+  }
+  __m512d p = _mm512_loadu_pd(a);
+  size_t i = LANES;
+  for (; i + LANES <= count; i += LANES) {
+    const __m512d x = _mm512_loadu_pd(a + i);
+    p = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(p, x, _CMP_LT_OQ), x, p);
+  }
+  Partials partials;
+  _mm512_storeu_pd(partials.data(), p);
+  return pick_rest(pick_partials(partials, min_of), a, i, count, min_of);
+}
+
+LOX_TARGET_AVX512 double max_avx512(const double* a, size_t count) {
+  if (count < LANES) {
+    return pick_rest(a[0], a, 1, count, max_of);
+  }
+  __m512d p = _mm512_loadu_pd(a);
+  size_t i = LANES;
+  for (; i + LANES <= count; i += LANES) {
+    const __m512d x = _mm512_loadu_pd(a + i);
+    p = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(p, x, _CMP_GT_OQ), x, p);
+  }
+  Partials partials;
+  _mm512_storeu_pd(partials.data(), p);
+  return pick_rest(pick_partials(partials, max_of), a, i, count, max_of);
+}
+
+// Prefix sums carry from one block to the next, so wider vectors do not
+// help and the AVX2 scan is reused.
+constexpr SimdKernels AVX512_KERNELS{
+    add_avx512, multiply_avx512, scale_avx512, dot_avx512,
+    sum_avx512, min_avx512,      max_avx512,   prefix_sum_avx2};
+#endif
+
+const SimdKernels& choose_kernels() {
+#ifdef LOX_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) {
+    return AVX512_KERNELS;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return AVX2_KERNELS;
+  }
+  return SSE2_KERNELS;
+#else
+  return SCALAR_KERNELS;
+#endif
+}
+}  // namespace
+
+const SimdKernels& simd_kernels() {
+  static const SimdKernels& kernels = choose_kernels();
+  return kernels;
+}
+}  // namespace lox::bytecode
@@ -0,0 +1,623 @@
+#include <algorithm>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "binary_io.hpp"
+#include "bytecode_file.hpp"
+#include "vm.hpp"
+
+// A snapshot lists the reachable objects twice. The first pass holds what
+// each object needs to be allocated, so every object exists before any
+// references are filled in by the second pass. Objects are referred to by
+// their position in the list plus one, with zero for null.
+namespace lox::bytecode {
+namespace {
+constexpr std::string_view MAGIC = "LOXS";
+constexpr size_t HEADER_SIZE =
+    MAGIC.size() + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+// Stands in for the index of a shared channel in snapshots, which cannot
+// share them.
+constexpr uint32_t NEW_CHANNEL = UINT32_MAX;
+
+enum ValueTag : uint8_t {
+  VALUE_NIL,
+  VALUE_FALSE,
+  VALUE_TRUE,
+  VALUE_INT,
+  VALUE_NUMBER,
+  VALUE_OBJ
+};
+
+template <typename Visit>
+void visit_table(const Table& table, Visit& visit) {
+  for (size_t i = 0; i < table.get_capacity(); i++) {
+    const Entry& entry = table.get_entries()[i];
+    if (entry.key != nullptr) {
+      visit(entry.key);
+      visit(entry.value);
+    }
+  }
+}
+
+// Calls visit with every object or value the object refers to, in the
+// order the second pass stores them.
+template <typename Visit>
+void visit_references(Obj* object, Visit& visit) {
+  switch (object->type) {
+    case OBJ_BOUND_METHOD: {
+      auto* bound = static_cast<ObjBoundMethod*>(object);
+      visit(bound->receiver);
+      visit(bound->method);
+      break;
+    }
+    case OBJ_CLASS: {
+      auto* class_ = static_cast<ObjClass*>(object);
+      visit(class_->name);
+      visit_table(class_->methods, visit);
+      break;
+    }
+    case OBJ_CLOSURE: {
+      auto* closure = static_cast<ObjClosure*>(object);
+      for (ObjUpvalue* upvalue : closure->upvalues) {
+        visit(upvalue);
+      }
+      break;
+    }
+    case OBJ_FIBER:
+      visit(static_cast<ObjFiber*>(object)->closure);
+      break;
+    case OBJ_FUNCTION: {
+      auto* function = static_cast<ObjFunction*>(object);
+      visit(function->name);
+      for (const Value constant : function->chunk.get_constants()) {
+        visit(constant);
+      }
+      break;
+    }
+    case OBJ_INSTANCE: {
+      auto* instance = static_cast<ObjInstance*>(object);
+      visit(instance->class_);
+      visit_table(instance->fields, visit);
+      break;
+    }
+    case OBJ_LIST:
+      for (const Value element : static_cast<ObjList*>(object)->elements) {
+        visit(element);
+      }
+      break;
+    case OBJ_MAP: {
+      const ValueTable& entries = static_cast<ObjMap*>(object)->entries;
+      for (uint32_t i = 0; i < entries.get_capacity(); i++) {
+        const ValueEntry& entry = entries.get_entries()[i];
+        if (!IS_NIL(entry.key)) {
+          visit(entry.key);
+          visit(entry.value);
+        }
+      }
+      break;
+    }
+    case OBJ_UPVALUE:
+      // An open upvalue is copied with the value its variable has now.
+      visit(*static_cast<ObjUpvalue*>(object)->location);
+      break;
+    case OBJ_CHANNEL:
+    case OBJ_FLOAT64_ARRAY:
+    case OBJ_NATIVE:
+    case OBJ_STRING:
+      break;
+  }
+}
+
+size_t live_entries(const Table& table) {
+  size_t count = 0;
+  for (size_t i = 0; i < table.get_capacity(); i++) {
+    count += table.get_entries()[i].key != nullptr ? 1U : 0U;
+  }
+  return count;
+}
+
+class SnapshotWriter : public BinaryWriter {
+ public:
+  SnapshotWriter(std::ostream& out,
+                 std::vector<std::shared_ptr<Channel>>* channels)
+      : BinaryWriter{out}, channels_{channels} {}
+
+  void add(Obj* object) {
+    if (object != nullptr && indices_.emplace(object, 0).second) {
+      objects_.push_back(object);
+    }
+  }
+
+  // Finds everything reachable from the objects added so far. Closures go
+  // last so that their functions, which size them, are allocated first.
+  void collect() {
+    auto add_reference = [this](auto reference) { add_object(reference); };
+    for (size_t i = 0; i < objects_.size(); i++) {
+      if (objects_[i]->type == OBJ_CLOSURE) {
+        add(static_cast<ObjClosure*>(objects_[i])->function);
+      }
+      visit_references(objects_[i], add_reference);
+    }
+
+    std::stable_partition(objects_.begin(), objects_.end(), [](Obj* object) {
+      return object->type != OBJ_CLOSURE;
+    });
+    for (size_t i = 0; i < objects_.size(); i++) {
+      indices_[objects_[i]] = static_cast<uint32_t>(i + 1);
+    }
+  }
+
+  void write_objects(const std::vector<NativeFn>& natives) {
+    write(static_cast<uint32_t>(objects_.size()));
+    for (Obj* object : objects_) {
+      write_allocation(object, natives);
+    }
+
+    auto write_reference = [this](auto reference) { write_value(reference); };
+    for (Obj* object : objects_) {
+      if (object->type == OBJ_CLASS) {
+        write_table_size(static_cast<ObjClass*>(object)->methods);
+      } else if (object->type == OBJ_INSTANCE) {
+        write_table_size(static_cast<ObjInstance*>(object)->fields);
+      } else if (object->type == OBJ_FUNCTION) {
+        const Chunk& chunk = static_cast<ObjFunction*>(object)->chunk;
+        write_code(chunk);
+        write(static_cast<uint32_t>(chunk.get_constants().size()));
+      } else if (object->type == OBJ_LIST) {
+        write(static_cast<uint32_t>(
+            static_cast<ObjList*>(object)->elements.size()));
+      } else if (object->type == OBJ_MAP) {
+        write(static_cast<ObjMap*>(object)->entries.count());
+      }
+      visit_references(object, write_reference);
+    }
+  }
+
+  void write_value(Obj* object) {
+    write(object != nullptr ? indices_[object] : 0U);
+  }
+
+  void write_value(Value value) {
+    if (IS_NIL(value)) {
+      write(VALUE_NIL);
+    } else if (IS_BOOL(value)) {
+      write(AS_BOOL(value) ? VALUE_TRUE : VALUE_FALSE);
+    } else if (IS_INT(value)) {
+      write(VALUE_INT);
+      write(AS_INT(value));
+    } else if (IS_NUMBER(value)) {
+      write(VALUE_NUMBER);
+      write(AS_NUMBER(value));
+    } else {
+      write(VALUE_OBJ);
+      write(indices_[AS_OBJ(value)]);
+    }
+  }
+
+  void write_table(const Table& table) {
+    write_table_size(table);
+    auto write_reference = [this](auto reference) { write_value(reference); };
+    visit_table(table, write_reference);
+  }
+
+ private:
+  void add_object(Value value) {
+    if (IS_OBJ(value)) {
+      add(AS_OBJ(value));
+    }
+  }
+  void add_object(Obj* object) { add(object); }
+
+  void write_allocation(Obj* object, const std::vector<NativeFn>& natives) {
+    write(static_cast<uint8_t>(object->type));
+    switch (object->type) {
+      case OBJ_STRING:
+        write_string(static_cast<ObjString*>(object)->string);
+        break;
+      case OBJ_NATIVE: {
+        const NativeFn function = static_cast<ObjNative*>(object)->function;
+        write(static_cast<uint32_t>(
+            std::find(natives.begin(), natives.end(), function) -
+            natives.begin()));
+        break;
+      }
+      case OBJ_FUNCTION: {
+        auto* function = static_cast<ObjFunction*>(object);
+        write(function->arity);
+        write(function->upvalue_count);
+        break;
+      }
+      case OBJ_CLOSURE:
+        write(indices_[static_cast<ObjClosure*>(object)->function]);
+        break;
+      case OBJ_FIBER:
+        // Saved frames point into this VM's code, so only a fiber that has
+        // not started is copied as it is; any other arrives finished.
+        write(static_cast<uint8_t>(
+            static_cast<ObjFiber*>(object)->state == FIBER_NEW ? FIBER_NEW
+                                                                : FIBER_DONE));
+        break;
+      case OBJ_FLOAT64_ARRAY: {
+        const std::vector<double>& values =
+            static_cast<ObjFloat64Array*>(object)->values;
+        write(static_cast<uint32_t>(values.size()));
+        for (const double value : values) {
+          write(value);
+        }
+        break;
+      }
+      case OBJ_CHANNEL: {
+        const std::shared_ptr<Channel>& channel =
+            static_cast<ObjChannel*>(object)->channel;
+        write(static_cast<uint32_t>(channel->capacity()));
+        if (channels_ != nullptr) {
+          write(static_cast<uint32_t>(channels_->size()));
+          channels_->push_back(channel);
+        } else {
+          write(NEW_CHANNEL);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  void write_table_size(const Table& table) {
+    write(static_cast<uint32_t>(live_entries(table)));
+  }
+
+  std::vector<Obj*> objects_;
+  std::unordered_map<Obj*, uint32_t> indices_;
+  std::vector<std::shared_ptr<Channel>>* channels_;
+};
+
+class SnapshotReader : public BinaryReader {
+ public:
+  SnapshotReader(std::string_view data, const std::vector<Obj*>& objects)
+      : BinaryReader{data}, objects_{objects} {}
+
+  // Reads a reference that must be null or point to an object of the
+  // given type.
+  template <typename ObjT>
+  ObjT* read_object(ObjType type) {
+    const auto index = read<uint32_t>();
+    if (index == 0) {
+      return nullptr;
+    }
+    if (index > objects_.size() || objects_[index - 1]->type != type) {
+      fail();
+      return nullptr;
+    }
+    return static_cast<ObjT*>(objects_[index - 1]);
+  }
+
+  Value read_value() {
+    switch (read<uint8_t>()) {
+      case VALUE_NIL:
+        return NIL_VAL;
+      case VALUE_FALSE:
+        return FALSE_VAL;
+      case VALUE_TRUE:
+        return TRUE_VAL;
+      case VALUE_INT:
+        return INT_VAL(read<int32_t>());
+      case VALUE_NUMBER:
+        return NUMBER_VAL(read<double>());
+      case VALUE_OBJ: {
+        const auto index = read<uint32_t>();
+        if (index == 0 || index > objects_.size()) {
+          fail();
+          return NIL_VAL;
+        }
+        return OBJ_VAL(objects_[index - 1]);
+      }
+      default:
+        fail();
+        return NIL_VAL;
+    }
+  }
+
+  void read_table(Table& table) {
+    const auto count = read<uint32_t>();
+    for (uint32_t i = 0; i < count && !failed(); i++) {
+      auto* key = read_object<ObjString>(OBJ_STRING);
+      const Value value = read_value();
+      if (key == nullptr) {
+        fail();
+      } else {
+        table.set(key, value);
+      }
+    }
+  }
+
+ private:
+  const std::vector<Obj*>& objects_;
+};
+}  // namespace
+
+void VM::write_heap(std::ostream& out, const Table& globals, Value value,
+                    std::vector<std::shared_ptr<Channel>>* channels) {
+  SnapshotWriter writer{out, channels};
+  auto add = [&writer](auto reference) {
+    if constexpr (std::is_same_v<decltype(reference), Value>) {
+      if (IS_OBJ(reference)) {
+        writer.add(AS_OBJ(reference));
+      }
+    } else {
+      writer.add(reference);
+    }
+  };
+  visit_table(globals, add);
+  add(value);
+  writer.collect();
+  writer.write_objects(natives_);
+  writer.write_table(globals);
+  writer.write_value(value);
+}
+
+void VM::write_snapshot(std::ostream& out) {
+  std::ostringstream payload;
+  write_heap(payload, globals_, NIL_VAL, nullptr);
+  const std::string bytes = payload.str();
+
+  BinaryWriter header{out};
+  header.write_bytes(MAGIC);
+  header.write(COMPILER_VERSION);
+  header.write(OPCODE_COUNT);
+  header.write(hash_bytes(bytes));
+  header.write_bytes(bytes);
+}
+
+bool VM::restore_snapshot(std::string_view data) {
+  if (data.size() < HEADER_SIZE || data.substr(0, MAGIC.size()) != MAGIC) {
+    return false;
+  }
+  BinaryReader header{data.substr(MAGIC.size())};
+  if (header.read<uint32_t>() != COMPILER_VERSION ||
+      header.read<uint32_t>() != OPCODE_COUNT ||
+      header.read<uint64_t>() != hash_bytes(data.substr(HEADER_SIZE))) {
+    return false;
+  }
+
+  Table globals;
+  Value value{NIL_VAL};
+  // Every object the VM runs must be whole, so a partial restore leaves the
+  // globals alone and its objects to the next collection.
+  if (!read_heap(data.substr(HEADER_SIZE), globals, value, {})) {
+    return false;
+  }
+  globals.add_all(globals_);
+  return true;
+}
+
+Message VM::pack(Value value) {
+  Message message;
+  std::ostringstream out;
+  write_heap(out, Table{}, value, &message.channels);
+  message.bytes = out.str();
+  return message;
+}
+
+Value VM::unpack(const Message& message) {
+  Table globals;
+  Value value{NIL_VAL};
+  return read_heap(message.bytes, globals, value, message.channels) ? value
+                                                                    : NIL_VAL;
+}
+
+// The objects are only rooted while they are read, so callers must root
+// the globals or value before allocating again.
+bool VM::read_heap(std::string_view data, Table& globals, Value& value,
+                   const std::vector<std::shared_ptr<Channel>>& channels) {
+  // Unroots the rebuilt objects however the restore ends, including when
+  // an allocation throws.
+  struct Unroot {
+    std::vector<Obj*>& objects;
+    ~Unroot() { objects.clear(); }
+  } unroot{restored_objects_};
+
+  SnapshotReader reader{data, restored_objects_};
+  const auto count = reader.read<uint32_t>();
+  // Every object takes at least a byte, which bounds a corrupt count.
+  if (count > data.size()) {
+    return false;
+  }
+
+  restored_objects_.reserve(count);
+  for (uint32_t i = 0; i < count && !reader.failed(); i++) {
+    Obj* object{};
+    switch (reader.read<uint8_t>()) {
+      case OBJ_BOUND_METHOD:
+        object = allocate_object<ObjBoundMethod>(NIL_VAL, nullptr);
+        break;
+      case OBJ_CHANNEL: {
+        const auto capacity = reader.read<uint32_t>();
+        const auto index = reader.read<uint32_t>();
+        if (index < channels.size()) {
+          object = allocate_object<ObjChannel>(channels[index]);
+        } else if (index == NEW_CHANNEL && capacity <= Channel::MAX_CAPACITY) {
+          object = allocate_object<ObjChannel>(
+              std::make_shared<Channel>(capacity));
+        }
+        break;
+      }
+      case OBJ_CLASS:
+        object = allocate_object<ObjClass>(nullptr);
+        break;
+      case OBJ_CLOSURE:
+        if (auto* function = reader.read_object<ObjFunction>(OBJ_FUNCTION)) {
+          object = allocate_object<ObjClosure>(function);
+        }
+        break;
+      case OBJ_FIBER: {
+        const auto state = reader.read<uint8_t>();
+        if (state == FIBER_NEW || state == FIBER_DONE) {
+          auto* fiber = allocate_object<ObjFiber>(nullptr);
+          fiber->state = static_cast<FiberState>(state);
+          object = fiber;
+        }
+        break;
+      }
+      case OBJ_FLOAT64_ARRAY: {
+        const auto length = reader.read<uint32_t>();
+        // Every element takes eight bytes, which bounds a corrupt length.
+        if (length <= data.size() / sizeof(double)) {
+          auto* array = allocate_float64_array(length);
+          for (double& value : array->values) {
+            value = reader.read<double>();
+          }
+          object = array;
+        }
+        break;
+      }
+      case OBJ_FUNCTION: {
+        auto* function = allocate_object<ObjFunction>();
+        function->arity = reader.read<int32_t>();
+        function->upvalue_count = reader.read<uint16_t>();
+        object = function;
+        break;
+      }
+      case OBJ_INSTANCE:
+        object = allocate_object<ObjInstance>(nullptr);
+        break;
+      case OBJ_LIST:
+        object = allocate_object<ObjList>();
+        break;
+      case OBJ_MAP:
+        object = allocate_map();
+        break;
+      case OBJ_NATIVE: {
+        const auto index = reader.read<uint32_t>();
+        if (index < natives_.size()) {
+          object = allocate_object<ObjNative>(natives_[index]);
+        }
+        break;
+      }
+      case OBJ_STRING:
+        object = allocate_object<ObjString>(reader.read_string());
+        break;
+      case OBJ_UPVALUE: {
+        auto* upvalue = allocate_object<ObjUpvalue>(nullptr);
+        upvalue->location = &upvalue->closed;
+        object = upvalue;
+        break;
+      }
+      default:
+        break;
+    }
+
+    if (object == nullptr) {
+      reader.fail();
+    } else {
+      restored_objects_.push_back(object);
+    }
+  }
+
+  for (Obj* object : restored_objects_) {
+    if (reader.failed()) {
+      break;
+    }
+    switch (object->type) {
+      case OBJ_BOUND_METHOD: {
+        auto* bound = static_cast<ObjBoundMethod*>(object);
+        bound->receiver = reader.read_value();
+        bound->method = reader.read_object<ObjClosure>(OBJ_CLOSURE);
+        break;
+      }
+      case OBJ_CLASS: {
+        auto* class_ = static_cast<ObjClass*>(object);
+        const auto method_count = reader.read<uint32_t>();
+        class_->name = reader.read_object<ObjString>(OBJ_STRING);
+        for (uint32_t i = 0; i < method_count && !reader.failed(); i++) {
+          auto* name = reader.read_object<ObjString>(OBJ_STRING);
+          const Value method = reader.read_value();
+          if (name == nullptr || !IS_CLOSURE(method)) {
+            reader.fail();
+          } else {
+            class_->methods.set(name, method);
+          }
+        }
+        break;
+      }
+      case OBJ_CLOSURE: {
+        auto* closure = static_cast<ObjClosure*>(object);
+        for (ObjUpvalue*& upvalue : closure->upvalues) {
+          upvalue = reader.read_object<ObjUpvalue>(OBJ_UPVALUE);
+        }
+        break;
+      }
+      case OBJ_FIBER: {
+        auto* fiber = static_cast<ObjFiber*>(object);
+        fiber->closure = reader.read_object<ObjClosure>(OBJ_CLOSURE);
+        if (fiber->closure == nullptr) {
+          reader.fail();
+        }
+        break;
+      }
+      case OBJ_FUNCTION: {
+        auto* function = static_cast<ObjFunction*>(object);
+        reader.read_code(function->chunk);
+        const auto constant_count = reader.read<uint32_t>();
+        function->name = reader.read_object<ObjString>(OBJ_STRING);
+        for (uint32_t i = 0; i < constant_count && !reader.failed(); i++) {
+          function->chunk.add_constant(reader.read_value());
+        }
+        break;
+      }
+      case OBJ_INSTANCE: {
+        auto* instance = static_cast<ObjInstance*>(object);
+        const auto field_count = reader.read<uint32_t>();
+        instance->class_ = reader.read_object<ObjClass>(OBJ_CLASS);
+        for (uint32_t i = 0; i < field_count && !reader.failed(); i++) {
+          auto* name = reader.read_object<ObjString>(OBJ_STRING);
+          const Value value = reader.read_value();
+          if (name == nullptr) {
+            reader.fail();
+          } else {
+            instance->fields.set(name, value);
+          }
+        }
+        break;
+      }
+      case OBJ_LIST: {
+        auto* list = static_cast<ObjList*>(object);
+        const auto element_count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < element_count && !reader.failed(); i++) {
+          list->elements.push_back(reader.read_value());
+        }
+        track_storage(list);
+        break;
+      }
+      case OBJ_MAP: {
+        auto* map = static_cast<ObjMap*>(object);
+        const auto entry_count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < entry_count && !reader.failed(); i++) {
+          const Value key = reader.read_value();
+          const Value value = reader.read_value();
+          if (IS_NIL(key)) {
+            reader.fail();
+          } else {
+            map->entries.set(key, value);
+          }
+        }
+        track_storage(map);
+        break;
+      }
+      case OBJ_UPVALUE:
+        static_cast<ObjUpvalue*>(object)->closed = reader.read_value();
+        break;
+      case OBJ_CHANNEL:
+      case OBJ_FLOAT64_ARRAY:
+      case OBJ_NATIVE:
+      case OBJ_STRING:
+        break;
+    }
+  }
+
+  reader.read_table(globals);
+  value = reader.read_value();
+  return !reader.failed();
+}
+}  // namespace lox::bytecode
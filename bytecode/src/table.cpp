@@ -1,8 +1,75 @@
 #include "table.hpp"
 
+#include <cmath>
+#include <cstring>
+
 #include "object.hpp"
 
 namespace lox::bytecode {
+namespace {
+Value normalize_key(Value key) {
+  if (IS_DOUBLE(key)) {
+    const double number = AS_NUMBER(key);
+    if (std::trunc(number) == number && number >= INT32_MIN &&
+        number <= INT32_MAX) {
+      return INT_VAL(static_cast<int32_t>(number));
+    }
+  }
+  return key;
+}
+
+bool keys_equal(Value left, Value right) {
+#ifdef NAN_BOXING
+  return left == right;
+#else
+  if (left.type != right.type) {
+    return false;
+  }
+  switch (left.type) {
+    case VAL_BOOL:
+      return AS_BOOL(left) == AS_BOOL(right);
+    case VAL_NIL:
+      return true;
+    case VAL_NUMBER:
+      return AS_NUMBER(left) == AS_NUMBER(right);
+    case VAL_OBJ:
+      return AS_OBJ(left) == AS_OBJ(right);
+  }
+  return false;
+#endif
+}
+
+// Strings use their content hash so that maps keyed by them iterate in
+// the same order on every run.
+uint32_t hash_key(Value key) {
+  if (IS_STRING(key)) {
+    return AS_STRING(key)->hash;
+  }
+
+  uint64_t bits{};
+#ifdef NAN_BOXING
+  bits = key;
+#else
+  if (IS_OBJ(key)) {
+    bits = reinterpret_cast<uintptr_t>(AS_OBJ(key));
+  } else if (IS_NUMBER(key)) {
+    const double number = AS_NUMBER(key);
+    std::memcpy(&bits, &number, sizeof(bits));
+  } else {
+    bits = AS_BOOL(key) ? 1U : 0U;
+  }
+#endif
+  // The finalizer of MurmurHash3, which spreads every bit of the value
+  // over the low bits used as the index.
+  constexpr uint64_t multiplier = 0xff51afd7ed558ccdULL;
+  constexpr unsigned shift = 33;
+  bits ^= bits >> shift;
+  bits *= multiplier;
+  bits ^= bits >> shift;
+  return static_cast<uint32_t>(bits);
+}
+}  // namespace
+
 bool Table::set(ObjString* key, Value value) {
   if (size_ + 1 >
       static_cast<uint32_t>(static_cast<float>(capacity_) * MAX_LOAD)) {
@@ -129,4 +196,97 @@ void Table::adjust_capacity(uint32_t capacity) {
   capacity_ = capacity;
   entries_ = std::move(entries);
 }
+
+bool ValueTable::set(Value key, Value value) {
+  if (size_ + 1 >
+      static_cast<uint32_t>(static_cast<float>(capacity_) * MAX_LOAD)) {
+    adjust_capacity(capacity_ * 2);
+  }
+
+  key = normalize_key(key);
+  ValueEntry* entry = find_entry(entries_, capacity_, key);
+  const bool is_new_key = IS_NIL(entry->key);
+  if (is_new_key) {
+    if (IS_NIL(entry->value)) {
+      size_++;
+    }
+    count_++;
+  }
+
+  entry->key = key;
+  entry->value = value;
+  return is_new_key;
+}
+
+bool ValueTable::get(Value key, Value* value) const {
+  if (count_ == 0 || IS_NIL(key)) {
+    return false;
+  }
+
+  ValueEntry* entry = find_entry(entries_, capacity_, normalize_key(key));
+  if (IS_NIL(entry->key)) {
+    return false;
+  }
+
+  *value = entry->value;
+  return true;
+}
+
+bool ValueTable::del(Value key) {
+  if (count_ == 0 || IS_NIL(key)) {
+    return false;
+  }
+
+  ValueEntry* entry = find_entry(entries_, capacity_, normalize_key(key));
+  if (IS_NIL(entry->key)) {
+    return false;
+  }
+
+  entry->key = NIL_VAL;
+  entry->value = TRUE_VAL;
+  count_--;
+  return true;
+}
+
+ValueEntry* ValueTable::find_entry(const Entries& entries, uint32_t capacity,
+                                   Value key) {
+  uint32_t index = hash_key(key) & (capacity - 1U);
+  ValueEntry* tombstone = nullptr;
+
+  for (;;) {
+    ValueEntry* entry = &entries[index];
+    if (IS_NIL(entry->key)) {
+      if (IS_NIL(entry->value)) {
+        return tombstone != nullptr ? tombstone : entry;
+      }
+      if (tombstone == nullptr) {
+        tombstone = entry;
+      }
+    } else if (keys_equal(entry->key, key)) {
+      return entry;
+    }
+
+    index = (index + 1) & (capacity - 1U);
+  }
+}
+
+void ValueTable::adjust_capacity(uint32_t capacity) {
+  auto entries = std::make_unique<ValueEntry[]>(capacity);
+
+  size_ = 0;
+  for (uint32_t i = 0; i < capacity_; i++) {
+    ValueEntry* entry = &entries_[i];
+    if (IS_NIL(entry->key)) {
+      continue;
+    }
+
+    ValueEntry* dest = find_entry(entries, capacity, entry->key);
+    dest->key = entry->key;
+    dest->value = entry->value;
+    size_++;
+  }
+
+  capacity_ = capacity;
+  entries_ = std::move(entries);
+}
 }  // namespace lox::bytecode
@@ -1,45 +1,124 @@
 #include "value.hpp"
 
+#include <algorithm>
 #include <iostream>
-#include <limits>
 
 #include "object.hpp"
 
 namespace lox::bytecode {
 namespace {
-void print_function(ObjFunction* function) {
+void print_function(ObjFunction* function, std::ostream& out) {
   if (function->name == nullptr) {
-    std::cout << "<script>";
+    out << "<script>";
     return;
   }
-  std::cout << "<fn " << function->name->string << ">";
+  out << "<fn " << function->name->string << ">";
 }
 
-void print_object(Value value) {
+// Lists and maps being printed on this thread, so that one containing
+// itself prints as [...] or {...} instead of recursing forever.
+thread_local std::vector<const Obj*> open_containers;
+
+bool is_open(const Obj* container) {
+  return std::find(open_containers.begin(), open_containers.end(),
+                   container) != open_containers.end();
+}
+
+void print_list(const ObjList* list, std::ostream& out) {
+  if (is_open(list)) {
+    out << "[...]";
+    return;
+  }
+
+  open_containers.push_back(list);
+  out << '[';
+  for (size_t i = 0; i < list->elements.size(); i++) {
+    if (i > 0) {
+      out << ", ";
+    }
+    print_value(list->elements[i], out);
+  }
+  out << ']';
+  open_containers.pop_back();
+}
+
+void print_map(const ObjMap* map, std::ostream& out) {
+  if (is_open(map)) {
+    out << "{...}";
+    return;
+  }
+
+  open_containers.push_back(map);
+  out << '{';
+  bool first = true;
+  for (uint32_t i = 0; i < map->entries.get_capacity(); i++) {
+    const ValueEntry& entry = map->entries.get_entries()[i];
+    if (IS_NIL(entry.key)) {
+      continue;
+    }
+    if (!first) {
+      out << ", ";
+    }
+    first = false;
+    print_value(entry.key, out);
+    out << ": ";
+    print_value(entry.value, out);
+  }
+  out << '}';
+  open_containers.pop_back();
+}
+
+void print_float64_array(const ObjFloat64Array* array, std::ostream& out) {
+  out << "float64Array[";
+  for (size_t i = 0; i < array->values.size(); i++) {
+    if (i > 0) {
+      out << ", ";
+    }
+    print_value(NUMBER_VAL(array->values[i]), out);
+  }
+  out << ']';
+}
+
+void print_object(Value value, std::ostream& out) {
   switch (OBJ_TYPE(value)) {
     case OBJ_BOUND_METHOD:
-      print_function(AS_BOUND_METHOD(value)->method->function);
+      print_function(AS_BOUND_METHOD(value)->method->function, out);
+      break;
+    case OBJ_CHANNEL:
+      out << "<channel>";
       break;
     case OBJ_CLASS:
-      std::cout << AS_CLASS(value)->name->string;
+      out << AS_CLASS(value)->name->string;
       break;
     case OBJ_CLOSURE:
-      print_function(AS_CLOSURE(value)->function);
+      print_function(AS_CLOSURE(value)->function, out);
+      break;
+    case OBJ_FIBER:
+      out << "<fiber>";
+      break;
+    case OBJ_FLOAT64_ARRAY:
+      print_float64_array(AS_FLOAT64_ARRAY(value), out);
       break;
     case OBJ_FUNCTION:
-      print_function(AS_FUNCTION(value));
+      print_function(AS_FUNCTION(value), out);
       break;
     case OBJ_INSTANCE:
-      std::cout << AS_INSTANCE(value)->class_->name->string << " instance";
+      out << AS_INSTANCE(value)->class_->name->string << " instance";
+      break;
+    case OBJ_LIST:
+      print_list(AS_LIST(value), out);
+      break;
+    case OBJ_MAP:
+      print_map(AS_MAP(value), out);
       break;
     case OBJ_NATIVE:
-      std::cout << "<native fn>";
+      out << "<native fn>";
       break;
     case OBJ_STRING:
-      std::cout << AS_STRING(value)->string;
+      out << AS_STRING(value)->string;
       break;
     case OBJ_UPVALUE:
-      std::cout << "upvalue";
+      out << "upvalue";
       break;
     default:
       break;
@@ -47,71 +126,43 @@ void print_object(Value value) {
 }
 }  // namespace
 
-void print_value(Value value) {
+void print_value(Value value, std::ostream& out) {
 #ifdef NAN_BOXING
   if (IS_BOOL(value)) {
-    std::cout << (AS_BOOL(value) ? "true" : "false");
+    out << (AS_BOOL(value) ? "true" : "false");
   } else if (IS_NIL(value)) {
-    std::cout << "nil";
+    out << "nil";
+  } else if (IS_INT(value)) {
+    out << AS_INT(value);
   } else if (IS_NUMBER(value)) {
     std::string number = std::to_string(AS_NUMBER(value));
     number.erase(number.find_last_not_of('0') + 1, std::string::npos);
     number.erase(number.find_last_not_of('.') + 1, std::string::npos);
-    std::cout << number;
+    out << number;
   } else if (IS_OBJ(value)) {
-    print_object(value);
+    print_object(value, out);
   }
 #else
   switch (value.type) {
     case VAL_BOOL:
-      std::cout << (AS_BOOL(value) ? "true" : "false");
+      out << (AS_BOOL(value) ? "true" : "false");
       break;
     case VAL_NIL:
-      std::cout << "nil";
+      out << "nil";
       break;
     case VAL_NUMBER: {
       std::string number = std::to_string(AS_NUMBER(value));
       number.erase(number.find_last_not_of('0') + 1, std::string::npos);
       number.erase(number.find_last_not_of('.') + 1, std::string::npos);
-      std::cout << number;
+      out << number;
       break;
     }
     case VAL_OBJ:
-      print_object(value);
+      print_object(value, out);
       break;
     default:
       break;
   }
 #endif
 }
-
-bool values_equal(Value left, Value right) {
-#ifdef NAN_BOXING
-  if (IS_NUMBER(left) && IS_NUMBER(right)) {
-    return std::abs(AS_NUMBER(left) - AS_NUMBER(right)) <=
-           std::max(std::abs(AS_NUMBER(left)), std::abs(AS_NUMBER(right))) *
-               std::numeric_limits<double>::epsilon();
-  }
-  return left == right;
-#else
-  if (left.type != right.type) {
-    return false;
-  }
-
-  switch (left.type) {
-    case VAL_BOOL:
-      return AS_BOOL(left) == AS_BOOL(right);
-    case VAL_NIL:
-      return true;
-    case VAL_NUMBER:
-      return std::abs(AS_NUMBER(left) - AS_NUMBER(right)) <=
-             std::max(std::abs(AS_NUMBER(left)), std::abs(AS_NUMBER(right))) *
-                 std::numeric_limits<double>::epsilon();
-    case VAL_OBJ:
-      return AS_OBJ(left) == AS_OBJ(right);
-    default:
-      return false;
-  }
-#endif
-}
 }  // namespace lox::bytecode
@@ -1,10 +1,14 @@
 #include "vm.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+
+#include "simd.hpp"
 
 namespace lox::bytecode {
 namespace {
-Value clock_native(int /*arg_count*/, Value* /*args*/) {
+Value clock_native(VM& /*vm*/, int /*arg_count*/, Value* /*args*/) {
   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::system_clock::now().time_since_epoch())
                 .count();
@@ -12,25 +16,574 @@ Value clock_native(int /*arg_count*/, Value* /*args*/) {
   constexpr double ms_to_seconds = 1.0 / 1000;
   return NUMBER_VAL(static_cast<double>(ms) * ms_to_seconds);
 }
+
+Value gc_stat_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_STRING(args[0])) {
+    return NIL_VAL;
+  }
+
+  const std::optional<double> stat = vm.gc_stat(AS_STRING(args[0])->string);
+  return stat ? number_or_int_to_value(*stat) : NIL_VAL;
+}
+
+Value channel_native(VM& vm, int arg_count, Value* args) {
+  constexpr int32_t default_capacity = 64;
+  const int32_t capacity = arg_count > 0 && IS_INT(args[0])
+                               ? AS_INT(args[0])
+                               : default_capacity;
+  if (arg_count > 1 || (arg_count == 1 && !IS_INT(args[0])) ||
+      capacity < 1 || static_cast<size_t>(capacity) > Channel::MAX_CAPACITY) {
+    return vm.native_error("Channel capacity must be an integer from 1 to " +
+                           std::to_string(Channel::MAX_CAPACITY) + ".");
+  }
+  return OBJ_VAL(vm.allocate_object<ObjChannel>(
+      std::make_shared<Channel>(static_cast<size_t>(capacity))));
+}
+
+Value spawn_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_CLOSURE(args[0]) ||
+      AS_CLOSURE(args[0])->function->arity != 0) {
+    return vm.native_error("Can only spawn functions without parameters.");
+  }
+  vm.spawn(AS_CLOSURE(args[0]));
+  return NIL_VAL;
+}
+
+Value send_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_CHANNEL(args[0])) {
+    return vm.native_error("Can only send a value to a channel.");
+  }
+  AS_CHANNEL(args[0])->send(vm.pack(args[1]));
+  return NIL_VAL;
+}
+
+Value recv_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_CHANNEL(args[0])) {
+    return vm.native_error("Can only receive from a channel.");
+  }
+  return vm.unpack(AS_CHANNEL(args[0])->receive());
+}
+
+Value fiber_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_CLOSURE(args[0]) ||
+      AS_CLOSURE(args[0])->function->arity > 1) {
+    return vm.native_error(
+        "A fiber needs a function with at most one parameter.");
+  }
+  return OBJ_VAL(vm.allocate_object<ObjFiber>(AS_CLOSURE(args[0])));
+}
+
+Value resume_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count < 1 || arg_count > 2 || !IS_FIBER(args[0])) {
+    return vm.native_error("Can only resume a fiber.");
+  }
+  ObjFiber* fiber = AS_FIBER(args[0]);
+  if (fiber->state == FIBER_RUNNING) {
+    return vm.native_error("Cannot resume a running fiber.");
+  }
+  if (fiber->state == FIBER_DONE) {
+    return vm.native_error("Cannot resume a finished fiber.");
+  }
+  vm.switch_fiber(fiber);
+  return arg_count == 2 ? args[1] : NIL_VAL;
+}
+
+Value yield_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count > 1) {
+    return vm.native_error("Can only yield one value.");
+  }
+  if (!vm.in_fiber()) {
+    return vm.native_error("Can only yield from inside a fiber.");
+  }
+  vm.switch_fiber(nullptr);
+  return arg_count == 1 ? args[0] : NIL_VAL;
+}
+
+Value is_done_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_FIBER(args[0])) {
+    return vm.native_error("Can only check whether a fiber is done.");
+  }
+  return BOOL_VAL(AS_FIBER(args[0])->state == FIBER_DONE);
+}
+
+// Indexes are integers, though arithmetic may have left them as doubles.
+std::optional<size_t> list_index(Value index, size_t size) {
+  if (IS_INT(index)) {
+    const int32_t integer = AS_INT(index);
+    if (integer >= 0 && static_cast<size_t>(integer) < size) {
+      return static_cast<size_t>(integer);
+    }
+    return std::nullopt;
+  }
+  if (IS_NUMBER(index)) {
+    const double number = AS_NUMBER(index);
+    if (number >= 0 && number < static_cast<double>(size) &&
+        std::trunc(number) == number) {
+      return static_cast<size_t>(number);
+    }
+  }
+  return std::nullopt;
+}
+
+Value push_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_LIST(args[0])) {
+    return vm.native_error("Can only push a value onto a list.");
+  }
+  AS_LIST(args[0])->elements.push_back(args[1]);
+  vm.track_storage(AS_LIST(args[0]));
+  return NIL_VAL;
+}
+
+Value pop_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_LIST(args[0])) {
+    return vm.native_error("Can only pop from a list.");
+  }
+  std::vector<Value>& elements = AS_LIST(args[0])->elements;
+  if (elements.empty()) {
+    return vm.native_error("Cannot pop from an empty list.");
+  }
+  const Value element = elements.back();
+  elements.pop_back();
+  return element;
+}
+
+Value len_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count == 1 && IS_LIST(args[0])) {
+    return integer_to_value(
+        static_cast<int64_t>(AS_LIST(args[0])->elements.size()));
+  }
+  if (arg_count == 1 && IS_MAP(args[0])) {
+    return integer_to_value(AS_MAP(args[0])->entries.count());
+  }
+  if (arg_count == 1 && IS_FLOAT64_ARRAY(args[0])) {
+    return integer_to_value(
+        static_cast<int64_t>(AS_FLOAT64_ARRAY(args[0])->values.size()));
+  }
+  if (arg_count == 1 && IS_STRING(args[0])) {
+    return integer_to_value(
+        static_cast<int64_t>(AS_STRING(args[0])->string.size()));
+  }
+  return vm.native_error(
+      "Can only take the length of a list, array, map or string.");
+}
+
+// Copies the elements from start up to end, which defaults to the length.
+Value slice_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count < 2 || arg_count > 3 || !IS_LIST(args[0])) {
+    return vm.native_error("Can only slice a list.");
+  }
+  const size_t size = AS_LIST(args[0])->elements.size();
+  // Bounds may equal the length, one past the last index.
+  const std::optional<size_t> start = list_index(args[1], size + 1);
+  const std::optional<size_t> end =
+      arg_count == 3 ? list_index(args[2], size + 1) : size;
+  if (!start || !end || *start > *end) {
+    return vm.native_error("Slice bounds out of range.");
+  }
+
+  const std::vector<Value>& elements = AS_LIST(args[0])->elements;
+  return OBJ_VAL(vm.allocate_list(
+      {elements.begin() + static_cast<ptrdiff_t>(*start),
+       elements.begin() + static_cast<ptrdiff_t>(*end)}));
+}
+
+Value map_native(VM& vm, int arg_count, Value* /*args*/) {
+  if (arg_count != 0) {
+    return vm.native_error("map takes no arguments.");
+  }
+  return OBJ_VAL(vm.allocate_map());
+}
+
+Value has_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_MAP(args[0])) {
+    return vm.native_error("Can only look for a key in a map.");
+  }
+  Value value{NIL_VAL};
+  return BOOL_VAL(AS_MAP(args[0])->entries.get(args[1], &value));
+}
+
+// Returns whether the key was there.
+Value delete_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_MAP(args[0])) {
+    return vm.native_error("Can only delete a key from a map.");
+  }
+  return BOOL_VAL(AS_MAP(args[0])->entries.del(args[1]));
+}
+
+// A list of the keys as they are now, so the map can change while a loop
+// walks it.
+Value keys_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_MAP(args[0])) {
+    return vm.native_error("Can only list the keys of a map.");
+  }
+  const ValueTable& entries = AS_MAP(args[0])->entries;
+  std::vector<Value> keys;
+  keys.reserve(entries.count());
+  for (uint32_t i = 0; i < entries.get_capacity(); i++) {
+    const ValueEntry& entry = entries.get_entries()[i];
+    if (!IS_NIL(entry.key)) {
+      keys.push_back(entry.key);
+    }
+  }
+  return OBJ_VAL(vm.allocate_list(std::move(keys)));
+}
+
+// Snapshots record lengths in 32 bits.
+constexpr size_t MAX_ARRAY_LENGTH = UINT32_MAX;
+
+// Takes a length, giving an array of zeros, or a list of numbers to copy.
+Value float64_array_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count == 1 && IS_LIST(args[0])) {
+    const std::vector<Value>& elements = AS_LIST(args[0])->elements;
+    if (!std::all_of(elements.begin(), elements.end(),
+                     [](Value element) { return IS_NUMBER(element); })) {
+      return vm.native_error("Float64 array elements must be numbers.");
+    }
+    auto* array = vm.allocate_float64_array(elements.size());
+    std::transform(elements.begin(), elements.end(), array->values.begin(),
+                   [](Value element) { return AS_NUMBER(element); });
+    return OBJ_VAL(array);
+  }
+
+  const std::optional<size_t> length =
+      arg_count == 1 ? list_index(args[0], MAX_ARRAY_LENGTH + 1)
+                     : std::nullopt;
+  if (!length) {
+    return vm.native_error(
+        "float64Array needs a length or a list of numbers.");
+  }
+  return OBJ_VAL(vm.allocate_float64_array(*length));
+}
+
+using ElementwiseKernel = void (*)(const double* a, const double* b,
+                                   double* out, size_t count);
+
+// Runs the kernel over two arrays of the same length into a new one.
+Value elementwise(VM& vm, int arg_count, Value* args,
+                  ElementwiseKernel kernel, const std::string& type_error) {
+  if (arg_count != 2 || !IS_FLOAT64_ARRAY(args[0]) ||
+      !IS_FLOAT64_ARRAY(args[1])) {
+    return vm.native_error(type_error);
+  }
+  const std::vector<double>& a = AS_FLOAT64_ARRAY(args[0])->values;
+  const std::vector<double>& b = AS_FLOAT64_ARRAY(args[1])->values;
+  if (a.size() != b.size()) {
+    return vm.native_error("Float64 arrays must have the same length.");
+  }
+  auto* result = vm.allocate_float64_array(a.size());
+  kernel(a.data(), b.data(), result->values.data(), a.size());
+  return OBJ_VAL(result);
+}
+
+Value add_native(VM& vm, int arg_count, Value* args) {
+  return elementwise(vm, arg_count, args, simd_kernels().add,
+                     "Can only add two float64 arrays.");
+}
+
+Value multiply_native(VM& vm, int arg_count, Value* args) {
+  return elementwise(vm, arg_count, args, simd_kernels().multiply,
+                     "Can only multiply two float64 arrays.");
+}
+
+Value scale_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_FLOAT64_ARRAY(args[0]) || !IS_NUMBER(args[1])) {
+    return vm.native_error("Can only scale a float64 array by a number.");
+  }
+  const std::vector<double>& values = AS_FLOAT64_ARRAY(args[0])->values;
+  auto* result = vm.allocate_float64_array(values.size());
+  simd_kernels().scale(values.data(), AS_NUMBER(args[1]),
+                       result->values.data(), values.size());
+  return OBJ_VAL(result);
+}
+
+Value dot_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_FLOAT64_ARRAY(args[0]) ||
+      !IS_FLOAT64_ARRAY(args[1])) {
+    return vm.native_error(
+        "Can only take the dot product of two float64 arrays.");
+  }
+  const std::vector<double>& a = AS_FLOAT64_ARRAY(args[0])->values;
+  const std::vector<double>& b = AS_FLOAT64_ARRAY(args[1])->values;
+  if (a.size() != b.size()) {
+    return vm.native_error("Float64 arrays must have the same length.");
+  }
+  return NUMBER_VAL(simd_kernels().dot(a.data(), b.data(), a.size()));
+}
+
+Value sum_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_FLOAT64_ARRAY(args[0])) {
+    return vm.native_error("Can only sum a float64 array.");
+  }
+  const std::vector<double>& values = AS_FLOAT64_ARRAY(args[0])->values;
+  return NUMBER_VAL(simd_kernels().sum(values.data(), values.size()));
+}
+
+using PickKernel = double (*)(const double* a, size_t count);
+
+Value pick(VM& vm, int arg_count, Value* args, PickKernel kernel,
+           const std::string& what) {
+  if (arg_count != 1 || !IS_FLOAT64_ARRAY(args[0])) {
+    return vm.native_error("Can only take the " + what +
+                           " of a float64 array.");
+  }
+  const std::vector<double>& values = AS_FLOAT64_ARRAY(args[0])->values;
+  if (values.empty()) {
+    return vm.native_error("Cannot take the " + what +
+                           " of an empty array.");
+  }
+  return NUMBER_VAL(kernel(values.data(), values.size()));
+}
+
+Value min_native(VM& vm, int arg_count, Value* args) {
+  return pick(vm, arg_count, args, simd_kernels().min, "minimum");
+}
+
+Value max_native(VM& vm, int arg_count, Value* args) {
+  return pick(vm, arg_count, args, simd_kernels().max, "maximum");
+}
+
+// Each element of the result is the sum of the elements up to and
+// including it.
+Value prefix_sum_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 1 || !IS_FLOAT64_ARRAY(args[0])) {
+    return vm.native_error("Can only take prefix sums of a float64 array.");
+  }
+  const std::vector<double>& values = AS_FLOAT64_ARRAY(args[0])->values;
+  auto* result = vm.allocate_float64_array(values.size());
+  simd_kernels().prefix_sum(values.data(), result->values.data(),
+                            values.size());
+  return OBJ_VAL(result);
+}
+
+// Callbacks can be functions or bound methods; anything else has no arity.
+int callback_arity(Value callback) {
+  if (IS_CLOSURE(callback)) {
+    return AS_CLOSURE(callback)->function->arity;
+  }
+  if (IS_BOUND_METHOD(callback)) {
+    return AS_BOUND_METHOD(callback)->method->function->arity;
+  }
+  return -1;
+}
+
+Value read_file_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 2 || !IS_STRING(args[0]) || callback_arity(args[1]) != 2) {
+    return vm.native_error(
+        "readFile needs a path and a function taking data and an error.");
+  }
+  vm.add_callback(vm.event_loop().read(AS_STRING(args[0])->string), args[1],
+                  2);
+  return NIL_VAL;
+}
+
+Value write_file_native(VM& vm, int arg_count, Value* args) {
+  if (arg_count != 3 || !IS_STRING(args[0]) || !IS_STRING(args[1]) ||
+      callback_arity(args[2]) != 1) {
+    return vm.native_error(
+        "writeFile needs a path, a string and a function taking an error.");
+  }
+  vm.add_callback(vm.event_loop().write(AS_STRING(args[0])->string,
+                                        AS_STRING(args[1])->string),
+                  args[2], 1);
+  return NIL_VAL;
+}
+
+Value timer_native(VM& vm, int arg_count, Value* args) {
+  // Written so that NaN fails the check too.
+  if (arg_count != 2 || !IS_NUMBER(args[0]) || !(AS_NUMBER(args[0]) >= 0) ||
+      callback_arity(args[1]) != 0) {
+    return vm.native_error(
+        "timer needs a delay in milliseconds and a function without "
+        "parameters.");
+  }
+  vm.add_callback(vm.event_loop().timer(AS_NUMBER(args[0])), args[1], 0);
+  return NIL_VAL;
+}
+
+Value multiply_integers(int64_t a, int64_t b) {
+  if ((a == 0 && b < 0) || (b == 0 && a < 0)) {
+    return NUMBER_VAL(-0.0);
+  }
+  return integer_to_value(a * b);
+}
+
+Value divide_integers(int64_t a, int64_t b) {
+  if (b == 0 || a % b != 0 || (a == 0 && b < 0)) {
+    return NUMBER_VAL(static_cast<double>(a) / static_cast<double>(b));
+  }
+  return integer_to_value(a / b);
+}
 }  // namespace
 
 VM::VM() {
   reset_stack();
   define_native("clock", clock_native);
+  define_native("gcStat", gc_stat_native);
+  define_native("channel", channel_native);
+  define_native("spawn", spawn_native);
+  define_native("send", send_native);
+  define_native("recv", recv_native);
+  define_native("fiber", fiber_native);
+  define_native("resume", resume_native);
+  define_native("yield", yield_native);
+  define_native("isDone", is_done_native);
+  define_native("readFile", read_file_native);
+  define_native("writeFile", write_file_native);
+  define_native("timer", timer_native);
+  define_native("push", push_native);
+  define_native("pop", pop_native);
+  define_native("len", len_native);
+  define_native("slice", slice_native);
+  define_native("map", map_native);
+  define_native("has", has_native);
+  define_native("delete", delete_native);
+  define_native("keys", keys_native);
+  define_native("float64Array", float64_array_native);
+  define_native("add", add_native);
+  define_native("multiply", multiply_native);
+  define_native("scale", scale_native);
+  define_native("dot", dot_native);
+  define_native("sum", sum_native);
+  define_native("min", min_native);
+  define_native("max", max_native);
+  define_native("prefixSum", prefix_sum_native);
   init_string_ = allocate_object<ObjString>("init");
 }
 
 InterpretResult VM::interpret(ObjFunction* function) {
-  push(OBJ_VAL(function));
-  auto* closure = allocate_object<ObjClosure>(function);
-  pop();
-  push(OBJ_VAL(closure));
-  call(closure, 0);
+  InterpretResult result{};
+  try {
+    push(OBJ_VAL(function));
+    auto* closure = allocate_object<ObjClosure>(function);
+    pop();
+    push(OBJ_VAL(closure));
+    call(closure, 0);
+
+    result = run();
+    if (result == INTERPRET_OK) {
+      result = run_events();
+    }
+  } catch (const HeapLimitError& error) {
+    runtime_error(error.what());
+    result = INTERPRET_RUNTIME_ERROR;
+  }
+  if (result != INTERPRET_OK) {
+    event_loop_.reset();
+    io_callbacks_.clear();
+  }
+  if (opcode_profiler_ != nullptr) {
+    opcode_profiler_->stop();
+  }
+  if (!join_isolates() && result == INTERPRET_OK) {
+    result = INTERPRET_RUNTIME_ERROR;
+  }
+  return result;
+}
+
+void VM::spawn(ObjClosure* closure) {
+  Message message;
+  std::ostringstream bytes;
+  write_heap(bytes, globals_, OBJ_VAL(closure), &message.channels);
+  message.bytes = bytes.str();
+
+  auto isolate = std::make_unique<Isolate>();
+  isolate->thread = std::thread{
+      [message = std::move(message), gc = gc_heuristics_.config(),
+       &out = isolate->out, &err = isolate->err,
+       &result = isolate->result] {
+        try {
+          const auto vm = std::make_unique<VM>();
+          vm->set_output(out, err);
+          vm->configure_gc(gc);
+          result = vm->run_isolate(message);
+        } catch (const std::exception& error) {
+          err << error.what() << '\n';
+          result = INTERPRET_RUNTIME_ERROR;
+        }
+      }};
+  isolates_.push_back(std::move(isolate));
+}
+
+InterpretResult VM::run_isolate(const Message& message) {
+  InterpretResult result{};
+  try {
+    Table globals;
+    Value callee{NIL_VAL};
+    if (!read_heap(message.bytes, globals, callee, message.channels)) {
+      return INTERPRET_RUNTIME_ERROR;
+    }
+    globals.add_all(globals_);
+    push(callee);
+    call(AS_CLOSURE(callee), 0);
+    result = run();
+    if (result == INTERPRET_OK) {
+      result = run_events();
+    }
+  } catch (const HeapLimitError& error) {
+    runtime_error(error.what());
+    result = INTERPRET_RUNTIME_ERROR;
+  }
+  if (!join_isolates() && result == INTERPRET_OK) {
+    result = INTERPRET_RUNTIME_ERROR;
+  }
+  return result;
+}
+
+// Runs each callback to completion as its operation finishes, until none
+// are left. A callback may start more operations or resume a fiber that
+// is waiting for the result.
+InterpretResult VM::run_events() {
+  while (event_loop_ != nullptr && event_loop_->pending()) {
+    EventLoop::Completion completion = event_loop_->wait();
+    const auto found = io_callbacks_.find(completion.id);
+    const IoCallback callback = found->second;
+    io_callbacks_.erase(found);
+
+    push(callback.function);
+    Value data{NIL_VAL};
+    Value error{NIL_VAL};
+    if (!completion.ok) {
+      error = OBJ_VAL(allocate_object<ObjString>(completion.data));
+    } else if (callback.arg_count == 2) {
+      data = OBJ_VAL(allocate_object<ObjString>(completion.data));
+    }
+    if (callback.arg_count == 2) {
+      push(data);
+    }
+    if (callback.arg_count >= 1) {
+      push(error);
+    }
+
+    if (!call_value(callback.function, callback.arg_count)) {
+      return INTERPRET_RUNTIME_ERROR;
+    }
+    const InterpretResult result = run();
+    if (result != INTERPRET_OK) {
+      return result;
+    }
+    // The callback's arguments stay behind when the outermost frame
+    // returns.
+    stack_top_ = stack_.data();
+  }
+  return INTERPRET_OK;
+}
 
-  return run();
+// Isolates buffer their output, which keeps it whole and in a stable order
+// however their threads interleave.
+bool VM::join_isolates() {
+  bool ok = true;
+  for (const std::unique_ptr<Isolate>& isolate : isolates_) {
+    isolate->thread.join();
+    *out_ << isolate->out.str();
+    *err_ << isolate->err.str();
+    ok = ok && isolate->result == INTERPRET_OK;
+  }
+  isolates_.clear();
+  return ok;
 }
 
 void VM::define_native(std::string_view name, NativeFn function) {
+  natives_.push_back(function);
   push(OBJ_VAL(allocate_object<ObjString>(name)));
   push(OBJ_VAL(allocate_object<ObjNative>(function)));
   globals_.set(AS_STRING(stack_[0]), stack_[1]);
@@ -50,6 +603,14 @@ InterpretResult VM::run() {
     push(value_type(a op b));                         \
   } while (false)
 
+#define INT_BINARY_OP(value_type, op) \
+  if (ARE_INTS(peek(0), peek(1))) {   \
+    const int64_t b = AS_INT(pop());  \
+    const int64_t a = AS_INT(pop());  \
+    push(value_type(a op b));         \
+    break;                            \
+  }
+
   frame_top_ = &frames_[frame_count_ - 1];
 
   for (;;) {
@@ -67,6 +628,13 @@ InterpretResult VM::run() {
             frame_top_->closure->function->chunk.get_codes().data()));
 #endif
 
+    if (opcode_profiler_ != nullptr) {
+      opcode_profiler_->record(frame_top_->closure->function, frame_top_->ip);
+    }
+    if (sampling_profiler_ != nullptr && --sample_countdown_ == 0) {
+      take_sample();
+    }
+
     switch (read_byte()) {
       case OP_CONSTANT:
         push(read_constant());
@@ -128,6 +696,16 @@ InterpretResult VM::run() {
         *frame_top_->closure->upvalues[slot]->location = peek(0);
         break;
       }
+      case OP_GET_CALLER_LOCAL: {
+        const uint8_t slot = read_byte();
+        push((frame_top_ - 1)->slots[slot]);
+        break;
+      }
+      case OP_SET_CALLER_LOCAL: {
+        const uint8_t slot = read_byte();
+        (frame_top_ - 1)->slots[slot] = peek(0);
+        break;
+      }
       case OP_GET_PROPERTY: {
         if (!IS_INSTANCE(peek(0))) {
           runtime_error("Only instances have properties.");
@@ -178,12 +756,15 @@ InterpretResult VM::run() {
         break;
       }
       case OP_GREATER:
+        INT_BINARY_OP(BOOL_VAL, >);
         BINARY_OP(BOOL_VAL, >);
         break;
       case OP_LESS:
+        INT_BINARY_OP(BOOL_VAL, <);
         BINARY_OP(BOOL_VAL, <);
         break;
       case OP_ADD:
+        INT_BINARY_OP(integer_to_value, +);
         if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
           ObjString* b = AS_STRING(peek(0));
           ObjString* a = AS_STRING(peek(1));
@@ -201,18 +782,35 @@ InterpretResult VM::run() {
         }
         break;
       case OP_SUBTRACT:
+        INT_BINARY_OP(integer_to_value, -);
         BINARY_OP(NUMBER_VAL, -);
         break;
       case OP_MULTIPLY:
+        if (ARE_INTS(peek(0), peek(1))) {
+          const int64_t b = AS_INT(pop());
+          const int64_t a = AS_INT(pop());
+          push(multiply_integers(a, b));
+          break;
+        }
         BINARY_OP(NUMBER_VAL, *);
         break;
       case OP_DIVIDE:
+        if (ARE_INTS(peek(0), peek(1))) {
+          const int64_t b = AS_INT(pop());
+          const int64_t a = AS_INT(pop());
+          push(divide_integers(a, b));
+          break;
+        }
         BINARY_OP(NUMBER_VAL, /);
         break;
       case OP_NOT:
         push(BOOL_VAL(is_falsey(pop())));
         break;
       case OP_NEGATE:
+        if (IS_INT(peek(0)) && AS_INT(peek(0)) != 0) {
+          push(integer_to_value(-static_cast<int64_t>(AS_INT(pop()))));
+          break;
+        }
         if (!IS_NUMBER(peek(0))) {
           runtime_error("Operand must be a number.");
           return INTERPRET_RUNTIME_ERROR;
@@ -220,8 +818,8 @@ InterpretResult VM::run() {
         push(NUMBER_VAL(-AS_NUMBER(pop())));
         break;
       case OP_PRINT:
-        print_value(pop());
-        std::cout << '\n';
+        print_value(pop(), *out_);
+        *out_ << '\n';
         break;
       case OP_JUMP: {
         const uint16_t offset = read_short();
@@ -248,6 +846,21 @@ InterpretResult VM::run() {
         frame_top_ = &frames_[frame_count_ - 1];
         break;
       }
+      case OP_TAIL_CALL: {
+        const int arg_count = read_byte();
+        const Value callee = peek(arg_count);
+        if (IS_CLOSURE(callee)) {
+          if (!tail_call(AS_CLOSURE(callee), arg_count)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          break;
+        }
+        if (!call_value(callee, arg_count)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        frame_top_ = &frames_[frame_count_ - 1];
+        break;
+      }
       case OP_INVOKE: {
         ObjString* method = AS_STRING(read_constant());
         const int arg_count = read_byte();
@@ -289,9 +902,14 @@ InterpretResult VM::run() {
       case OP_RETURN: {
         const Value result = pop();
         close_upvalues(frame_top_->slots);
-        if (--frame_count_ == 0) {
-          pop();
-          return INTERPRET_OK;
+        if (--frame_count_ == fiber_frame_base_) {
+          if (fibers_.empty()) {
+            pop();
+            return INTERPRET_OK;
+          }
+          leave_fiber(result, FIBER_DONE);
+          frame_top_ = &frames_[frame_count_ - 1];
+          break;
         }
         stack_top_ = frame_top_->slots;
         push(result);
@@ -316,12 +934,112 @@ InterpretResult VM::run() {
       case OP_METHOD:
         define_method(AS_STRING(read_constant()));
         break;
+      case OP_BUILD_LIST: {
+        const uint8_t count = read_byte();
+        auto* list = allocate_list({stack_top_ - count, stack_top_});
+        stack_top_ -= count;
+        push(OBJ_VAL(list));
+        break;
+      }
+      case OP_GET_INDEX: {
+        if (IS_LIST(peek(1))) {
+          const std::vector<Value>& elements = AS_LIST(peek(1))->elements;
+          const std::optional<size_t> index =
+              list_index(peek(0), elements.size());
+          if (!index) {
+            runtime_error(IS_NUMBER(peek(0))
+                              ? "List index out of range."
+                              : "List index must be a number.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          const Value element = elements[*index];
+          pop();
+          pop();
+          push(element);
+          break;
+        }
+        if (IS_FLOAT64_ARRAY(peek(1))) {
+          const std::vector<double>& values =
+              AS_FLOAT64_ARRAY(peek(1))->values;
+          const std::optional<size_t> index =
+              list_index(peek(0), values.size());
+          if (!index) {
+            runtime_error(IS_NUMBER(peek(0))
+                              ? "Array index out of range."
+                              : "Array index must be a number.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          const double element = values[*index];
+          pop();
+          pop();
+          push(NUMBER_VAL(element));
+          break;
+        }
+        if (!IS_MAP(peek(1))) {
+          runtime_error("Can only index lists, arrays and maps.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        // A missing key reads as nil.
+        Value value{NIL_VAL};
+        AS_MAP(peek(1))->entries.get(peek(0), &value);
+        pop();
+        pop();
+        push(value);
+        break;
+      }
+      case OP_SET_INDEX: {
+        if (IS_LIST(peek(2))) {
+          std::vector<Value>& elements = AS_LIST(peek(2))->elements;
+          const std::optional<size_t> index =
+              list_index(peek(1), elements.size());
+          if (!index) {
+            runtime_error(IS_NUMBER(peek(1))
+                              ? "List index out of range."
+                              : "List index must be a number.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          elements[*index] = peek(0);
+        } else if (IS_FLOAT64_ARRAY(peek(2))) {
+          std::vector<double>& values = AS_FLOAT64_ARRAY(peek(2))->values;
+          const std::optional<size_t> index =
+              list_index(peek(1), values.size());
+          if (!index) {
+            runtime_error(IS_NUMBER(peek(1))
+                              ? "Array index out of range."
+                              : "Array index must be a number.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          if (!IS_NUMBER(peek(0))) {
+            runtime_error("Float64 array elements must be numbers.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          values[*index] = AS_NUMBER(peek(0));
+        } else if (IS_MAP(peek(2))) {
+          if (IS_NIL(peek(1))) {
+            runtime_error("Map keys cannot be nil.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          AS_MAP(peek(2))->entries.set(peek(1), peek(0));
+          track_storage(AS_MAP(peek(2)));
+        } else {
+          runtime_error("Can only index lists, arrays and maps.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        const Value value = pop();
+        pop();
+        pop();
+        push(value);
+        break;
+      }
       default:
         break;
     }
   }
 
 #undef BINARY_OP
+#undef INT_BINARY_OP
 }
 
 void VM::define_method(ObjString* name) {
@@ -398,8 +1116,21 @@ bool VM::call_value(Value callee, int arg_count) {
         return call(AS_CLOSURE(callee), arg_count);
       case OBJ_NATIVE: {
         NativeFn native = AS_NATIVE(callee);
-        const Value result = native(arg_count, stack_top_ - arg_count);
+        const Value result = native(*this, arg_count, stack_top_ - arg_count);
+        if (native_error_) {
+          runtime_error(*native_error_);
+          native_error_.reset();
+          return false;
+        }
         stack_top_ -= arg_count + 1;
+        if (fiber_switch_) {
+          fiber_switch_ = false;
+          if (resumed_fiber_ != nullptr) {
+            return enter_fiber(resumed_fiber_, result);
+          }
+          leave_fiber(result, FIBER_SUSPENDED);
+          return true;
+        }
         push(result);
         return true;
       }
@@ -430,40 +1161,158 @@ bool VM::call(ObjClosure* closure, int arg_count) {
   return true;
 }
 
+bool VM::tail_call(ObjClosure* closure, int arg_count) {
+  if (arg_count != closure->function->arity) {
+    runtime_error("Expected " + std::to_string(closure->function->arity) +
+                  " arguments but got " + std::to_string(arg_count) + ".");
+    return false;
+  }
+
+  close_upvalues(frame_top_->slots);
+  std::copy(stack_top_ - arg_count - 1, stack_top_, frame_top_->slots);
+  stack_top_ = frame_top_->slots + arg_count + 1;
+
+  frame_top_->closure = closure;
+  frame_top_->ip = closure->function->chunk.get_codes().data();
+  return true;
+}
+
+// A fiber starts or continues where the resume call's result would go.
+// The value becomes its function's argument or the result of the yield
+// that suspended it.
+bool VM::enter_fiber(ObjFiber* fiber, Value value) {
+  if (frame_count_ + fiber->frames.size() > FRAMES_MAX) {
+    runtime_error("Stack overflow.");
+    return false;
+  }
+
+  Value* base = stack_top_;
+  fibers_.push_back({fiber, base, frame_count_});
+  fiber_frame_base_ = frame_count_;
+  if (fiber->state == FIBER_NEW) {
+    fiber->state = FIBER_RUNNING;
+    push(OBJ_VAL(fiber->closure));
+    const int arity = fiber->closure->function->arity;
+    if (arity == 1) {
+      push(value);
+    }
+    return call(fiber->closure, arity);
+  }
+
+  fiber->state = FIBER_RUNNING;
+  std::copy(fiber->stack.begin(), fiber->stack.end(), base);
+  stack_top_ = base + fiber->stack.size();
+  for (const ObjFiber::Frame& frame : fiber->frames) {
+    frames_[frame_count_++] = {frame.closure, frame.ip, base + frame.slots};
+  }
+
+  // Its open upvalues are all above the resumer's, so they go in front.
+  if (fiber->open_upvalues != nullptr) {
+    ObjUpvalue* last = nullptr;
+    for (ObjUpvalue* upvalue = fiber->open_upvalues; upvalue != nullptr;
+         upvalue = upvalue->next_upvalue) {
+      upvalue->location = base + (upvalue->location - fiber->stack.data());
+      upvalue->fiber = nullptr;
+      open_upvalue_at(upvalue->location) = upvalue;
+      last = upvalue;
+    }
+    last->next_upvalue = open_upvalues_;
+    open_upvalues_ = fiber->open_upvalues;
+    fiber->open_upvalues = nullptr;
+  }
+
+  fiber->stack.clear();
+  fiber->frames.clear();
+  push(value);
+  return true;
+}
+
+// Returns to the resumer with the value as the result of its resume call.
+// A suspended fiber takes its part of the stack with it, and upvalues open
+// on that part follow it there.
+void VM::leave_fiber(Value value, FiberState state) {
+  const RunningFiber running = fibers_.back();
+  fibers_.pop_back();
+  fiber_frame_base_ = fibers_.empty() ? 0 : fibers_.back().frame_base;
+  ObjFiber* fiber = running.fiber;
+  fiber->state = state;
+
+  if (state == FIBER_SUSPENDED) {
+    fiber->stack.assign(running.base, stack_top_);
+    for (size_t i = running.frame_base; i < frame_count_; i++) {
+      const CallFrame& frame = frames_[i];
+      fiber->frames.push_back(
+          {frame.closure, frame.ip,
+           static_cast<size_t>(frame.slots - running.base)});
+    }
+
+    ObjUpvalue** saved = &fiber->open_upvalues;
+    while (open_upvalues_ != nullptr &&
+           open_upvalues_->location >= running.base) {
+      ObjUpvalue* upvalue = open_upvalues_;
+      open_upvalues_ = upvalue->next_upvalue;
+      open_upvalue_at(upvalue->location) = nullptr;
+      upvalue->location =
+          fiber->stack.data() + (upvalue->location - running.base);
+      upvalue->fiber = fiber;
+      *saved = upvalue;
+      saved = &upvalue->next_upvalue;
+    }
+    *saved = nullptr;
+  }
+
+  frame_count_ = running.frame_base;
+  stack_top_ = running.base;
+  push(value);
+}
+
 void VM::reset_stack() {
+  for (const RunningFiber& running : fibers_) {
+    running.fiber->state = FIBER_DONE;
+  }
+  fibers_.clear();
+  fiber_frame_base_ = 0;
   frame_count_ = 0;
   stack_.fill(NIL_VAL);
   stack_top_ = stack_.data();
   open_upvalues_ = nullptr;
+  open_upvalue_slots_.fill(nullptr);
 }
 
+// Open upvalues are also indexed by stack slot, so a capture that is
+// already open is found directly and a new one is linked in after scanning
+// only the slots above it, which belong to the current frame.
 ObjUpvalue* VM::capture_upvalue(Value* local) {
-  ObjUpvalue* prev_upvalue{};
-  ObjUpvalue* upvalue = open_upvalues_;
-  while (upvalue != nullptr && upvalue->location > local) {
-    prev_upvalue = upvalue;
-    upvalue = upvalue->next_upvalue;
+  ObjUpvalue*& slot = open_upvalue_at(local);
+  if (slot != nullptr) {
+    return slot;
   }
 
-  if (upvalue != nullptr && upvalue->location == local) {
-    return upvalue;
+  ObjUpvalue* prev_upvalue{};
+  for (const Value* above = local + 1; above < stack_top_; above++) {
+    prev_upvalue = open_upvalue_at(above);
+    if (prev_upvalue != nullptr) {
+      break;
+    }
   }
 
   auto* created_upvalue = allocate_object<ObjUpvalue>(local);
-  created_upvalue->next_upvalue = upvalue;
-
   if (prev_upvalue == nullptr) {
+    created_upvalue->next_upvalue = open_upvalues_;
     open_upvalues_ = created_upvalue;
   } else {
+    created_upvalue->next_upvalue = prev_upvalue->next_upvalue;
     prev_upvalue->next_upvalue = created_upvalue;
   }
 
+  slot = created_upvalue;
   return created_upvalue;
 }
 
 void VM::close_upvalues(const Value* last) {
   while (open_upvalues_ != nullptr && open_upvalues_->location >= last) {
     ObjUpvalue* upvalue = open_upvalues_;
+    open_upvalue_at(upvalue->location) = nullptr;
     upvalue->closed = *upvalue->location;
     upvalue->location = &upvalue->closed;
     open_upvalues_ = upvalue->next_upvalue;
@@ -471,37 +1320,116 @@ void VM::close_upvalues(const Value* last) {
 }
 
 void VM::runtime_error(const std::string& message) {
-  std::cerr << message << '\n';
+  *err_ << message << '\n';
 
   for (size_t i = frame_count_; i-- > 0;) {
     CallFrame* frame = &frames_[i];
     ObjFunction* function = frame->closure->function;
     const auto instruction =
         static_cast<size_t>(frame->ip - function->chunk.get_codes().data() - 1);
-    std::cerr << "[line " << function->chunk.get_lines()[instruction]
+    *err_ << "[line " << function->chunk.get_lines()[instruction]
               << "] in ";
     if (function->name == nullptr) {
-      std::cerr << "script\n";
+      *err_ << "script\n";
     } else {
-      std::cerr << function->name->string << "()\n";
+      *err_ << function->name->string << "()\n";
     }
   }
 
   reset_stack();
 }
 
+void VM::take_sample() {
+  for (const CallFrame* frame = frames_.data(); frame <= frame_top_; frame++) {
+    const ObjFunction* function = frame->closure->function;
+    // Callers have already advanced past their OP_CALL operands.
+    const auto instruction = static_cast<size_t>(
+        frame->ip - function->chunk.get_codes().data() -
+        (frame == frame_top_ ? 0 : 1));
+    sampling_profiler_->push_frame(function, instruction);
+  }
+  sampling_profiler_->commit_sample();
+
+  sample_countdown_ = sampling_profiler_->interval();
+}
+
+ObjFloat64Array* VM::allocate_float64_array(size_t length) {
+  const size_t bytes = length * sizeof(double);
+  reserve_heap(bytes);
+  auto* array = allocate_object<ObjFloat64Array>(length);
+  bytes_allocated_ += bytes;
+  return array;
+}
+
+ObjList* VM::allocate_list(std::vector<Value> elements) {
+  const size_t bytes = elements.capacity() * sizeof(Value);
+  reserve_heap(bytes);
+  auto* list = allocate_object<ObjList>();
+  list->elements = std::move(elements);
+  list->charged = bytes;
+  bytes_allocated_ += bytes;
+  return list;
+}
+
+ObjMap* VM::allocate_map() {
+  const size_t bytes = ValueTable::INITIAL_CAPACITY * sizeof(ValueEntry);
+  reserve_heap(bytes);
+  auto* map = allocate_object<ObjMap>();
+  map->charged = bytes;
+  bytes_allocated_ += bytes;
+  return map;
+}
+
+void VM::track_storage(ObjList* list) {
+  charge(list->charged, list->elements.capacity() * sizeof(Value));
+}
+
+void VM::track_storage(ObjMap* map) {
+  charge(map->charged, map->entries.get_capacity() * sizeof(ValueEntry));
+}
+
+// Moves the object's charge to bytes. Growth is reserved first, so it can
+// collect or throw HeapLimitError.
+void VM::charge(size_t& charged, size_t bytes) {
+  if (bytes > charged) {
+    reserve_heap(bytes - charged);
+  }
+  bytes_allocated_ = bytes_allocated_ - charged + bytes;
+  charged = bytes;
+}
+
+void VM::reserve_heap(size_t bytes) {
+#ifdef DEBUG_STRESS_GC
+  collect_garbage();
+#endif
+
+  if (bytes_allocated_ + bytes > next_gc_) {
+    collect_garbage();
+  }
+  if (bytes_allocated_ + bytes > gc_heuristics_.heap_limit()) {
+    collect_garbage();
+    if (bytes_allocated_ + bytes > gc_heuristics_.heap_limit()) {
+      throw HeapLimitError{};
+    }
+  }
+}
+
 void VM::collect_garbage() {
 #ifdef DEBUG_LOG_GC
   std::cout << "-- gc begin\n";
   const size_t before = bytes_allocated_;
 #endif
+  gc_stats_.begin_collection(bytes_allocated_);
 
   mark_roots();
   trace_references();
   strings_.remove_white();
   sweep();
 
-  next_gc_ = bytes_allocated_ * GC_HEAP_GROW_FACTOR;
+  gc_stats_.end_collection(bytes_allocated_);
+  next_gc_ = gc_heuristics_.next_threshold(bytes_allocated_,
+                                           gc_stats_.last_gc_fraction());
+  gc_stats_.record_next_gc(next_gc_);
 
 #ifdef DEBUG_LOG_GC
   std::cout << "-- gc end\n";
@@ -522,6 +1450,7 @@ void VM::free_objects() {
     delete object;
     object = next;
   }
+  objects_ = nullptr;
 }
 
 void VM::mark_object(Obj* object) {
@@ -599,9 +1528,40 @@ void VM::blacken_object(Obj* object) {
       mark_table(instance->fields);
       break;
     }
-    case OBJ_UPVALUE:
-      mark_value(static_cast<ObjUpvalue*>(object)->closed);
+    case OBJ_FIBER: {
+      auto* fiber = static_cast<ObjFiber*>(object);
+      mark_object(fiber->closure);
+      for (const Value value : fiber->stack) {
+        mark_value(value);
+      }
+      for (const ObjFiber::Frame& frame : fiber->frames) {
+        mark_object(frame.closure);
+      }
+      for (ObjUpvalue* upvalue = fiber->open_upvalues; upvalue != nullptr;
+           upvalue = upvalue->next_upvalue) {
+        mark_object(upvalue);
+      }
+      break;
+    }
+    case OBJ_LIST:
+      for (const Value element : static_cast<ObjList*>(object)->elements) {
+        mark_value(element);
+      }
+      break;
+    case OBJ_MAP: {
+      const ValueTable& entries = static_cast<ObjMap*>(object)->entries;
+      for (uint32_t i = 0; i < entries.get_capacity(); i++) {
+        mark_value(entries.get_entries()[i].key);
+        mark_value(entries.get_entries()[i].value);
+      }
+      break;
+    }
+    case OBJ_UPVALUE: {
+      auto* upvalue = static_cast<ObjUpvalue*>(object);
+      mark_value(upvalue->closed);
+      mark_object(upvalue->fiber);
       break;
+    }
     default:
       break;
   }
@@ -613,8 +1573,14 @@ void VM::mark_roots() {
   }
 
   mark_table(globals_);
-  if (g_current_compiler != nullptr) {
-    g_current_compiler->mark_compiler_roots();
+  if (compiler_ != nullptr) {
+    compiler_->mark_compiler_roots();
+  }
+  for (Obj* object : roots_) {
+    mark_object(object);
+  }
+  for (Obj* object : restored_objects_) {
+    mark_object(object);
   }
   mark_object(init_string_);
 
@@ -626,6 +1592,14 @@ void VM::mark_roots() {
        upvalue = upvalue->next_upvalue) {
     mark_object(static_cast<Obj*>(upvalue));
   }
+
+  for (const RunningFiber& running : fibers_) {
+    mark_object(running.fiber);
+  }
+
+  for (const auto& [id, callback] : io_callbacks_) {
+    mark_value(callback.function);
+  }
 }
 
 void VM::trace_references() {
@@ -653,32 +1627,53 @@ void VM::sweep() {
         objects_ = object;
       }
 
+      size_t size = 0;
       switch (unreached->type) {
         case OBJ_BOUND_METHOD:
-          bytes_allocated_ -= sizeof(ObjBoundMethod);
+          size = sizeof(ObjBoundMethod);
+          break;
+        case OBJ_CHANNEL:
+          size = sizeof(ObjChannel);
           break;
         case OBJ_CLASS:
-          bytes_allocated_ -= sizeof(ObjClass);
+          size = sizeof(ObjClass);
           break;
         case OBJ_CLOSURE:
-          bytes_allocated_ -= sizeof(ObjClosure);
+          size = sizeof(ObjClosure);
+          break;
+        case OBJ_FIBER:
+          size = sizeof(ObjFiber);
+          break;
+        case OBJ_FLOAT64_ARRAY:
+          size = sizeof(ObjFloat64Array) +
+                 static_cast<ObjFloat64Array*>(unreached)->values.size() *
+                     sizeof(double);
           break;
         case OBJ_FUNCTION:
-          bytes_allocated_ -= sizeof(ObjFunction);
+          size = sizeof(ObjFunction);
           break;
         case OBJ_INSTANCE:
-          bytes_allocated_ -= sizeof(ObjInstance);
+          size = sizeof(ObjInstance);
+          break;
+        case OBJ_LIST:
+          size = sizeof(ObjList) + static_cast<ObjList*>(unreached)->charged;
+          break;
+        case OBJ_MAP:
+          size = sizeof(ObjMap) + static_cast<ObjMap*>(unreached)->charged;
           break;
         case OBJ_NATIVE:
-          bytes_allocated_ -= sizeof(ObjNative);
+          size = sizeof(ObjNative);
           break;
         case OBJ_STRING:
-          bytes_allocated_ -= sizeof(ObjString);
+          size = sizeof(ObjString) +
+                 static_cast<ObjString*>(unreached)->string.size();
           break;
         case OBJ_UPVALUE:
-          bytes_allocated_ -= sizeof(ObjUpvalue);
+          size = sizeof(ObjUpvalue);
           break;
       }
+      bytes_allocated_ -= size;
+      gc_stats_.record_free(unreached->type, size);
 
 #ifdef DEBUG_LOG_GC
       std::cout << static_cast<void*>(unreached) << " free type "
@@ -0,0 +1,120 @@
+#include "gc_config.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <utility>
+
+namespace lox {
+namespace {
+constexpr double MIN_GROW_FACTOR = 1.25;
+constexpr double MAX_GROW_FACTOR = 16;
+
+bool parse_number(std::string_view text, double& number) {
+  const std::string string{text};
+  char* end{};
+  number = std::strtod(string.c_str(), &end);
+  return !string.empty() && *end == '\0' && std::isfinite(number) &&
+         number >= 0;
+}
+
+bool parse_size(std::string_view text, size_t& size) {
+  double multiplier = 1;
+  if (!text.empty()) {
+    switch (text.back()) {
+      case 'K':
+      case 'k':
+        multiplier = 1024.0;
+        break;
+      case 'M':
+      case 'm':
+        multiplier = 1024.0 * 1024;
+        break;
+      case 'G':
+      case 'g':
+        multiplier = 1024.0 * 1024 * 1024;
+        break;
+      default:
+        break;
+    }
+  }
+  if (multiplier != 1) {
+    text.remove_suffix(1);
+  }
+
+  // Sizes that do not fit in a size_t cannot be converted.
+  constexpr auto too_big =
+      static_cast<double>(std::numeric_limits<size_t>::max());
+  double number{};
+  if (!parse_number(text, number) || number * multiplier >= too_big) {
+    return false;
+  }
+  size = static_cast<size_t>(number * multiplier);
+  return true;
+}
+}  // namespace
+
+bool GcConfig::set(std::string_view name, std::string_view value) {
+  if (name == "initial") {
+    return parse_size(value, initial_threshold);
+  }
+  if (name == "grow") {
+    return parse_number(value, grow_factor) && grow_factor >= 1;
+  }
+  if (name == "min-heap") {
+    return parse_size(value, min_heap);
+  }
+  if (name == "max-heap") {
+    return parse_size(value, max_heap);
+  }
+  if (name == "heap-limit") {
+    return parse_size(value, heap_limit);
+  }
+  if (name == "target") {
+    return parse_number(value, target_gc_percent) && target_gc_percent < 100;
+  }
+  return false;
+}
+
+void GcConfig::load_environment() {
+  constexpr std::array<std::pair<const char*, std::string_view>, 6> variables{
+      {{"LOX_GC_INITIAL", "initial"},
+       {"LOX_GC_GROW", "grow"},
+       {"LOX_GC_MIN_HEAP", "min-heap"},
+       {"LOX_GC_MAX_HEAP", "max-heap"},
+       {"LOX_GC_HEAP_LIMIT", "heap-limit"},
+       {"LOX_GC_TARGET", "target"}}};
+
+  for (const auto& [variable, name] : variables) {
+    const char* value = std::getenv(variable);
+    if (value != nullptr && !set(name, value)) {
+      throw std::invalid_argument{std::string{"Invalid value for "} +
+                                  variable + "."};
+    }
+  }
+}
+
+size_t GcHeuristics::next_threshold(size_t bytes_allocated,
+                                    double gc_time_fraction) {
+  if (config_.target_gc_percent > 0) {
+    const double gc_percent = gc_time_fraction * 100;
+    if (gc_percent > config_.target_gc_percent) {
+      grow_factor_ = std::min(grow_factor_ * 1.5, MAX_GROW_FACTOR);
+    } else if (gc_percent < config_.target_gc_percent / 2) {
+      grow_factor_ = std::max(grow_factor_ / 1.25, MIN_GROW_FACTOR);
+    }
+  }
+
+  // A large grow factor can take the product past what a size_t holds.
+  const double grown = static_cast<double>(bytes_allocated) * grow_factor_;
+  const size_t threshold =
+      grown < static_cast<double>(std::numeric_limits<size_t>::max())
+          ? static_cast<size_t>(grown)
+          : std::numeric_limits<size_t>::max();
+  return std::clamp(threshold, config_.min_heap,
+                    std::max(config_.max_heap, config_.min_heap));
+}
+}  // namespace lox
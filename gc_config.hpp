@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace lox {
+struct GcConfig {
+  size_t initial_threshold{static_cast<size_t>(1024 * 1024)};
+  double grow_factor{2};
+  size_t min_heap{};
+  size_t max_heap{SIZE_MAX};
+  // Allocations beyond this raise a HeapLimitError. Strings count their
+  // characters, and lists and maps their storage, as well as the object.
+  size_t heap_limit{SIZE_MAX};
+  // When non-zero the grow factor adapts to keep GC near this share of time.
+  double target_gc_percent{};
+
+  // Accepts the names used by --gc-<name>=<value>. Sizes may carry a K, M or
+  // G suffix.
+  bool set(std::string_view name, std::string_view value);
+  // Reads LOX_GC_INITIAL, LOX_GC_GROW, LOX_GC_MIN_HEAP, LOX_GC_MAX_HEAP,
+  // LOX_GC_HEAP_LIMIT and LOX_GC_TARGET.
+  void load_environment();
+};
+
+struct HeapLimitError : std::runtime_error {
+  HeapLimitError() : runtime_error{"Heap limit exceeded."} {}
+};
+
+class GcHeuristics {
+ public:
+  explicit GcHeuristics(const GcConfig& config = {})
+      : config_{config}, grow_factor_{config.grow_factor} {}
+
+  [[nodiscard]] size_t initial_threshold() const {
+    return config_.initial_threshold;
+  }
+  [[nodiscard]] size_t heap_limit() const { return config_.heap_limit; }
+  [[nodiscard]] const GcConfig& config() const { return config_; }
+
+  size_t next_threshold(size_t bytes_allocated, double gc_time_fraction);
+
+ private:
+  GcConfig config_;
+  double grow_factor_;
+};
+}  // namespace lox
@@ -0,0 +1,147 @@
+#include "gc_stats.hpp"
+
+#include <iomanip>
+#include <string>
+
+namespace lox {
+namespace {
+double to_ms(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+}  // namespace
+
+GcStats::GcStats(std::vector<std::string_view> type_names)
+    : type_names_{std::move(type_names)}, types_(type_names_.size()) {}
+
+void GcStats::begin_collection(size_t bytes_allocated) {
+  collection_start_ = Clock::now();
+  bytes_before_ = bytes_allocated;
+}
+
+void GcStats::end_collection(size_t bytes_allocated) {
+  const Clock::time_point now = Clock::now();
+  const Clock::duration pause = now - collection_start_;
+
+  last_gc_fraction_ =
+      std::chrono::duration<double>(pause).count() /
+      std::chrono::duration<double>(now - last_collection_end_).count();
+  last_collection_end_ = now;
+
+  last_recorded_ = collections_ % trajectory_step_ == 0;
+  collections_++;
+  if (last_recorded_) {
+    trajectory_.push_back(
+        {now - start_, pause, bytes_before_, bytes_allocated});
+    // One more than MAX_ROWS is odd, so halving keeps the newest entry.
+    if (trajectory_.size() > MAX_ROWS) {
+      for (size_t i = 0; 2 * i < trajectory_.size(); i++) {
+        trajectory_[i] = trajectory_[2 * i];
+      }
+      trajectory_.resize((trajectory_.size() + 1) / 2);
+      trajectory_step_ *= 2;
+    }
+  }
+
+  auto micros = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(pause).count());
+  size_t bucket = 0;
+  while (micros != 0 && bucket < PAUSE_BUCKETS - 1) {
+    micros >>= 1U;
+    bucket++;
+  }
+  pause_histogram_[bucket]++;
+
+  total_pause_ += pause;
+  if (pause > max_pause_) {
+    max_pause_ = pause;
+  }
+}
+
+std::optional<double> GcStats::query(std::string_view key,
+                                     size_t bytes_allocated,
+                                     size_t next_gc) const {
+  uint64_t objects_freed = 0;
+  uint64_t bytes_freed = 0;
+  uint64_t live_objects = 0;
+  for (const TypeStats& type : types_) {
+    objects_freed += type.freed;
+    bytes_freed += type.bytes_freed;
+    live_objects += type.allocated - type.freed;
+  }
+
+  if (key == "collections") {
+    return static_cast<double>(collections_);
+  }
+  if (key == "pause_total_ms") {
+    return to_ms(total_pause_);
+  }
+  if (key == "pause_max_ms") {
+    return to_ms(max_pause_);
+  }
+  if (key == "bytes_allocated") {
+    return static_cast<double>(bytes_allocated);
+  }
+  if (key == "next_gc") {
+    return static_cast<double>(next_gc);
+  }
+  if (key == "bytes_freed") {
+    return static_cast<double>(bytes_freed);
+  }
+  if (key == "objects_freed") {
+    return static_cast<double>(objects_freed);
+  }
+  if (key == "live_objects") {
+    return static_cast<double>(live_objects);
+  }
+  return std::nullopt;
+}
+
+void GcStats::print_report(std::ostream& out, size_t bytes_allocated,
+                           size_t next_gc) const {
+  out << "== gc ==\n";
+  out << "collections      " << collections_ << '\n';
+  out << "pause total ms   " << to_ms(total_pause_) << '\n';
+  out << "pause max ms     " << to_ms(max_pause_) << '\n';
+  out << "bytes allocated  " << bytes_allocated << '\n';
+  out << "next gc          " << next_gc << '\n';
+
+  out << "== gc pauses ==\n";
+  out << std::setw(16) << "pause" << std::setw(12) << "count" << '\n';
+  for (size_t i = 0; i < PAUSE_BUCKETS; i++) {
+    if (pause_histogram_[i] == 0) {
+      continue;
+    }
+    if (i == 0) {
+      out << std::setw(16) << "< 1us";
+    } else {
+      out << std::setw(16)
+          << ">= " + std::to_string(uint64_t{1} << (i - 1U)) + "us";
+    }
+    out << std::setw(12) << pause_histogram_[i] << '\n';
+  }
+
+  out << "== gc objects ==\n";
+  out << std::left << std::setw(16) << "type" << std::right << std::setw(12)
+      << "allocated" << std::setw(12) << "freed" << std::setw(14)
+      << "bytes freed" << std::setw(12) << "live" << '\n';
+  for (size_t i = 0; i < types_.size(); i++) {
+    const TypeStats& type = types_[i];
+    out << std::left << std::setw(16) << type_names_[i] << std::right
+        << std::setw(12) << type.allocated << std::setw(12) << type.freed
+        << std::setw(14) << type.bytes_freed << std::setw(12)
+        << type.allocated - type.freed << '\n';
+  }
+
+  out << "== gc trajectory ==\n";
+  out << std::setw(12) << "time ms" << std::setw(14) << "pause ms"
+      << std::setw(14) << "before" << std::setw(14) << "after"
+      << std::setw(14) << "next gc" << '\n';
+  for (const Collection& collection : trajectory_) {
+    out << std::fixed << std::setprecision(3) << std::setw(12)
+        << to_ms(collection.time) << std::setw(14) << to_ms(collection.pause)
+        << std::defaultfloat << std::setw(14) << collection.bytes_before
+        << std::setw(14) << collection.bytes_after << std::setw(14)
+        << collection.next_gc << '\n';
+  }
+}
+}  // namespace lox
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace lox {
+class GcStats {
+  using Clock = std::chrono::steady_clock;
+
+  // Bucket i counts pauses in [2^(i-1), 2^i) microseconds.
+  static constexpr size_t PAUSE_BUCKETS = 24;
+  // The trajectory keeps at most this many collections, evenly spaced.
+  static constexpr size_t MAX_ROWS = 32;
+
+  struct TypeStats {
+    uint64_t allocated{};
+    uint64_t freed{};
+    uint64_t bytes_freed{};
+  };
+
+  struct Collection {
+    Clock::duration time;
+    Clock::duration pause;
+    size_t bytes_before;
+    size_t bytes_after;
+    size_t next_gc{};
+  };
+
+ public:
+  explicit GcStats(std::vector<std::string_view> type_names);
+
+  void record_allocation(size_t type) { types_[type].allocated++; }
+  void record_free(size_t type, size_t bytes) {
+    types_[type].freed++;
+    types_[type].bytes_freed += bytes;
+  }
+
+  void begin_collection(size_t bytes_allocated);
+  void end_collection(size_t bytes_allocated);
+  void record_next_gc(size_t next_gc) {
+    if (last_recorded_) {
+      trajectory_.back().next_gc = next_gc;
+    }
+  }
+
+  // Share of wall time spent in the last collection since the one before.
+  [[nodiscard]] double last_gc_fraction() const { return last_gc_fraction_; }
+
+  [[nodiscard]] std::optional<double> query(std::string_view key,
+                                            size_t bytes_allocated,
+                                            size_t next_gc) const;
+
+  void print_report(std::ostream& out, size_t bytes_allocated,
+                    size_t next_gc) const;
+
+ private:
+  std::vector<std::string_view> type_names_;
+  std::vector<TypeStats> types_;
+
+  Clock::time_point start_{Clock::now()};
+  Clock::time_point collection_start_;
+  Clock::time_point last_collection_end_{start_};
+  double last_gc_fraction_{};
+  size_t bytes_before_{};
+
+  uint64_t collections_{};
+  // Every trajectory_step_-th collection, starting with the first. The step
+  // doubles whenever the trajectory fills up, so memory stays bounded
+  // however long the program runs.
+  std::vector<Collection> trajectory_;
+  uint64_t trajectory_step_{1};
+  bool last_recorded_{};
+  std::array<uint64_t, PAUSE_BUCKETS> pause_histogram_{};
+  Clock::duration total_pause_{};
+  Clock::duration max_pause_{};
+};
+}  // namespace lox
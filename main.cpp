@@ -1,27 +1,142 @@
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 #include "bytecode.hpp"
 #include "treewalk.hpp"
 
 using namespace lox;
 
+namespace {
+constexpr std::string_view USAGE =
+    "Usage: cpplox [--profile=opcodes|samples] [--profile-output=<file>] "
+    "[--sample-interval=<instructions>] [--gc-stats] [--gc-initial=<size>] "
+    "[--gc-grow=<factor>] [--gc-min-heap=<size>] [--gc-max-heap=<size>] "
+    "[--gc-heap-limit=<size>] [--gc-target=<percent>] [--compiled] [--ast] "
+    "[--compile=<file>] [--cache] [--snapshot=<file>] [--restore=<file>] "
+    "[--workers=<threads>] [treewalk] [script...]";
+
+bool parse_option(std::string_view option, bytecode::Options& options,
+                  treewalk::Options& treewalk_options) {
+  constexpr std::string_view profile_output = "--profile-output=";
+  constexpr std::string_view sample_interval = "--sample-interval=";
+  constexpr std::string_view gc = "--gc-";
+  constexpr std::string_view compile = "--compile=";
+  constexpr std::string_view snapshot = "--snapshot=";
+  constexpr std::string_view restore = "--restore=";
+  constexpr std::string_view workers = "--workers=";
+
+  if (option == "--gc-stats") {
+    options.gc_stats = true;
+  } else if (option == "--compiled") {
+    treewalk_options.compiled = true;
+  } else if (option == "--ast") {
+    options.ast = true;
+  } else if (option == "--cache") {
+    options.cache = true;
+  } else if (option.substr(0, compile.size()) == compile &&
+             option.size() > compile.size()) {
+    options.compile_output = option.substr(compile.size());
+  } else if (option.substr(0, snapshot.size()) == snapshot &&
+             option.size() > snapshot.size()) {
+    options.snapshot_output = option.substr(snapshot.size());
+  } else if (option.substr(0, restore.size()) == restore &&
+             option.size() > restore.size()) {
+    options.snapshot_input = option.substr(restore.size());
+  } else if (option == "--profile=opcodes") {
+    options.profile = bytecode::PROFILE_OPCODES;
+  } else if (option == "--profile=samples") {
+    options.profile = bytecode::PROFILE_SAMPLES;
+  } else if (option.substr(0, profile_output.size()) == profile_output) {
+    options.profile_output = option.substr(profile_output.size());
+  } else if (option.substr(0, sample_interval.size()) == sample_interval) {
+    const std::string value{option.substr(sample_interval.size())};
+    char* end{};
+    const unsigned long interval = std::strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || interval == 0 ||
+        interval > UINT32_MAX) {
+      return false;
+    }
+    options.sample_interval = static_cast<uint32_t>(interval);
+  } else if (option.substr(0, workers.size()) == workers) {
+    const std::string value{option.substr(workers.size())};
+    char* end{};
+    const unsigned long count = std::strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || count == 0 || count > UINT16_MAX) {
+      return false;
+    }
+    options.workers = static_cast<uint32_t>(count);
+  } else if (option.substr(0, gc.size()) == gc) {
+    const size_t equals = option.find('=');
+    if (equals == std::string_view::npos ||
+        !options.gc.set(option.substr(gc.size(), equals - gc.size()),
+                        option.substr(equals + 1))) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Scripts run with --workers take only the --gc-* options.
+bool uses_worker_options(const bytecode::Options& options) {
+  return options.profile == bytecode::PROFILE_NONE && !options.gc_stats &&
+         !options.ast && !options.cache && options.compile_output.empty() &&
+         options.snapshot_input.empty() && options.snapshot_output.empty();
+}
+}  // namespace
+
 int main(int argc, char* argv[]) {
   int exit_code = 0;
 
+  bytecode::Options options;
+  try {
+    options.gc.load_environment();
+  } catch (const std::invalid_argument& e) {
+    std::cerr << e.what() << '\n';
+    return 64;
+  }
+
+  treewalk::Options treewalk_options;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--", 2) != 0) {
+      args.push_back(argv[i]);
+    } else if (!parse_option(argv[i], options, treewalk_options)) {
+      std::cerr << "Unknown option '" << argv[i] << "'.\n" << USAGE;
+      return 64;
+    }
+  }
+
+  if (options.workers > 0 && !uses_worker_options(options)) {
+    std::cerr << "Only the --gc-* options can be combined with --workers.\n"
+              << USAGE;
+    return 64;
+  }
+
+  treewalk_options.gc_stats = options.gc_stats;
+  treewalk_options.gc = options.gc;
+
   try {
-    if (argc == 3 && strcmp(argv[1], "treewalk") == 0) {
-      exit_code = treewalk::run_file(argv[2]);
-    } else if (argc == 2) {
-      if (strcmp(argv[1], "treewalk") == 0) {
-        treewalk::run_prompt();
+    if (args.size() == 2 && strcmp(args[0], "treewalk") == 0) {
+      exit_code = treewalk::run_file(args[1], treewalk_options);
+    } else if (options.workers > 0 && !args.empty() &&
+               strcmp(args[0], "treewalk") != 0) {
+      exit_code = bytecode::run_files({args.begin(), args.end()}, options);
+    } else if (args.size() == 1) {
+      if (strcmp(args[0], "treewalk") == 0) {
+        treewalk::run_prompt(treewalk_options);
       } else {
-        exit_code = bytecode::run_file(argv[1]);
+        exit_code = bytecode::run_file(args[0], options);
       }
-    } else if (argc == 1) {
-      bytecode::run_prompt();
+    } else if (args.empty()) {
+      bytecode::run_prompt(options);
     } else {
-      std::cerr << "Usage: cpplox [treewalk] [script]";
+      std::cerr << USAGE;
       exit_code = 64;
     }
   } catch (const std::exception& e) {
@@ -72,6 +72,10 @@ Token Scanner::scan_token() {
       return make_token(TOKEN_LEFT_BRACE);
     case '}':
       return make_token(TOKEN_RIGHT_BRACE);
+    case '[':
+      return make_token(TOKEN_LEFT_BRACKET);
+    case ']':
+      return make_token(TOKEN_RIGHT_BRACKET);
     case ';':
       return make_token(TOKEN_SEMICOLON);
     case ',':
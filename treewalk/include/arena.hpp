@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace lox::treewalk {
+template <typename T>
+class NodeList {
+ public:
+  NodeList() = default;
+  NodeList(T* data, size_t size) : data_{data}, size_{size} {}
+
+  [[nodiscard]] T* begin() const { return data_; }
+  [[nodiscard]] T* end() const { return data_ + size_; }
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+  T& operator[](size_t index) const { return data_[index]; }
+
+ private:
+  T* data_{};
+  size_t size_{};
+};
+
+// A bump allocator for AST nodes. Everything is released at once when the
+// arena is destroyed, so only trivially destructible types may live in it.
+class Arena {
+  static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+ public:
+  Arena() = default;
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  Arena(Arena&&) = default;
+  Arena& operator=(Arena&&) = default;
+
+  ~Arena() = default;
+
+  template <typename T, typename... Args>
+  T* make(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+  }
+
+  template <typename T>
+  NodeList<T> copy(const std::vector<T>& items) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (items.empty()) {
+      return {};
+    }
+
+    auto* data =
+        static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), data);
+    return {data, items.size()};
+  }
+
+  std::string_view copy(std::string_view string);
+
+ private:
+  void* allocate(size_t size, size_t alignment);
+
+  std::vector<std::unique_ptr<std::byte[]>> blocks_;
+  std::byte* next_{};
+  size_t remaining_{};
+};
+}  // namespace lox::treewalk
@@ -7,7 +7,7 @@ class AstPrinter : public expr::Visitor {
   using expr::Visitor::visit;
 
  public:
-  std::string print(const std::unique_ptr<Expr>& expr);
+  std::string print(Expr* expr);
 
  private:
   void visit(expr::Binary& binary) override;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string_view>
+
+#include "scanner.hpp"
+
+namespace lox::treewalk {
+// The part of a token the AST keeps. The lexeme points into the arena the
+// AST was allocated from.
+struct AstToken {
+  std::string_view lexeme;
+  int line{};
+  TokenType type{TOKEN_ERROR};
+};
+}  // namespace lox::treewalk
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <functional>
+#include <limits>
+
+#include "stmt.hpp"
+
+namespace lox::treewalk {
+class Interpreter;
+
+using ExprFn = std::function<Value(Interpreter&)>;
+// Returns true once a return statement has run.
+using StmtFn = std::function<bool(Interpreter&)>;
+
+struct CompiledFunction {
+  StmtFn body;
+  size_t slot_count{};
+};
+
+struct CompiledProgram {
+  StmtFn body;
+  std::vector<std::unique_ptr<CompiledFunction>> functions;
+};
+
+// Turns a resolved AST into a tree of closures with variable locations,
+// operators and literals baked in. Blocks that declare no functions or
+// classes share their enclosing environment instead of allocating one.
+class ClosureCompiler : public expr::Visitor, public stmt::Visitor {
+  static constexpr size_t GLOBAL = std::numeric_limits<size_t>::max();
+
+  struct Scope {
+    // Index of the scope whose environment holds this scope's variables,
+    // or GLOBAL for a scope without variables at the top level.
+    size_t environment{};
+    size_t offset{};
+    // Only used by scopes that own an environment.
+    size_t next{};
+    size_t size{};
+  };
+
+  struct Location {
+    int distance;
+    int slot;
+  };
+
+ public:
+  explicit ClosureCompiler(Interpreter& interpreter)
+      : interpreter_{interpreter} {}
+
+  CompiledProgram compile(NodeList<Stmt*> statements);
+
+ private:
+  StmtFn compile_block(NodeList<Stmt*> statements);
+  StmtFn compile(Stmt* stmt);
+  void visit(stmt::Block& block) override;
+  void visit(stmt::Class& class_) override;
+  void visit(stmt::Expression& expression) override;
+  void visit(stmt::Function& function) override;
+  void visit(stmt::If& if_) override;
+  void visit(stmt::Print& print) override;
+  void visit(stmt::Return& return_) override;
+  void visit(stmt::Var& var) override;
+  void visit(stmt::While& while_) override;
+
+  ExprFn compile(Expr* expr);
+  void visit(expr::Assign& assign) override;
+  void visit(expr::Binary& binary) override;
+  void visit(expr::Call& call) override;
+  void visit(expr::Get& get) override;
+  void visit(expr::GetIndex& get_index) override;
+  void visit(expr::Grouping& grouping) override;
+  void visit(expr::List& list) override;
+  void visit(expr::Literal& literal) override;
+  void visit(expr::Logical& logical) override;
+  void visit(expr::Set& set) override;
+  void visit(expr::SetIndex& set_index) override;
+  void visit(expr::This& this_) override;
+  void visit(expr::Super& super) override;
+  void visit(expr::Unary& unary) override;
+  void visit(expr::Variable& variable) override;
+
+  void begin_scope(size_t slot_count);
+  void begin_shared_scope(size_t slot_count);
+  size_t end_scope();
+
+  [[nodiscard]] Location locate(int depth, int slot) const;
+  [[nodiscard]] int local_slot(int slot) const;
+
+  static Value& find_global(Interpreter& interpreter, const AstToken& name);
+  ExprFn load(const AstToken& name, int depth, int slot) const;
+  void compile_function(stmt::Function& function);
+
+  Interpreter& interpreter_;
+  std::vector<Scope> scopes_;
+  std::vector<std::unique_ptr<CompiledFunction>> functions_;
+
+  ExprFn expr_;
+  StmtFn stmt_;
+};
+}  // namespace lox::treewalk
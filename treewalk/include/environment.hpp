@@ -1,29 +1,54 @@
 #pragma once
 
-#include "scanner.hpp"
+#include <array>
+
+#include "ast_token.hpp"
 #include "value.hpp"
 
 namespace lox::treewalk {
 class Environment : public Obj {
-  using Values = std::unordered_map<std::string, Value>;
+  using Values = std::unordered_map<std::string_view, Value>;
+  // Most calls and blocks need only a few slots; they are stored inline so
+  // that creating a frame is a single allocation.
+  static constexpr size_t INLINE_SLOTS = 4;
 
  public:
-  explicit Environment(Environment* enclosing = nullptr);
-
-  const Value& get(const Token& name);
-  const Value& get_at(int distance, const Token& name);
-
-  void assign(const Token& name, const Value& value);
-  void assign_at(int distance, const Token& name, const Value& value);
-  void define(const std::string& name, const Value& value);
+  explicit Environment(Environment* enclosing = nullptr, size_t slot_count = 0);
+
+  // Name lookup is only used for globals; locals are resolved to slots.
+  // Both fail when the name was never defined.
+  const Value* get(const AstToken& name);
+  bool assign(const AstToken& name, const Value& value);
+  void define(std::string_view name, const Value& value);
+
+  const Value& get_at(int distance, int slot) {
+    return ancestor(distance).slots_[slot];
+  }
+  void assign_at(int distance, int slot, const Value& value) {
+    ancestor(distance).slots_[slot] = value;
+  }
+  void define(int slot, const Value& value) { slots_[slot] = value; }
 
   [[nodiscard]] Environment* get_enclosing() const { return enclosing_; }
   [[nodiscard]] Values& get_values() { return values_; }
+  [[nodiscard]] Value* get_slots() const { return slots_; }
+  [[nodiscard]] size_t get_slot_count() const { return slot_count_; }
 
  private:
-  Environment& ancestor(int distance);
+  Environment& ancestor(int distance) {
+    Environment* environment = this;
+    for (int i = 0; i < distance; i++) {
+      environment = environment->enclosing_;
+    }
+
+    return *environment;
+  }
 
   Environment* enclosing_{};
+  size_t slot_count_;
+  std::array<Value, INLINE_SLOTS> inline_slots_{};
+  std::unique_ptr<Value[]> heap_slots_;
+  Value* slots_;
   Values values_;
 };
 }  // namespace lox::treewalk
@@ -1,8 +1,7 @@
 #pragma once
 
-#include <utility>
-
-#include "scanner.hpp"
+#include "arena.hpp"
+#include "ast_token.hpp"
 #include "value.hpp"
 
 namespace lox::treewalk::expr {
@@ -10,10 +9,13 @@ struct Assign;
 struct Binary;
 struct Call;
 struct Get;
+struct GetIndex;
 struct Grouping;
+struct List;
 struct Literal;
 struct Logical;
 struct Set;
+struct SetIndex;
 struct This;
 struct Super;
 struct Unary;
@@ -34,10 +36,13 @@ struct Visitor {
   virtual void visit(Binary& binary) = 0;
   virtual void visit(Call& call) = 0;
   virtual void visit(Get& get) = 0;
+  virtual void visit(GetIndex& get_index) = 0;
   virtual void visit(Grouping& grouping) = 0;
+  virtual void visit(List& list) = 0;
   virtual void visit(Literal& literal) = 0;
   virtual void visit(Logical& logical) = 0;
   virtual void visit(Set& set) = 0;
+  virtual void visit(SetIndex& set_index) = 0;
   virtual void visit(This& this_) = 0;
   virtual void visit(Super& super) = 0;
   virtual void visit(Unary& unary) = 0;
@@ -45,142 +50,176 @@ struct Visitor {
 };
 
 struct Expr {
-  virtual ~Expr() = default;
-
   Expr() = default;
 
   Expr(const Expr&) = delete;
   Expr& operator=(const Expr&) = delete;
 
-  Expr(Expr&&) = default;
-  Expr& operator=(Expr&&) = default;
+  Expr(Expr&&) = delete;
+  Expr& operator=(Expr&&) = delete;
 
   virtual void accept(Visitor& visitor) = 0;
 
   int depth{-1};
+  int slot{-1};
+
+ protected:
+  // Nodes live in an Arena and are never destroyed individually.
+  ~Expr() = default;
+};
+
+struct Assign final : Expr {
+  Assign(AstToken name, Expr* value) : name{name}, value{value} {}
+
+  void accept(Visitor& visitor) override { visitor.visit(*this); }
+
+  AstToken name;
+  Expr* value;
+};
+
+struct Binary final : Expr {
+  Binary(Expr* left, AstToken op, Expr* right)
+      : left{left}, op{op}, right{right} {}
+
+  void accept(Visitor& visitor) override { visitor.visit(*this); }
+
+  Expr* left;
+  AstToken op;
+  Expr* right;
 };
 
-struct Assign : Expr {
-  Assign(lox::Token name, std::unique_ptr<Expr> value)
-      : name{std::move(name)}, value{std::move(value)} {}
+struct Call final : Expr {
+  Call(Expr* callee, AstToken paren, NodeList<Expr*> arguments)
+      : callee{callee}, paren{paren}, arguments{arguments} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token name;
-  std::unique_ptr<Expr> value;
+  Expr* callee;
+  AstToken paren;
+  NodeList<Expr*> arguments;
+  // Set when the callee is a property access, so that calling a method
+  // does not have to bind it first.
+  Get* property{};
 };
 
-struct Binary : Expr {
-  Binary(std::unique_ptr<Expr> left, lox::Token op, std::unique_ptr<Expr> right)
-      : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
+struct Get final : Expr {
+  Get(Expr* object, AstToken name) : object{object}, name{name} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> left;
-  lox::Token op;
-  std::unique_ptr<Expr> right;
+  Expr* object;
+  AstToken name;
 };
 
-struct Call : Expr {
-  Call(std::unique_ptr<Expr> callee, lox::Token paren,
-       std::vector<std::unique_ptr<Expr>> arguments)
-      : callee{std::move(callee)},
-        paren{std::move(paren)},
-        arguments{std::move(arguments)} {}
+struct GetIndex final : Expr {
+  GetIndex(Expr* object, AstToken bracket, Expr* index)
+      : object{object}, bracket{bracket}, index{index} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> callee;
-  lox::Token paren;
-  std::vector<std::unique_ptr<Expr>> arguments;
+  Expr* object;
+  AstToken bracket;
+  Expr* index;
 };
 
-struct Get : Expr {
-  Get(std::unique_ptr<Expr> object, lox::Token name)
-      : object{std::move(object)}, name{std::move(name)} {}
+struct Grouping final : Expr {
+  explicit Grouping(Expr* expr) : expr{expr} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> object;
-  lox::Token name;
+  Expr* expr;
 };
 
-struct Grouping : Expr {
-  explicit Grouping(std::unique_ptr<Expr> expr) : expr{std::move(expr)} {}
+struct List final : Expr {
+  List(AstToken bracket, NodeList<Expr*> elements)
+      : bracket{bracket}, elements{elements} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> expr;
+  AstToken bracket;
+  NodeList<Expr*> elements;
 };
 
-struct Literal : Expr {
-  explicit Literal(Value value) : value{std::move(value)} {}
+struct Literal final : Expr {
+  explicit Literal(Value value) : value{value} {}
+  // String literals keep their text; the interpreter interns it on first use.
+  explicit Literal(std::string_view string) : string{string}, is_string{true} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
   Value value;
+  std::string_view string;
+  bool is_string{};
+};
+
+struct Logical final : Expr {
+  Logical(Expr* left, AstToken op, Expr* right)
+      : left{left}, op{op}, right{right} {}
+
+  void accept(Visitor& visitor) override { visitor.visit(*this); }
+
+  Expr* left;
+  AstToken op;
+  Expr* right;
 };
 
-struct Logical : Expr {
-  Logical(std::unique_ptr<Expr> left, lox::Token op,
-          std::unique_ptr<Expr> right)
-      : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
+struct Set final : Expr {
+  Set(Expr* object, AstToken name, Expr* value)
+      : object{object}, name{name}, value{value} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> left;
-  lox::Token op;
-  std::unique_ptr<Expr> right;
+  Expr* object;
+  AstToken name;
+  Expr* value;
 };
 
-struct Set : Expr {
-  Set(std::unique_ptr<Expr> object, lox::Token name,
-      std::unique_ptr<Expr> value)
-      : object{std::move(object)},
-        name{std::move(name)},
-        value{std::move(value)} {}
+struct SetIndex final : Expr {
+  SetIndex(Expr* object, AstToken bracket, Expr* index, Expr* value)
+      : object{object}, bracket{bracket}, index{index}, value{value} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> object;
-  lox::Token name;
-  std::unique_ptr<Expr> value;
+  Expr* object;
+  AstToken bracket;
+  Expr* index;
+  Expr* value;
 };
 
-struct This : Expr {
-  explicit This(lox::Token keyword) : keyword{std::move(keyword)} {}
+struct This final : Expr {
+  explicit This(AstToken keyword) : keyword{keyword} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token keyword;
+  AstToken keyword;
 };
 
-struct Super : Expr {
-  Super(lox::Token keyword, lox::Token method)
-      : keyword{std::move(keyword)}, method{std::move(method)} {}
+struct Super final : Expr {
+  Super(AstToken keyword, AstToken method)
+      : keyword{keyword}, method{method} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token keyword;
-  lox::Token method;
+  AstToken keyword;
+  AstToken method;
+  int this_depth{-1};
 };
 
-struct Unary : Expr {
-  Unary(lox::Token op, std::unique_ptr<Expr> right)
-      : op{std::move(op)}, right{std::move(right)} {}
+struct Unary final : Expr {
+  Unary(AstToken op, Expr* right) : op{op}, right{right} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token op;
-  std::unique_ptr<Expr> right;
+  AstToken op;
+  Expr* right;
 };
 
-struct Variable : Expr {
-  explicit Variable(lox::Token name) : name{std::move(name)} {}
+struct Variable final : Expr {
+  explicit Variable(AstToken name) : name{name} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token name;
+  AstToken name;
 };
 }  // namespace lox::treewalk::expr
 
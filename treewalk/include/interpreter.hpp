@@ -1,25 +1,54 @@
 #pragma once
 
 #include <iostream>
+#include <optional>
 #include <stack>
 
+#include "closure_compiler.hpp"
 #include "environment.hpp"
+#include "gc_config.hpp"
+#include "gc_stats.hpp"
+#include "runtime_error.hpp"
 #include "stmt.hpp"
 
 namespace lox::treewalk {
 class Interpreter : public expr::Visitor, public stmt::Visitor {
-  static constexpr size_t GC_HEAP_GROW_FACTOR = 2;
+  friend class ClosureCompiler;
 
  public:
   Interpreter();
-  void interpret(std::vector<std::unique_ptr<Stmt>> statements);
-  void execute_block(const std::vector<std::unique_ptr<Stmt>>& statements,
-                     Environment* environment);
+  void interpret(NodeList<Stmt*> statements, Arena arena);
+  void execute_block(NodeList<Stmt*> statements, Environment* environment);
 
   void free_objects() const;
 
+  [[nodiscard]] std::optional<double> gc_stat(std::string_view key) const {
+    return gc_stats_.query(key, bytes_allocated_, next_gc_);
+  }
+  void print_gc_stats(std::ostream& out) const {
+    gc_stats_.print_report(out, bytes_allocated_, next_gc_);
+  }
+  // Interns a string literal the first time it is evaluated. Literal
+  // strings stay reachable for as long as the interpreter lives.
+  const Value& literal_value(expr::Literal& literal) {
+    if (literal.is_string && IS_NIL(literal.value)) {
+      literal.value = intern_constant(std::string{literal.string});
+    }
+    return literal.value;
+  }
+
+  // Run programs through closures built by ClosureCompiler instead of
+  // visiting the AST.
+  void set_compiled(bool compiled) { compiled_ = compiled; }
+
+  void configure_gc(const GcConfig& config) {
+    gc_heuristics_ = GcHeuristics{config};
+    next_gc_ = gc_heuristics_.initial_threshold();
+  }
+
  private:
-  void execute(const std::unique_ptr<Stmt>& stmt);
+  ObjString* intern_constant(std::string string);
+  void execute(Stmt* stmt);
   void visit(stmt::Block& block) override;
   void visit(stmt::Class& class_) override;
   void visit(stmt::Expression& expression) override;
@@ -30,26 +59,37 @@ class Interpreter : public expr::Visitor, public stmt::Visitor {
   void visit(stmt::Var& var) override;
   void visit(stmt::While& while_) override;
 
-  Value& evaluate(const std::unique_ptr<Expr>& expr);
+  Value& evaluate(Expr* expr);
   void visit(expr::Assign& assign) override;
   void visit(expr::Binary& binary) override;
   void visit(expr::Call& call) override;
   void visit(expr::Get& get) override;
+  void visit(expr::GetIndex& get_index) override;
   void visit(expr::Grouping& grouping) override;
+  void visit(expr::List& list) override;
   void visit(expr::Literal& literal) override;
   void visit(expr::Logical& logical) override;
   void visit(expr::Set& set) override;
+  void visit(expr::SetIndex& set_index) override;
   void visit(expr::This& this_) override;
   void visit(expr::Super& super) override;
   void visit(expr::Unary& unary) override;
   void visit(expr::Variable& variable) override;
 
-  [[nodiscard]] const Value& look_up_variable(const lox::Token& name,
-                                              const expr::Expr& expr) const;
-
-  static void check_number_operand(const lox::Token& op, const Value& operand);
-  static void check_number_operands(const lox::Token& op, const Value& left,
-                                    const Value& right);
+  void define_variable(const AstToken& name, int slot, const Value& value);
+  void define_class(stmt::Class& class_, ObjClass* superclass);
+  ObjString* intern(std::string string);
+  const Value* look_up_variable(const AstToken& name, const expr::Expr& expr);
+
+  // Runtime errors do not throw. The first error is recorded and
+  // is_returning_ is set, so the program unwinds like a return that no
+  // call stops. Only visits with side effects check the flag; pure
+  // expressions finish with a meaningless value, which keeps the checks
+  // off the arithmetic paths.
+  void set_error(const AstToken& token, std::string message);
+  bool check_number_operand(const AstToken& op, const Value& operand);
+  bool check_number_operands(const AstToken& op, const Value& left,
+                             const Value& right);
 
   template <typename ObjT>
   class StackObject {
@@ -73,14 +113,29 @@ class Interpreter : public expr::Visitor, public stmt::Visitor {
     Interpreter* interpreter;
   };
 
-  static Value* find_field(ObjInstance* instance, const std::string& name);
-  ObjFunction* find_method(ObjClass* class_, const std::string& name);
+  static Value* find_field(ObjInstance* instance, std::string_view name);
+  ObjFunction* find_method(ObjClass* class_, std::string_view name);
+  ObjFunction* find_invoked_method(const Value& object, const AstToken& name);
+  Value get_property(Value object, const AstToken& name);
   ObjFunction* bind_function(ObjFunction* function, ObjInstance* instance);
-  Value call_class(ObjClass* class_, std::vector<Value> arguments);
-  Value call_function(ObjFunction* function, std::vector<Value> arguments);
-  static Value call_native(ObjNative* native, std::vector<Value> arguments);
-  Value call_value(const Value& callee, std::vector<Value> arguments,
-                   const lox::Token& token);
+  Environment* create_frame(ObjFunction* function, size_t slot_count,
+                            ObjInstance* receiver, Value* arguments,
+                            int arg_count);
+  // Calls the callee at arguments_[base] with the arguments above it and
+  // pops them. With a method, that slot holds the receiver instead.
+  Value call_at(size_t base, ObjFunction* method, const AstToken& token);
+  bool check_arity(int arity, int arg_count, const AstToken& token);
+  Value call_class(ObjClass* class_, Value* arguments, int arg_count);
+  Value call_function(ObjFunction* function, ObjInstance* receiver,
+                      Value* arguments, int arg_count);
+  Value call_compiled(ObjFunction* function, const CompiledFunction& compiled,
+                      ObjInstance* receiver, Value* arguments, int arg_count);
+  static Value call_native(ObjNative* native, Value* arguments,
+                           int arg_count);
+  // Arguments point into arguments_ and stay there until the caller pops
+  // them after the call.
+  Value call_value(Value callee, Value* arguments, int arg_count,
+                   const AstToken& token);
 
   template <typename ObjT, typename... Args>
   ObjT* allocate_object(Args&&... args) {
@@ -88,19 +143,31 @@ class Interpreter : public expr::Visitor, public stmt::Visitor {
     collect_garbage();
 #endif
 
+    // Strings count their characters too.
+    size_t size = sizeof(ObjT);
+    if constexpr (std::is_same_v<ObjT, ObjString>) {
+      size += std::string_view{args...}.size();
+    }
     if (bytes_allocated_ > next_gc_) {
       collect_garbage();
     }
+    if (bytes_allocated_ + size > gc_heuristics_.heap_limit()) {
+      collect_garbage();
+      if (bytes_allocated_ + size > gc_heuristics_.heap_limit()) {
+        throw HeapLimitError{};
+      }
+    }
 
     ObjT* object = new ObjT{std::forward<Args>(args)...};
 
     object->next_object = objects_;
     objects_ = object;
 
-    bytes_allocated_ += sizeof(ObjT);
+    bytes_allocated_ += size;
+    gc_stats_.record_allocation(object->type);
 
 #ifdef DEBUG_LOG_GC
-    std::cout << static_cast<void*>(object) << " allocate " << sizeof(ObjT)
+    std::cout << static_cast<void*>(object) << " allocate " << size
               << " for " << static_cast<int>(object->type) << "\n";
 #endif
 
@@ -120,18 +187,31 @@ class Interpreter : public expr::Visitor, public stmt::Visitor {
 
   Value return_value_{};
   bool is_returning_{};
+  std::optional<RuntimeError> error_;
 
   Environment* environment_{};
   Environment* globals_{};
 
   std::vector<Obj*> stack_;
+  // Callees and their evaluated arguments, rooted until the call returns.
+  std::vector<Value> arguments_;
+  std::vector<Obj*> constants_;
+  std::unordered_map<std::string_view, ObjString*> strings_;
   Obj* objects_{};
 
   size_t bytes_allocated_{};
-  size_t next_gc_{static_cast<size_t>(1024 * 1024)};
+  GcHeuristics gc_heuristics_;
+  size_t next_gc_{gc_heuristics_.initial_threshold()};
   std::stack<Obj*> gray_stack_;
 
-  std::vector<std::unique_ptr<Stmt>> statements_;
+  GcStats gc_stats_{
+      {"class", "function", "instance", "native", "string", "environment"}};
+
+  // Functions and classes point into the AST, so every parsed program's
+  // arena is kept until the interpreter goes away.
+  std::vector<Arena> arenas_;
+  std::vector<CompiledProgram> programs_;
+  bool compiled_{};
 };
 
 inline Interpreter g_interpreter;
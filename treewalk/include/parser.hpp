@@ -7,39 +7,42 @@ struct ParseError : std::exception {};
 
 class Parser {
  public:
-  explicit Parser(std::vector<lox::Token> tokens);
+  Parser(std::vector<lox::Token> tokens, Arena& arena);
 
-  std::vector<std::unique_ptr<Stmt>> parse();
+  NodeList<Stmt*> parse();
 
  private:
-  std::unique_ptr<Stmt> declaration();
-  std::unique_ptr<Stmt> class_declaration();
-  stmt::Function fun_declaration(const std::string& kind);
-  std::unique_ptr<Stmt> fun_declaration();
-  std::unique_ptr<Stmt> var_declaration();
-  std::unique_ptr<Stmt> statement();
-  std::unique_ptr<Stmt> for_statement();
-  std::unique_ptr<Stmt> if_statement();
-  std::unique_ptr<Stmt> print_statement();
-  std::unique_ptr<Stmt> return_statement();
-  std::unique_ptr<Stmt> while_statement();
-  std::unique_ptr<Stmt> block_statement();
-  std::unique_ptr<Stmt> expression_statement();
-
-  std::vector<std::unique_ptr<Stmt>> block();
-  std::unique_ptr<Expr> finish_call(std::unique_ptr<Expr> callee);
-
-  std::unique_ptr<Expr> expression();
-  std::unique_ptr<Expr> assignment();
-  std::unique_ptr<Expr> logic_or();
-  std::unique_ptr<Expr> logic_and();
-  std::unique_ptr<Expr> equality();
-  std::unique_ptr<Expr> comparison();
-  std::unique_ptr<Expr> term();
-  std::unique_ptr<Expr> factor();
-  std::unique_ptr<Expr> unary();
-  std::unique_ptr<Expr> call();
-  std::unique_ptr<Expr> primary();
+  Stmt* declaration();
+  Stmt* class_declaration();
+  stmt::Function* fun_declaration(const std::string& kind);
+  Stmt* fun_declaration();
+  Stmt* var_declaration();
+  Stmt* statement();
+  Stmt* for_statement();
+  Stmt* if_statement();
+  Stmt* print_statement();
+  Stmt* return_statement();
+  Stmt* while_statement();
+  Stmt* block_statement();
+  Stmt* expression_statement();
+
+  NodeList<Stmt*> block();
+  Expr* finish_call(Expr* callee);
+  Expr* list();
+
+  Expr* expression();
+  Expr* assignment();
+  Expr* logic_or();
+  Expr* logic_and();
+  Expr* equality();
+  Expr* comparison();
+  Expr* term();
+  Expr* factor();
+  Expr* unary();
+  Expr* call();
+  Expr* primary();
+
+  AstToken token(const lox::Token& token);
 
   bool match(TokenType type);
   bool check(TokenType type);
@@ -56,5 +59,6 @@ class Parser {
 
   std::vector<lox::Token> tokens_;
   size_t current_{};
+  Arena& arena_;
 };
 }  // namespace lox::treewalk
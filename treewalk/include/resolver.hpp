@@ -6,13 +6,17 @@
 
 namespace lox::treewalk {
 class Resolver : public expr::Visitor, public stmt::Visitor {
-  using ScopeMap = std::unordered_map<std::string_view, bool>;
+  struct Local {
+    bool is_defined{};
+    int slot{};
+  };
+  using ScopeMap = std::unordered_map<std::string_view, Local>;
 
  public:
-  void resolve(const std::vector<std::unique_ptr<Stmt>>& statements);
+  void resolve(NodeList<Stmt*> statements);
 
  private:
-  void resolve(const std::unique_ptr<Stmt>& stmt);
+  void resolve(Stmt* stmt);
   void visit(stmt::Block& block) override;
   void visit(stmt::Class& class_) override;
   void visit(stmt::Expression& expression) override;
@@ -23,30 +27,34 @@ class Resolver : public expr::Visitor, public stmt::Visitor {
   void visit(stmt::Var& var) override;
   void visit(stmt::While& while_) override;
 
-  void resolve(const std::unique_ptr<Expr>& expr);
+  void resolve(Expr* expr);
   void visit(expr::Assign& assign) override;
   void visit(expr::Binary& binary) override;
   void visit(expr::Call& call) override;
   void visit(expr::Get& get) override;
+  void visit(expr::GetIndex& get_index) override;
   void visit(expr::Grouping& grouping) override;
+  void visit(expr::List& list) override;
   void visit(expr::Literal& literal) override;
   void visit(expr::Logical& logical) override;
   void visit(expr::Set& set) override;
+  void visit(expr::SetIndex& set_index) override;
   void visit(expr::This& this_) override;
   void visit(expr::Super& super) override;
   void visit(expr::Unary& unary) override;
   void visit(expr::Variable& variable) override;
 
   void begin_scope();
-  void end_scope();
+  size_t end_scope();
 
-  void declare(const lox::Token& name);
-  void define(const lox::Token& name);
+  int declare(const AstToken& name);
+  void define(const AstToken& name);
 
-  void resolve_local(expr::Expr& expr, const lox::Token& name);
+  void resolve_local(expr::Expr& expr, const AstToken& name);
+  [[nodiscard]] int depth_of(std::string_view name) const;
 
   enum class FunctionType { NONE, FUNCTION, INITIALIZER, METHOD };
-  void resolve_function(const stmt::Function& function, FunctionType type);
+  void resolve_function(stmt::Function& function, FunctionType type);
 
   std::vector<ScopeMap> scopes_;
   FunctionType current_function_{FunctionType::NONE};
@@ -1,15 +1,18 @@
 #pragma once
 
 #include <stdexcept>
-#include <utility>
-
-#include "scanner.hpp"
+#include "ast_token.hpp"
 
 namespace lox::treewalk {
+// The treewalk interpreter parses list literals and indexing, which the
+// bytecode VM's --ast front end shares, but has no lists to run them on.
+inline constexpr const char* LIST_SYNTAX_ERROR =
+    "Lists and indexing need the bytecode VM.";
+
 struct RuntimeError : std::runtime_error {
-  RuntimeError(Token token, const std::string& message)
-      : runtime_error{message}, token{std::move(token)} {}
+  RuntimeError(const AstToken& token, const std::string& message)
+      : runtime_error{message}, token{token} {}
 
-  Token token;
+  AstToken token;
 };
 }  // namespace lox::treewalk
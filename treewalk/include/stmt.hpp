@@ -1,10 +1,11 @@
 #pragma once
 
-#include <optional>
-#include <utility>
-
 #include "expr.hpp"
 
+namespace lox::treewalk {
+struct CompiledFunction;
+}  // namespace lox::treewalk
+
 namespace lox::treewalk::stmt {
 struct Block;
 struct Class;
@@ -39,114 +40,113 @@ struct Visitor {
 };
 
 struct Stmt {
-  virtual ~Stmt() = default;
-
   Stmt() = default;
 
   Stmt(const Stmt&) = delete;
   Stmt& operator=(const Stmt&) = delete;
 
-  Stmt(Stmt&&) = default;
-  Stmt& operator=(Stmt&&) = default;
+  Stmt(Stmt&&) = delete;
+  Stmt& operator=(Stmt&&) = delete;
 
   virtual void accept(Visitor& visitor) = 0;
+
+ protected:
+  ~Stmt() = default;
 };
 
-struct Block : Stmt {
-  explicit Block(std::vector<std::unique_ptr<Stmt>> statements)
-      : statements{std::move(statements)} {}
+struct Block final : Stmt {
+  explicit Block(NodeList<Stmt*> statements) : statements{statements} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::vector<std::unique_ptr<Stmt>> statements;
+  NodeList<Stmt*> statements;
+  size_t slot_count{};
 };
 
-struct Function : Stmt {
-  Function(lox::Token name, std::vector<lox::Token> params,
-           std::vector<std::unique_ptr<Stmt>> body)
-      : name{std::move(name)},
-        params{std::move(params)},
-        body{std::move(body)} {}
+struct Function final : Stmt {
+  Function(AstToken name, NodeList<AstToken> params, NodeList<Stmt*> body)
+      : name{name}, params{params}, body{body} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token name;
-  std::vector<lox::Token> params;
-  std::vector<std::unique_ptr<Stmt>> body;
+  AstToken name;
+  NodeList<AstToken> params;
+  NodeList<Stmt*> body;
+  int slot{-1};
+  size_t slot_count{};
+  bool is_method{};
+  const CompiledFunction* compiled{};
 };
 
-struct Class : Stmt {
-  Class(lox::Token name, std::optional<expr::Variable> superclass,
-        std::vector<Function> methods)
-      : name{std::move(name)},
-        superclass{std::move(superclass)},
-        methods{std::move(methods)} {}
+struct Class final : Stmt {
+  Class(AstToken name, expr::Variable* superclass, NodeList<Function*> methods)
+      : name{name}, superclass{superclass}, methods{methods} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token name;
-  std::optional<expr::Variable> superclass;
-  std::vector<Function> methods;
+  AstToken name;
+  expr::Variable* superclass;
+  NodeList<Function*> methods;
+  int slot{-1};
 };
 
-struct Expression : Stmt {
-  explicit Expression(std::unique_ptr<Expr> expr) : expr{std::move(expr)} {}
+struct Expression final : Stmt {
+  explicit Expression(Expr* expr) : expr{expr} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> expr;
+  Expr* expr;
 };
 
-struct If : Stmt {
-  If(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> then_branch,
-     std::unique_ptr<Stmt> else_branch)
-      : condition{std::move(condition)},
-        then_branch{std::move(then_branch)},
-        else_branch{std::move(else_branch)} {}
+struct If final : Stmt {
+  If(Expr* condition, Stmt* then_branch, Stmt* else_branch)
+      : condition{condition},
+        then_branch{then_branch},
+        else_branch{else_branch} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Stmt> then_branch;
-  std::unique_ptr<Stmt> else_branch;
+  Expr* condition;
+  Stmt* then_branch;
+  Stmt* else_branch;
 };
 
-struct Print : Stmt {
-  explicit Print(std::unique_ptr<Expr> expr) : expr{std::move(expr)} {}
+struct Print final : Stmt {
+  explicit Print(Expr* expr) : expr{expr} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> expr;
+  Expr* expr;
 };
 
-struct Return : Stmt {
-  explicit Return(lox::Token keyword, std::unique_ptr<Expr> value)
-      : keyword{std::move(keyword)}, value{std::move(value)} {}
+struct Return final : Stmt {
+  explicit Return(AstToken keyword, Expr* value)
+      : keyword{keyword}, value{value} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token keyword;
-  std::unique_ptr<Expr> value;
+  AstToken keyword;
+  Expr* value;
 };
 
-struct Var : Stmt {
-  Var(lox::Token name, std::unique_ptr<Expr> initializer)
-      : name{std::move(name)}, initializer{std::move(initializer)} {}
+struct Var final : Stmt {
+  Var(AstToken name, Expr* initializer)
+      : name{name}, initializer{initializer} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  lox::Token name;
-  std::unique_ptr<Expr> initializer;
+  AstToken name;
+  Expr* initializer;
+  int slot{-1};
 };
 
-struct While : Stmt {
-  While(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> body)
-      : condition{std::move(condition)}, body{std::move(body)} {}
+struct While final : Stmt {
+  While(Expr* condition, Stmt* body) : condition{condition}, body{body} {}
 
   void accept(Visitor& visitor) override { visitor.visit(*this); }
 
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Stmt> body;
+  Expr* condition;
+  Stmt* body;
 };
 }  // namespace lox::treewalk::stmt
 
@@ -1,14 +1,27 @@
 #pragma once
 
+#include <optional>
 #include <string>
 
+#include "gc_config.hpp"
 #include "runtime_error.hpp"
+#include "stmt.hpp"
 
 namespace lox::treewalk {
-int run_file(const std::string& path);
-void run_prompt();
+struct Options {
+  bool gc_stats{};
+  bool compiled{};
+  GcConfig gc;
+};
+
+int run_file(const std::string& path, const Options& options = {});
+void run_prompt(const Options& options = {});
+// Scans, parses and resolves source into arena. Returns nothing after
+// reporting a compile error.
+std::optional<NodeList<Stmt*>> parse(const std::string& source, Arena& arena);
 void runtime_error(const RuntimeError& error);
-void error(const lox::Token& token, const std::string& message);
+void runtime_error(const HeapLimitError& error);
+void error(const AstToken& token, const std::string& message);
 void error(int line, const std::string& message);
 void report(int line, const std::string& where, const std::string& message);
 }  // namespace lox::treewalk
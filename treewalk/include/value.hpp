@@ -1,28 +1,29 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <unordered_map>
-#include <variant>
 
 #include "common.hpp"
 
-#define IS_BOOL(value) (std::holds_alternative<bool>(value))
-#define IS_NIL(value) (std::holds_alternative<std::monostate>(value))
-#define IS_NUMBER(value) (std::holds_alternative<double>(value))
-#define IS_STRING(value) (std::holds_alternative<std::string>(value))
-#define IS_OBJ(value) (std::holds_alternative<Obj*>(value))
+#define IS_BOOL(value) ((value).is_bool())
+#define IS_NIL(value) ((value).is_nil())
+#define IS_NUMBER(value) ((value).is_number())
+#define IS_OBJ(value) ((value).is_obj())
 #define IS_CLASS(value) (is_obj_type(value, OBJ_CLASS))
 #define IS_FUNCTION(value) (is_obj_type(value, OBJ_FUNCTION))
 #define IS_INSTANCE(value) (is_obj_type(value, OBJ_INSTANCE))
 #define IS_NATIVE(value) (is_obj_type(value, OBJ_NATIVE))
+#define IS_STRING(value) (is_obj_type(value, OBJ_STRING))
 
-#define AS_BOOL(value) (std::get<bool>(value))
-#define AS_NUMBER(value) (std::get<double>(value))
-#define AS_STRING(value) (std::get<std::string>(value))
-#define AS_OBJ(value) (std::get<Obj*>(value))
+#define AS_BOOL(value) ((value).as_bool())
+#define AS_NUMBER(value) ((value).as_number())
+#define AS_OBJ(value) ((value).as_obj())
 #define AS_CLASS(value) (static_cast<ObjClass*>(AS_OBJ(value)))
 #define AS_FUNCTION(value) (static_cast<ObjFunction*>(AS_OBJ(value)))
 #define AS_INSTANCE(value) (static_cast<ObjInstance*>(AS_OBJ(value)))
 #define AS_NATIVE(value) (static_cast<ObjNative*>(AS_OBJ(value)))
+#define AS_STRING(value) (static_cast<ObjString*>(AS_OBJ(value)))
 
 namespace lox::treewalk {
 namespace stmt {
@@ -37,6 +38,7 @@ enum ObjType {
   OBJ_FUNCTION,
   OBJ_INSTANCE,
   OBJ_NATIVE,
+  OBJ_STRING,
   OBJ_ENVIRONMENT
 };
 
@@ -56,25 +58,81 @@ struct Obj {
   Obj* next_object{};
 };
 
-using Value = std::variant<std::monostate, std::string, double, bool, Obj*>;
+// A NaN-boxed word: doubles are stored as is, nil and booleans as tagged
+// quiet NaNs and objects as a pointer in the payload of a signed quiet NaN.
+class Value {
+  static constexpr uint64_t SIGN_BIT = 0x8000000000000000U;
+  static constexpr uint64_t QNAN = 0x7ffc000000000000U;
+
+  static constexpr uint64_t NIL_VAL = QNAN | 1U;
+  static constexpr uint64_t FALSE_VAL = QNAN | 2U;
+  static constexpr uint64_t TRUE_VAL = QNAN | 3U;
+
+ public:
+  Value() = default;
+  Value(double number) { memcpy(&bits_, &number, sizeof(double)); }
+  Value(bool boolean) : bits_{boolean ? TRUE_VAL : FALSE_VAL} {}
+  Value(Obj* object)
+      : bits_{SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(object)} {}
+
+  [[nodiscard]] bool is_bool() const { return (bits_ | 1U) == TRUE_VAL; }
+  [[nodiscard]] bool is_nil() const { return bits_ == NIL_VAL; }
+  [[nodiscard]] bool is_number() const { return (bits_ & QNAN) != QNAN; }
+  [[nodiscard]] bool is_obj() const {
+    return (bits_ & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+  }
+
+  [[nodiscard]] bool as_bool() const { return bits_ == TRUE_VAL; }
+  [[nodiscard]] double as_number() const {
+    double number{};
+    memcpy(&number, &bits_, sizeof(double));
+    return number;
+  }
+  [[nodiscard]] Obj* as_obj() const {
+    return reinterpret_cast<Obj*>(bits_ & ~(SIGN_BIT | QNAN));
+  }
+
+  friend bool operator==(const Value& left, const Value& right) {
+    if (left.is_number() && right.is_number()) {
+      return left.as_number() == right.as_number();
+    }
+    return left.bits_ == right.bits_;
+  }
+
+ private:
+  uint64_t bits_{NIL_VAL};
+};
+
+struct ObjInstance;
 
 struct ObjFunction : Obj {
   ObjFunction(Environment* closure, const stmt::Function* declaration,
-              int arity, bool is_initializer)
+              int arity, bool is_initializer,
+              ObjInstance* receiver = nullptr)
       : Obj{OBJ_FUNCTION},
         closure{closure},
         declaration{declaration},
         arity{arity},
-        is_initializer{is_initializer} {}
+        is_initializer{is_initializer},
+        receiver{receiver} {}
 
   Environment* closure;
   const stmt::Function* declaration;
   int arity;
   bool is_initializer;
+  // The instance a method was bound to; it becomes 'this' in slot 0.
+  ObjInstance* receiver;
 };
 
 using NativeFn = Value (*)(int arg_count, Value* args);
 
+struct ObjString : Obj {
+  explicit ObjString(std::string string)
+      : Obj{OBJ_STRING}, string{std::move(string)} {}
+
+  const std::string string;
+};
+
 struct ObjNative : Obj {
   ObjNative(NativeFn function, int arity)
       : Obj{OBJ_NATIVE}, function{function}, arity{arity} {}
@@ -83,24 +141,43 @@ struct ObjNative : Obj {
   int arity;
 };
 
-using Methods = std::unordered_map<std::string, ObjFunction>;
+// Method and field names point into the AST arenas, which outlive every
+// object.
+using Methods = std::unordered_map<std::string_view, ObjFunction>;
+using MethodTable = std::unordered_map<std::string_view, ObjFunction*>;
 
 struct ObjClass : Obj {
   ObjClass(Methods methods, const stmt::Class* declaration,
-           ObjClass* superclass, int arity)
+           ObjClass* superclass)
       : Obj{OBJ_CLASS},
         methods{std::move(methods)},
         declaration{declaration},
-        superclass{superclass},
-        arity{arity} {}
-
+        superclass{superclass} {
+    if (superclass != nullptr) {
+      method_table = superclass->method_table;
+    }
+    for (auto& [name, method] : this->methods) {
+      method_table.insert_or_assign(name, &method);
+    }
+
+    if (auto it = method_table.find("init"); it != method_table.end()) {
+      initializer = it->second;
+      arity = initializer->arity;
+    }
+  }
+
+  // The methods declared by this class.
   Methods methods;
+  // Every method an instance responds to, inherited ones included, so a
+  // lookup never walks the superclass chain.
+  MethodTable method_table;
   const stmt::Class* declaration;
   ObjClass* superclass;
-  int arity;
+  ObjFunction* initializer{};
+  int arity{};
 };
 
-using Fields = std::unordered_map<std::string, Value>;
+using Fields = std::unordered_map<std::string_view, Value>;
 
 struct ObjInstance : Obj {
   explicit ObjInstance(ObjClass* class_) : Obj{OBJ_INSTANCE}, class_{class_} {}
@@ -0,0 +1,35 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lox::treewalk {
+std::string_view Arena::copy(std::string_view string) {
+  if (string.empty()) {
+    return {};
+  }
+
+  auto* data = static_cast<char*>(allocate(string.size(), alignof(char)));
+  memcpy(data, string.data(), string.size());
+  return {data, string.size()};
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+  const size_t padding =
+      (alignment - reinterpret_cast<uintptr_t>(next_) % alignment) % alignment;
+
+  if (next_ == nullptr || padding + size > remaining_) {
+    const size_t block_size = std::max(size, BLOCK_SIZE);
+    // Blocks come from operator new[] and are aligned for any node type.
+    blocks_.push_back(std::make_unique<std::byte[]>(block_size));
+    next_ = blocks_.back().get();
+    remaining_ = block_size;
+    return allocate(size, alignment);
+  }
+
+  std::byte* data = next_ + padding;
+  next_ = data + size;
+  remaining_ -= padding + size;
+  return data;
+}
+}  // namespace lox::treewalk
@@ -1,7 +1,7 @@
 #include "ast_printer.hpp"
 
 namespace lox::treewalk {
-std::string AstPrinter::print(const std::unique_ptr<Expr>& expr) {
+std::string AstPrinter::print(Expr* expr) {
   expr->accept(*this);
   return str_;
 }
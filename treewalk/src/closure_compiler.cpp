@@ -0,0 +1,660 @@
+#include "closure_compiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+
+#include "interpreter.hpp"
+#include "runtime_error.hpp"
+
+namespace lox::treewalk {
+namespace {
+bool declares_functions(NodeList<Stmt*> statements);
+
+// Closures capture the environment they are declared in, so a block that
+// declares a function or class needs an environment of its own.
+bool declares_functions(Stmt* stmt) {
+  if (dynamic_cast<stmt::Function*>(stmt) != nullptr ||
+      dynamic_cast<stmt::Class*>(stmt) != nullptr) {
+    return true;
+  }
+  if (auto* block = dynamic_cast<stmt::Block*>(stmt)) {
+    return declares_functions(block->statements);
+  }
+  if (auto* if_ = dynamic_cast<stmt::If*>(stmt)) {
+    return declares_functions(if_->then_branch) ||
+           (if_->else_branch != nullptr &&
+            declares_functions(if_->else_branch));
+  }
+  if (auto* while_ = dynamic_cast<stmt::While*>(stmt)) {
+    return declares_functions(while_->body);
+  }
+  return false;
+}
+
+bool declares_functions(NodeList<Stmt*> statements) {
+  return std::any_of(statements.begin(), statements.end(),
+                     [](Stmt* stmt) { return declares_functions(stmt); });
+}
+
+std::optional<double> number_literal(Expr* expr) {
+  if (auto* literal = dynamic_cast<expr::Literal*>(expr);
+      literal != nullptr && IS_NUMBER(literal->value)) {
+    return AS_NUMBER(literal->value);
+  }
+  return std::nullopt;
+}
+
+template <typename Operation>
+ExprFn number_operation(ExprFn left, ExprFn right,
+                        std::optional<double> constant, const AstToken& op,
+                        Operation operation) {
+  if (constant) {
+    return [left = std::move(left), op, operation,
+            right = *constant](Interpreter& interpreter) -> Value {
+      const Value value = left(interpreter);
+      if (!IS_NUMBER(value)) {
+        throw RuntimeError{op, "Operands must be numbers."};
+      }
+      return operation(AS_NUMBER(value), right);
+    };
+  }
+
+  return [left = std::move(left), right = std::move(right), op,
+          operation](Interpreter& interpreter) -> Value {
+    const Value a = left(interpreter);
+    const Value b = right(interpreter);
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+      throw RuntimeError{op, "Operands must be numbers."};
+    }
+    return operation(AS_NUMBER(a), AS_NUMBER(b));
+  };
+}
+}  // namespace
+
+CompiledProgram ClosureCompiler::compile(NodeList<Stmt*> statements) {
+  StmtFn body = compile_block(statements);
+  return {std::move(body), std::move(functions_)};
+}
+
+StmtFn ClosureCompiler::compile_block(NodeList<Stmt*> statements) {
+  std::vector<StmtFn> compiled;
+  compiled.reserve(statements.size());
+  for (Stmt* statement : statements) {
+    compiled.push_back(compile(statement));
+  }
+
+  if (compiled.empty()) {
+    return [](Interpreter& /*interpreter*/) { return false; };
+  }
+  if (compiled.size() == 1) {
+    return std::move(compiled.front());
+  }
+
+  return [statements = std::move(compiled)](Interpreter& interpreter) {
+    for (const StmtFn& statement : statements) {
+      if (statement(interpreter)) {
+        return true;
+      }
+    }
+    return false;
+  };
+}
+
+StmtFn ClosureCompiler::compile(Stmt* stmt) {
+  stmt->accept(*this);
+  return std::move(stmt_);
+}
+
+void ClosureCompiler::visit(stmt::Block& block) {
+  const size_t owner = scopes_.empty() ? GLOBAL : scopes_.back().environment;
+  if ((owner != GLOBAL || block.slot_count == 0) &&
+      !declares_functions(block.statements)) {
+    begin_shared_scope(block.slot_count);
+    stmt_ = compile_block(block.statements);
+    end_scope();
+    return;
+  }
+
+  begin_scope(block.slot_count);
+  StmtFn statements = compile_block(block.statements);
+  const size_t slot_count = end_scope();
+
+  stmt_ = [statements = std::move(statements),
+           slot_count](Interpreter& interpreter) {
+    const Interpreter::StackObject environment{
+        interpreter.allocate_object<Environment>(interpreter.environment_,
+                                                 slot_count),
+        &interpreter};
+
+    Environment* previous = interpreter.environment_;
+    interpreter.environment_ = static_cast<Environment*>(environment);
+    const bool returned = statements(interpreter);
+    interpreter.environment_ = previous;
+    return returned;
+  };
+}
+
+void ClosureCompiler::visit(stmt::Class& class_) {
+  ExprFn superclass;
+  if (class_.superclass != nullptr) {
+    superclass = compile(class_.superclass);
+    begin_scope(1);
+  }
+
+  for (stmt::Function* method : class_.methods) {
+    compile_function(*method);
+  }
+
+  if (class_.superclass != nullptr) {
+    end_scope();
+  }
+
+  stmt_ = [&class_,
+           superclass = std::move(superclass)](Interpreter& interpreter) {
+    ObjClass* object{};
+    if (superclass) {
+      const Value value = superclass(interpreter);
+      if (!IS_CLASS(value)) {
+        throw RuntimeError{class_.superclass->name,
+                           "Superclass must be a class."};
+      }
+      object = AS_CLASS(value);
+    }
+
+    interpreter.define_class(class_, object);
+    return false;
+  };
+}
+
+void ClosureCompiler::visit(stmt::Expression& expression) {
+  stmt_ = [expr = compile(expression.expr)](Interpreter& interpreter) {
+    expr(interpreter);
+    return false;
+  };
+}
+
+void ClosureCompiler::visit(stmt::Function& function) {
+  compile_function(function);
+
+  stmt_ = [&function,
+           slot = local_slot(function.slot)](Interpreter& interpreter) {
+    interpreter.define_variable(
+        function.name, slot,
+        interpreter.allocate_object<ObjFunction>(
+            interpreter.environment_, &function,
+            static_cast<int>(function.params.size()), false));
+    return false;
+  };
+}
+
+void ClosureCompiler::visit(stmt::If& if_) {
+  ExprFn condition = compile(if_.condition);
+  StmtFn then_branch = compile(if_.then_branch);
+
+  if (if_.else_branch == nullptr) {
+    stmt_ = [condition = std::move(condition),
+             then_branch = std::move(then_branch)](Interpreter& interpreter) {
+      return !is_falsey(condition(interpreter)) && then_branch(interpreter);
+    };
+    return;
+  }
+
+  stmt_ = [condition = std::move(condition),
+           then_branch = std::move(then_branch),
+           else_branch = compile(if_.else_branch)](Interpreter& interpreter) {
+    if (!is_falsey(condition(interpreter))) {
+      return then_branch(interpreter);
+    }
+    return else_branch(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(stmt::Print& print) {
+  stmt_ = [expr = compile(print.expr)](Interpreter& interpreter) {
+    print_value(expr(interpreter));
+    std::cout << '\n';
+    return false;
+  };
+}
+
+void ClosureCompiler::visit(stmt::Return& return_) {
+  if (return_.value == nullptr) {
+    stmt_ = [](Interpreter& interpreter) {
+      interpreter.return_value_ = {};
+      return true;
+    };
+    return;
+  }
+
+  stmt_ = [value = compile(return_.value)](Interpreter& interpreter) {
+    interpreter.return_value_ = value(interpreter);
+    return true;
+  };
+}
+
+void ClosureCompiler::visit(stmt::Var& var) {
+  ExprFn initializer;
+  if (var.initializer != nullptr) {
+    initializer = compile(var.initializer);
+  } else {
+    initializer = [](Interpreter& /*interpreter*/) { return Value{}; };
+  }
+
+  const int slot = local_slot(var.slot);
+  if (slot < 0) {
+    stmt_ = [initializer = std::move(initializer),
+             name = var.name](Interpreter& interpreter) {
+      const Value value = initializer(interpreter);
+      interpreter.environment_->define(name.lexeme, value);
+      return false;
+    };
+    return;
+  }
+
+  stmt_ = [initializer = std::move(initializer),
+           slot](Interpreter& interpreter) {
+    const Value value = initializer(interpreter);
+    interpreter.environment_->define(slot, value);
+    return false;
+  };
+}
+
+void ClosureCompiler::visit(stmt::While& while_) {
+  stmt_ = [condition = compile(while_.condition),
+           body = compile(while_.body)](Interpreter& interpreter) {
+    while (!is_falsey(condition(interpreter))) {
+      if (body(interpreter)) {
+        return true;
+      }
+    }
+    return false;
+  };
+}
+
+ExprFn ClosureCompiler::compile(Expr* expr) {
+  expr->accept(*this);
+  return std::move(expr_);
+}
+
+void ClosureCompiler::visit(expr::Assign& assign) {
+  ExprFn value = compile(assign.value);
+
+  if (assign.depth < 0) {
+    expr_ = [value = std::move(value), name = assign.name,
+             global = static_cast<Value*>(nullptr)](
+                Interpreter& interpreter) mutable {
+      const Value result = value(interpreter);
+      if (global == nullptr) {
+        global = &find_global(interpreter, name);
+      }
+      *global = result;
+      return result;
+    };
+    return;
+  }
+
+  expr_ = [value = std::move(value), location = locate(assign.depth,
+                                                       assign.slot)](
+              Interpreter& interpreter) {
+    const Value result = value(interpreter);
+    interpreter.environment_->assign_at(location.distance, location.slot,
+                                        result);
+    return result;
+  };
+}
+
+void ClosureCompiler::visit(expr::Binary& binary) {
+  ExprFn left = compile(binary.left);
+  ExprFn right = compile(binary.right);
+  const std::optional<double> constant = number_literal(binary.right);
+  const AstToken& op = binary.op;
+
+  switch (op.type) {
+    case TOKEN_BANG_EQUAL:
+      expr_ = [left = std::move(left),
+               right = std::move(right)](Interpreter& interpreter) {
+        const Value value = left(interpreter);
+        return Value{!(value == right(interpreter))};
+      };
+      break;
+    case TOKEN_EQUAL_EQUAL:
+      expr_ = [left = std::move(left),
+               right = std::move(right)](Interpreter& interpreter) {
+        const Value value = left(interpreter);
+        return Value{value == right(interpreter)};
+      };
+      break;
+    case TOKEN_GREATER:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::greater<double>{});
+      break;
+    case TOKEN_GREATER_EQUAL:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::greater_equal<double>{});
+      break;
+    case TOKEN_LESS:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::less<double>{});
+      break;
+    case TOKEN_LESS_EQUAL:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::less_equal<double>{});
+      break;
+    case TOKEN_MINUS:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::minus<double>{});
+      break;
+    case TOKEN_SLASH:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::divides<double>{});
+      break;
+    case TOKEN_STAR:
+      expr_ = number_operation(std::move(left), std::move(right), constant,
+                               op, std::multiplies<double>{});
+      break;
+    case TOKEN_PLUS:
+      if (constant) {
+        expr_ = [left = std::move(left), op,
+                 right = *constant](Interpreter& interpreter) -> Value {
+          const Value value = left(interpreter);
+          if (!IS_NUMBER(value)) {
+            throw RuntimeError{op,
+                               "Operands must be two numbers or two strings."};
+          }
+          return AS_NUMBER(value) + right;
+        };
+        break;
+      }
+
+      expr_ = [left = std::move(left), right = std::move(right),
+               op](Interpreter& interpreter) -> Value {
+        const Value a = left(interpreter);
+        if (!IS_OBJ(a)) {
+          const Value b = right(interpreter);
+          if (IS_NUMBER(a) && IS_NUMBER(b)) {
+            return AS_NUMBER(a) + AS_NUMBER(b);
+          }
+        } else {
+          const Interpreter::StackObject root{AS_OBJ(a), &interpreter};
+          const Value b = right(interpreter);
+          if (IS_STRING(a) && IS_STRING(b)) {
+            return interpreter.intern(AS_STRING(a)->string +
+                                      AS_STRING(b)->string);
+          }
+        }
+
+        throw RuntimeError{op, "Operands must be two numbers or two strings."};
+      };
+      break;
+    default:
+      expr_ = [](Interpreter& /*interpreter*/) { return Value{}; };
+      break;
+  }
+}
+
+void ClosureCompiler::visit(expr::Call& call) {
+  std::vector<ExprFn> arguments;
+  arguments.reserve(call.arguments.size());
+  for (Expr* argument : call.arguments) {
+    arguments.push_back(compile(argument));
+  }
+
+  if (call.property != nullptr) {
+    expr_ = [object = compile(call.property->object),
+             arguments = std::move(arguments), name = call.property->name,
+             paren = call.paren](Interpreter& interpreter) {
+      std::vector<Value>& stack = interpreter.arguments_;
+      const size_t base = stack.size();
+      stack.push_back(object(interpreter));
+      ObjFunction* method = interpreter.find_invoked_method(stack[base], name);
+      if (method == nullptr) {
+        stack[base] = interpreter.get_property(stack[base], name);
+      }
+
+      for (const ExprFn& argument : arguments) {
+        stack.push_back(argument(interpreter));
+      }
+      return interpreter.call_at(base, method, paren);
+    };
+    return;
+  }
+
+  expr_ = [callee = compile(call.callee), arguments = std::move(arguments),
+           paren = call.paren](Interpreter& interpreter) {
+    std::vector<Value>& stack = interpreter.arguments_;
+    const size_t base = stack.size();
+    stack.push_back(callee(interpreter));
+    for (const ExprFn& argument : arguments) {
+      stack.push_back(argument(interpreter));
+    }
+    return interpreter.call_at(base, nullptr, paren);
+  };
+}
+
+void ClosureCompiler::visit(expr::Get& get) {
+  expr_ = [object = compile(get.object),
+           name = get.name](Interpreter& interpreter) {
+    return interpreter.get_property(object(interpreter), name);
+  };
+}
+
+void ClosureCompiler::visit(expr::GetIndex& get_index) {
+  expr_ = [bracket = get_index.bracket](Interpreter& /*interpreter*/)
+      -> Value { throw RuntimeError{bracket, LIST_SYNTAX_ERROR}; };
+}
+
+void ClosureCompiler::visit(expr::Grouping& grouping) {
+  expr_ = compile(grouping.expr);
+}
+
+void ClosureCompiler::visit(expr::List& list) {
+  expr_ = [bracket = list.bracket](Interpreter& /*interpreter*/) -> Value {
+    throw RuntimeError{bracket, LIST_SYNTAX_ERROR};
+  };
+}
+
+void ClosureCompiler::visit(expr::Literal& literal) {
+  expr_ = [value = interpreter_.literal_value(literal)](
+              Interpreter& /*interpreter*/) {
+    return value;
+  };
+}
+
+void ClosureCompiler::visit(expr::Logical& logical) {
+  ExprFn left = compile(logical.left);
+  ExprFn right = compile(logical.right);
+
+  if (logical.op.type == TOKEN_OR) {
+    expr_ = [left = std::move(left),
+             right = std::move(right)](Interpreter& interpreter) {
+      const Value value = left(interpreter);
+      return is_falsey(value) ? right(interpreter) : value;
+    };
+    return;
+  }
+
+  expr_ = [left = std::move(left),
+           right = std::move(right)](Interpreter& interpreter) {
+    const Value value = left(interpreter);
+    return is_falsey(value) ? value : right(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(expr::Set& set) {
+  expr_ = [object = compile(set.object), value = compile(set.value),
+           name = set.name](Interpreter& interpreter) {
+    const Value instance = object(interpreter);
+    if (!IS_INSTANCE(instance)) {
+      throw RuntimeError{name, "Only instances have fields."};
+    }
+
+    const Interpreter::StackObject root{AS_INSTANCE(instance), &interpreter};
+    const Value result = value(interpreter);
+    AS_INSTANCE(instance)->fields.insert_or_assign(name.lexeme, result);
+    return result;
+  };
+}
+
+void ClosureCompiler::visit(expr::SetIndex& set_index) {
+  expr_ = [bracket = set_index.bracket](Interpreter& /*interpreter*/)
+      -> Value { throw RuntimeError{bracket, LIST_SYNTAX_ERROR}; };
+}
+
+void ClosureCompiler::visit(expr::This& this_) {
+  expr_ = load(this_.keyword, this_.depth, 0);
+}
+
+void ClosureCompiler::visit(expr::Super& super) {
+  expr_ = [superclass = locate(super.depth, 0),
+           this_ = locate(super.this_depth, 0),
+           method = super.method](Interpreter& interpreter) -> Value {
+    Environment* environment = interpreter.environment_;
+    ObjFunction* function = interpreter.find_method(
+        AS_CLASS(environment->get_at(superclass.distance, superclass.slot)),
+        method.lexeme);
+
+    if (function == nullptr) {
+      throw RuntimeError{
+          method, "Undefined property '" + std::string{method.lexeme} + "'."};
+    }
+
+    return interpreter.bind_function(
+        function,
+        AS_INSTANCE(environment->get_at(this_.distance, this_.slot)));
+  };
+}
+
+void ClosureCompiler::visit(expr::Unary& unary) {
+  if (unary.op.type == TOKEN_MINUS) {
+    if (const std::optional<double> constant = number_literal(unary.right)) {
+      expr_ = [value = -*constant](Interpreter& /*interpreter*/) {
+        return Value{value};
+      };
+      return;
+    }
+
+    expr_ = [right = compile(unary.right),
+             op = unary.op](Interpreter& interpreter) -> Value {
+      const Value value = right(interpreter);
+      if (!IS_NUMBER(value)) {
+        throw RuntimeError{op, "Operand must be a number."};
+      }
+      return -AS_NUMBER(value);
+    };
+    return;
+  }
+
+  expr_ = [right = compile(unary.right)](Interpreter& interpreter) {
+    return Value{is_falsey(right(interpreter))};
+  };
+}
+
+void ClosureCompiler::visit(expr::Variable& variable) {
+  expr_ = load(variable.name, variable.depth, variable.slot);
+}
+
+void ClosureCompiler::begin_scope(size_t slot_count) {
+  scopes_.push_back({scopes_.size(), 0, slot_count, slot_count});
+}
+
+void ClosureCompiler::begin_shared_scope(size_t slot_count) {
+  const size_t owner = scopes_.empty() ? GLOBAL : scopes_.back().environment;
+
+  size_t offset = 0;
+  if (owner != GLOBAL) {
+    Scope& environment = scopes_[owner];
+    offset = environment.next;
+    environment.next += slot_count;
+    environment.size = std::max(environment.size, environment.next);
+  }
+
+  scopes_.push_back({owner, offset, 0, 0});
+}
+
+size_t ClosureCompiler::end_scope() {
+  const size_t index = scopes_.size() - 1;
+  const Scope scope = scopes_.back();
+  scopes_.pop_back();
+
+  if (scope.environment == index) {
+    return scope.size;
+  }
+  if (scope.environment != GLOBAL) {
+    scopes_[scope.environment].next = scope.offset;
+  }
+  return 0;
+}
+
+ClosureCompiler::Location ClosureCompiler::locate(int depth, int slot) const {
+  const Scope& scope =
+      scopes_[scopes_.size() - 1 - static_cast<size_t>(depth)];
+
+  int distance = 0;
+  for (size_t i = scope.environment + 1; i < scopes_.size(); i++) {
+    if (scopes_[i].environment == i) {
+      distance++;
+    }
+  }
+
+  return {distance, static_cast<int>(scope.offset) + slot};
+}
+
+int ClosureCompiler::local_slot(int slot) const {
+  if (slot < 0) {
+    return slot;
+  }
+  return static_cast<int>(scopes_.back().offset) + slot;
+}
+
+Value& ClosureCompiler::find_global(Interpreter& interpreter,
+                                    const AstToken& name) {
+  auto& values = interpreter.globals_->get_values();
+  if (auto it = values.find(name.lexeme); it != values.end()) {
+    return it->second;
+  }
+
+  throw RuntimeError{name,
+                     "Undefined variable '" + std::string{name.lexeme} + "'."};
+}
+
+ExprFn ClosureCompiler::load(const AstToken& name, int depth, int slot) const {
+  if (depth < 0) {
+    // Globals are never removed, so the slot found on first use stays valid.
+    return [name, global = static_cast<Value*>(nullptr)](
+               Interpreter& interpreter) mutable {
+      if (global == nullptr) {
+        global = &find_global(interpreter, name);
+      }
+      return *global;
+    };
+  }
+
+  const Location location = locate(depth, slot);
+  switch (location.distance) {
+    case 0:
+      return [slot = location.slot](Interpreter& interpreter) {
+        return interpreter.environment_->get_at(0, slot);
+      };
+    case 1:
+      return [slot = location.slot](Interpreter& interpreter) {
+        return interpreter.environment_->get_at(1, slot);
+      };
+    default:
+      return [location](Interpreter& interpreter) {
+        return interpreter.environment_->get_at(location.distance,
+                                                location.slot);
+      };
+  }
+}
+
+void ClosureCompiler::compile_function(stmt::Function& function) {
+  begin_scope(function.slot_count);
+  StmtFn body = compile_block(function.body);
+  const size_t slot_count = end_scope();
+
+  functions_.push_back(std::make_unique<CompiledFunction>(
+      CompiledFunction{std::move(body), slot_count}));
+  function.compiled = functions_.back().get();
+}
+}  // namespace lox::treewalk
@@ -1,57 +1,41 @@
 #include "environment.hpp"
 
-#include "runtime_error.hpp"
-
 namespace lox::treewalk {
-Environment::Environment(Environment* enclosing)
-    : Obj{OBJ_ENVIRONMENT}, enclosing_{enclosing} {}
-
-const Value& Environment::get(const Token& name) {
+Environment::Environment(Environment* enclosing, size_t slot_count)
+    : Obj{OBJ_ENVIRONMENT},
+      enclosing_{enclosing},
+      slot_count_{slot_count},
+      heap_slots_{slot_count > INLINE_SLOTS
+                      ? std::make_unique<Value[]>(slot_count)
+                      : nullptr},
+      slots_{heap_slots_ ? heap_slots_.get() : inline_slots_.data()} {}
+
+const Value* Environment::get(const AstToken& name) {
   if (auto it = values_.find(name.lexeme); it != values_.end()) {
-    return it->second;
+    return &it->second;
   }
 
   if (enclosing_ != nullptr) {
     return enclosing_->get(name);
   }
 
-  throw RuntimeError{name,
-                     "Undefined variable '" + std::string{name.lexeme} + "'."};
+  return nullptr;
 }
 
-const Value& Environment::get_at(int distance, const Token& name) {
-  return ancestor(distance).get(name);
-}
-
-void Environment::assign(const Token& name, const Value& value) {
+bool Environment::assign(const AstToken& name, const Value& value) {
   if (auto it = values_.find(name.lexeme); it != values_.end()) {
     it->second = value;
-    return;
+    return true;
   }
 
   if (enclosing_ != nullptr) {
     return enclosing_->assign(name, value);
   }
 
-  throw RuntimeError{name,
-                     "Undefined variable '" + std::string{name.lexeme} + "'."};
-}
-
-void Environment::assign_at(int distance, const Token& name,
-                            const Value& value) {
-  ancestor(distance).assign(name, value);
+  return false;
 }
 
-void Environment::define(const std::string& name, const Value& value) {
+void Environment::define(std::string_view name, const Value& value) {
   values_.insert_or_assign(name, value);
 }
-
-Environment& Environment::ancestor(int distance) {
-  Environment* environment = this;
-  for (int i = 0; i < distance; i++) {
-    environment = environment->enclosing_;
-  }
-
-  return *environment;
-}
 }  // namespace lox::treewalk
@@ -14,6 +14,16 @@ Value clock_native(int /*arg_count*/, Value* /*args*/) {
   constexpr double ms_to_seconds = 1.0 / 1000;
   return static_cast<double>(ms) * ms_to_seconds;
 }
+
+Value gc_stat_native(int /*arg_count*/, Value* args) {
+  if (!IS_STRING(args[0])) {
+    return {};
+  }
+
+  const std::optional<double> stat =
+      g_interpreter.gc_stat(AS_STRING(args[0])->string);
+  return stat ? Value{*stat} : Value{};
+}
 }  // namespace
 
 Interpreter::Interpreter() {
@@ -24,20 +34,39 @@ Interpreter::Interpreter() {
 
   const StackObject clock{allocate_object<ObjNative>(clock_native, 0), this};
   environment_->define("clock", static_cast<ObjNative*>(clock));
+
+  const StackObject gc_stat{allocate_object<ObjNative>(gc_stat_native, 1),
+                            this};
+  environment_->define("gcStat", static_cast<ObjNative*>(gc_stat));
 }
 
-void Interpreter::interpret(std::vector<std::unique_ptr<Stmt>> statements) {
+void Interpreter::interpret(NodeList<Stmt*> statements, Arena arena) {
+  arenas_.push_back(std::move(arena));
+
   try {
-    for (auto& statement : statements) {
-      execute(statement);
+    if (compiled_) {
+      programs_.push_back(ClosureCompiler{*this}.compile(statements));
+      programs_.back().body(*this);
+    } else {
+      for (Stmt* statement : statements) {
+        execute(statement);
+      }
     }
   } catch (const RuntimeError& e) {
     runtime_error(e);
+  } catch (const HeapLimitError& e) {
+    runtime_error(e);
   }
 
-  statements_.insert(statements_.end(),
-                     std::make_move_iterator(statements.begin()),
-                     std::make_move_iterator(statements.end()));
+  if (error_) {
+    runtime_error(*error_);
+    error_.reset();
+  }
+
+  // An error can leave the interpreter anywhere inside the program.
+  is_returning_ = false;
+  environment_ = globals_;
+  arguments_.clear();
 }
 
 void Interpreter::free_objects() const {
@@ -53,31 +82,24 @@ void Interpreter::free_objects() const {
   }
 }
 
-void Interpreter::execute_block(
-    const std::vector<std::unique_ptr<Stmt>>& statements,
-    Environment* environment) {
+void Interpreter::execute_block(NodeList<Stmt*> statements,
+                                Environment* environment) {
   if (statements.empty()) {
     return_value_ = {};
     return;
   }
 
   Environment* previous = environment_;
-
-  // try {
   environment_ = environment;
 
-  for (const auto& statement : statements) {
+  for (Stmt* statement : statements) {
     execute(statement);
   }
-  // } catch (...) {
-  //   environment_ = previous;
-  //   throw;
-  // }
 
   environment_ = previous;
 }
 
-void Interpreter::execute(const std::unique_ptr<Stmt>& stmt) {
+void Interpreter::execute(Stmt* stmt) {
   if (is_returning_) {
     return;
   }
@@ -86,51 +108,57 @@ void Interpreter::execute(const std::unique_ptr<Stmt>& stmt) {
 }
 
 void Interpreter::visit(stmt::Block& block) {
-  const StackObject environment{allocate_object<Environment>(environment_),
-                                this};
+  const StackObject environment{
+      allocate_object<Environment>(environment_, block.slot_count), this};
   execute_block(block.statements, static_cast<Environment*>(environment));
 }
 
 void Interpreter::visit(stmt::Class& class_) {
   ObjClass* superclass{};
-  if (class_.superclass) {
-    const Value& variable =
+  if (class_.superclass != nullptr) {
+    const Value* variable =
         look_up_variable(class_.superclass->name, *class_.superclass);
+    if (variable == nullptr) {
+      return;
+    }
 
-    if (IS_CLASS(variable)) {
-      superclass = AS_CLASS(variable);
-    } else {
-      throw RuntimeError{class_.superclass->name,
-                         "Superclass must be a class."};
+    if (!IS_CLASS(*variable)) {
+      set_error(class_.superclass->name, "Superclass must be a class.");
+      return;
     }
+    superclass = AS_CLASS(*variable);
   }
 
-  environment_->define(class_.name.lexeme, {});
+  define_class(class_, superclass);
+}
+
+void Interpreter::define_class(stmt::Class& class_, ObjClass* superclass) {
+  define_variable(class_.name, class_.slot, {});
 
   if (superclass != nullptr) {
-    environment_ = allocate_object<Environment>(environment_);
-    environment_->define("super", superclass);
+    environment_ = allocate_object<Environment>(environment_, size_t{1});
+    environment_->define(0, superclass);
   }
 
   Methods methods;
-  for (const auto& method : class_.methods) {
-    methods.try_emplace(method.name.lexeme, environment_, &method,
-                        static_cast<int>(method.params.size()),
-                        method.name.lexeme == "init");
+  for (const stmt::Function* method : class_.methods) {
+    methods.try_emplace(method->name.lexeme, environment_, method,
+                        static_cast<int>(method->params.size()),
+                        method->name.lexeme == "init");
   }
 
   auto* object =
-      allocate_object<ObjClass>(std::move(methods), &class_, superclass, 0);
+      allocate_object<ObjClass>(std::move(methods), &class_, superclass);
 
   if (superclass != nullptr) {
     environment_ = environment_->get_enclosing();
   }
 
-  if (ObjFunction* initializer = find_method(object, "init")) {
-    object->arity = initializer->arity;
+  if (class_.slot >= 0) {
+    environment_->define(class_.slot, object);
+  } else {
+    environment_->assign(class_.name, object);
   }
-
-  environment_->assign(class_.name, object);
 }
 
 void Interpreter::visit(stmt::Expression& expression) {
@@ -138,10 +166,10 @@ void Interpreter::visit(stmt::Expression& expression) {
 }
 
 void Interpreter::visit(stmt::Function& function) {
-  environment_->define(function.name.lexeme,
-                       allocate_object<ObjFunction>(
-                           environment_, &function,
-                           static_cast<int>(function.params.size()), false));
+  define_variable(function.name, function.slot,
+                  allocate_object<ObjFunction>(
+                      environment_, &function,
+                      static_cast<int>(function.params.size()), false));
 }
 
 void Interpreter::visit(stmt::If& if_) {
@@ -153,7 +181,12 @@ void Interpreter::visit(stmt::If& if_) {
 }
 
 void Interpreter::visit(stmt::Print& print) {
-  print_value(evaluate(print.expr));
+  const Value& value = evaluate(print.expr);
+  if (is_returning_) {
+    return;
+  }
+
+  print_value(value);
   std::cout << '\n';
 }
 
@@ -165,7 +198,6 @@ void Interpreter::visit(stmt::Return& return_) {
   }
 
   is_returning_ = true;
-  // throw Return(value);
 }
 
 void Interpreter::visit(stmt::Var& var) {
@@ -175,7 +207,9 @@ void Interpreter::visit(stmt::Var& var) {
     return_value_ = {};
   }
 
-  environment_->define(var.name.lexeme, return_value_);
+  if (!is_returning_) {
+    define_variable(var.name, var.slot, return_value_);
+  }
 }
 
 void Interpreter::visit(stmt::While& while_) {
@@ -187,18 +221,23 @@ void Interpreter::visit(stmt::While& while_) {
   }
 }
 
-Value& Interpreter::evaluate(const std::unique_ptr<Expr>& expr) {
+Value& Interpreter::evaluate(Expr* expr) {
   expr->accept(*this);
   return return_value_;
 }
 
 void Interpreter::visit(expr::Assign& assign) {
   const Value& value = evaluate(assign.value);
+  if (is_returning_) {
+    return;
+  }
+
   const int distance = assign.depth;
   if (distance >= 0) {
-    environment_->assign_at(distance, assign.name, value);
-  } else {
-    globals_->assign(assign.name, value);
+    environment_->assign_at(distance, assign.slot, value);
+  } else if (!globals_->assign(assign.name, value)) {
+    set_error(assign.name, "Undefined variable '" +
+                               std::string{assign.name.lexeme} + "'.");
   }
 }
 
@@ -223,24 +262,29 @@ void Interpreter::visit(expr::Binary& binary) {
       return_value_ = {left == right};
       break;
     case TOKEN_GREATER:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) > AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) > AS_NUMBER(right)};
+      }
       break;
     case TOKEN_GREATER_EQUAL:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) >= AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) >= AS_NUMBER(right)};
+      }
       break;
     case TOKEN_LESS:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) < AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) < AS_NUMBER(right)};
+      }
       break;
     case TOKEN_LESS_EQUAL:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) <= AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) <= AS_NUMBER(right)};
+      }
       break;
     case TOKEN_MINUS:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) - AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) - AS_NUMBER(right)};
+      }
       break;
     case TOKEN_PLUS:
       if (IS_NUMBER(left) && IS_NUMBER(right)) {
@@ -248,19 +292,22 @@ void Interpreter::visit(expr::Binary& binary) {
         break;
       }
       if (IS_STRING(left) && IS_STRING(right)) {
-        return_value_ = {AS_STRING(left) + AS_STRING(right)};
+        return_value_ = {
+            intern(AS_STRING(left)->string + AS_STRING(right)->string)};
         break;
       }
 
-      throw RuntimeError{binary.op,
-                         "Operands must be two numbers or two strings."};
+      set_error(binary.op, "Operands must be two numbers or two strings.");
+      break;
     case TOKEN_SLASH:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) / AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) / AS_NUMBER(right)};
+      }
       break;
     case TOKEN_STAR:
-      check_number_operands(binary.op, left, right);
-      return_value_ = {AS_NUMBER(left) * AS_NUMBER(right)};
+      if (check_number_operands(binary.op, left, right)) {
+        return_value_ = {AS_NUMBER(left) * AS_NUMBER(right)};
+      }
       break;
     default:
       return_value_ = {};
@@ -269,44 +316,49 @@ void Interpreter::visit(expr::Binary& binary) {
 }
 
 void Interpreter::visit(expr::Call& call) {
-  const Value callee = evaluate(call.callee);
+  const size_t base = arguments_.size();
+  ObjFunction* method{};
+  if (call.property != nullptr) {
+    arguments_.push_back(evaluate(call.property->object));
+    method = find_invoked_method(arguments_[base], call.property->name);
+    if (method == nullptr) {
+      arguments_[base] = get_property(arguments_[base], call.property->name);
+    }
+  } else {
+    arguments_.push_back(evaluate(call.callee));
+  }
 
-  std::vector<Value> arguments;
-  arguments.reserve(call.arguments.size());
-  for (const auto& argument : call.arguments) {
-    arguments.push_back(evaluate(argument));
+  for (Expr* argument : call.arguments) {
+    arguments_.push_back(evaluate(argument));
   }
 
-  return_value_ = call_value(callee, arguments, call.paren);
-  is_returning_ = false;
+  // On an error the pushed values are left behind; interpret() clears
+  // them once the error has unwound.
+  if (is_returning_) {
+    return;
+  }
+
+  return_value_ = call_at(base, method, call.paren);
+  // The callee's return statement stops here; an error keeps unwinding.
+  is_returning_ = error_.has_value();
 }
 
 void Interpreter::visit(expr::Get& get) {
-  const Value& value = evaluate(get.object);
-  if (IS_INSTANCE(value)) {
-    const auto& instance = AS_INSTANCE(value);
-
-    if (Value* field = find_field(instance, get.name.lexeme)) {
-      return_value_ = *field;
-      return;
-    }
-
-    if (ObjFunction* method = find_method(instance->class_, get.name.lexeme)) {
-      return_value_ = bind_function(method, instance);
-      return;
-    }
-
-    throw RuntimeError{get.name,
-                       "Undefined property '" + get.name.lexeme + "'."};
-  }
+  return_value_ = get_property(evaluate(get.object), get.name);
+}
 
-  throw RuntimeError{get.name, "Only instances have properties."};
+void Interpreter::visit(expr::GetIndex& get_index) {
+  set_error(get_index.bracket, LIST_SYNTAX_ERROR);
 }
 
 void Interpreter::visit(expr::Grouping& grouping) { evaluate(grouping.expr); }
 
+void Interpreter::visit(expr::List& list) {
+  set_error(list.bracket, LIST_SYNTAX_ERROR);
+}
+
 void Interpreter::visit(expr::Literal& literal) {
-  return_value_ = literal.value;
+  return_value_ = literal_value(literal);
 }
 
 void Interpreter::visit(expr::Logical& logical) {
@@ -326,32 +378,42 @@ void Interpreter::visit(expr::Logical& logical) {
 }
 
 void Interpreter::visit(expr::Set& set) {
-  Value& object = evaluate(set.object);
-
+  const Value& object = evaluate(set.object);
   if (!IS_INSTANCE(object)) {
-    throw RuntimeError{set.name, "Only instances have fields."};
+    set_error(set.name, "Only instances have fields.");
+    return;
+  }
+
+  ObjInstance* instance = AS_INSTANCE(object);
+  const StackObject root{instance, this};
+  const Value& value = evaluate(set.value);
+  if (is_returning_) {
+    return;
   }
 
-  AS_INSTANCE(object)->fields.insert_or_assign(set.name.lexeme,
-                                               evaluate(set.value));
+  instance->fields.insert_or_assign(set.name.lexeme, value);
+}
+
+void Interpreter::visit(expr::SetIndex& set_index) {
+  set_error(set_index.bracket, LIST_SYNTAX_ERROR);
 }
 
 void Interpreter::visit(expr::This& this_) {
-  return_value_ = look_up_variable(this_.keyword, this_);
+  return_value_ = environment_->get_at(this_.depth, this_.slot);
 }
 
 void Interpreter::visit(expr::Super& super) {
-  ObjFunction* method = find_method(
-      AS_CLASS(environment_->get_at(super.depth, {TOKEN_SUPER, "super", 0})),
-      super.method.lexeme);
+  ObjFunction* method =
+      find_method(AS_CLASS(environment_->get_at(super.depth, 0)),
+                  super.method.lexeme);
 
   if (method == nullptr) {
-    throw RuntimeError{super.method,
-                       "Undefined property '" + super.method.lexeme + "'."};
+    set_error(super.method, "Undefined property '" +
+                                std::string{super.method.lexeme} + "'.");
+    return;
   }
 
-  const Value& this_ =
-      environment_->get_at(super.depth - 1, {TOKEN_THIS, "this", 0});
+  const Value& this_ = environment_->get_at(super.this_depth, 0);
 
   return_value_ = {bind_function(method, AS_INSTANCE(this_))};
 }
@@ -364,8 +426,9 @@ void Interpreter::visit(expr::Unary& unary) {
       return_value_ = {is_falsey(right)};
       break;
     case TOKEN_MINUS:
-      check_number_operand(unary.op, right);
-      return_value_ = {-AS_NUMBER(right)};
+      if (check_number_operand(unary.op, right)) {
+        return_value_ = {-AS_NUMBER(right)};
+      }
       break;
     default:
       return_value_ = {};
@@ -374,38 +437,85 @@ void Interpreter::visit(expr::Unary& unary) {
 }
 
 void Interpreter::visit(expr::Variable& variable) {
-  return_value_ = look_up_variable(variable.name, variable);
+  if (const Value* value = look_up_variable(variable.name, variable)) {
+    return_value_ = *value;
+  }
+}
+
+void Interpreter::define_variable(const AstToken& name, int slot,
+                                  const Value& value) {
+  if (slot >= 0) {
+    environment_->define(slot, value);
+  } else {
+    environment_->define(name.lexeme, value);
+  }
 }
 
-const Value& Interpreter::look_up_variable(const lox::Token& name,
-                                           const expr::Expr& expr) const {
+ObjString* Interpreter::intern(std::string string) {
+  if (auto it = strings_.find(string); it != strings_.end()) {
+    return it->second;
+  }
+
+  auto* object = allocate_object<ObjString>(std::move(string));
+  strings_.emplace(object->string, object);
+  return object;
+}
+
+ObjString* Interpreter::intern_constant(std::string string) {
+  ObjString* object = intern(std::move(string));
+  constants_.push_back(object);
+  return object;
+}
+
+const Value* Interpreter::look_up_variable(const AstToken& name,
+                                           const expr::Expr& expr) {
   const int distance = expr.depth;
   if (distance >= 0) {
-    return environment_->get_at(distance, name);
+    return &environment_->get_at(distance, expr.slot);
+  }
+
+  if (const Value* value = globals_->get(name)) {
+    return value;
   }
 
-  return globals_->get(name);
+  set_error(name, "Undefined variable '" + std::string{name.lexeme} + "'.");
+  return nullptr;
 }
 
-void Interpreter::check_number_operand(const lox::Token& op,
+void Interpreter::set_error(const AstToken& token, std::string message) {
+  // Closures built by ClosureCompiler have no status checks, so they
+  // still unwind by exception.
+  if (compiled_) {
+    throw RuntimeError{token, message};
+  }
+
+  if (!error_) {
+    error_.emplace(token, message);
+  }
+  is_returning_ = true;
+}
+
+bool Interpreter::check_number_operand(const AstToken& op,
                                        const Value& operand) {
   if (IS_NUMBER(operand)) {
-    return;
+    return true;
   }
 
-  throw RuntimeError{op, "Operand must be a number."};
+  set_error(op, "Operand must be a number.");
+  return false;
 }
 
-void Interpreter::check_number_operands(const lox::Token& op, const Value& left,
+bool Interpreter::check_number_operands(const AstToken& op, const Value& left,
                                         const Value& right) {
   if (IS_NUMBER(left) && IS_NUMBER(right)) {
-    return;
+    return true;
   }
 
-  throw RuntimeError{op, "Operands must be numbers."};
+  set_error(op, "Operands must be numbers.");
+  return false;
 }
 
-Value* Interpreter::find_field(ObjInstance* instance, const std::string& name) {
+Value* Interpreter::find_field(ObjInstance* instance, std::string_view name) {
   if (auto it = instance->fields.find(name); it != instance->fields.end()) {
     return &it->second;
   }
@@ -414,60 +524,133 @@ Value* Interpreter::find_field(ObjInstance* instance, const std::string& name) {
 }
 
 ObjFunction* Interpreter::find_method(ObjClass* class_,
-                                      const std::string& name) {
-  if (auto it = class_->methods.find(name); it != class_->methods.end()) {
-    return &it->second;
+                                      std::string_view name) {
+  const MethodTable& methods = class_->method_table;
+  if (auto it = methods.find(name); it != methods.end()) {
+    return it->second;
   }
 
-  if (class_->superclass != nullptr) {
-    return find_method(class_->superclass, name);
+  return nullptr;
+}
+
+ObjFunction* Interpreter::find_invoked_method(const Value& object,
+                                              const AstToken& name) {
+  if (!IS_INSTANCE(object)) {
+    return nullptr;
   }
 
-  return nullptr;
+  // A field holding a callable shadows a method of the same name.
+  ObjInstance* instance = AS_INSTANCE(object);
+  if (find_field(instance, name.lexeme) != nullptr) {
+    return nullptr;
+  }
+
+  return find_method(instance->class_, name.lexeme);
+}
+
+Value Interpreter::get_property(Value object, const AstToken& name) {
+  if (!IS_INSTANCE(object)) {
+    set_error(name, "Only instances have properties.");
+    return {};
+  }
+
+  ObjInstance* instance = AS_INSTANCE(object);
+  if (Value* field = find_field(instance, name.lexeme)) {
+    return *field;
+  }
+
+  if (ObjFunction* method = find_method(instance->class_, name.lexeme)) {
+    const StackObject root{instance, this};
+    return bind_function(method, instance);
+  }
+
+  set_error(name, "Undefined property '" + std::string{name.lexeme} + "'.");
+  return {};
 }
 
 ObjFunction* Interpreter::bind_function(ObjFunction* function,
                                         ObjInstance* instance) {
-  const StackObject environment{allocate_object<Environment>(function->closure),
-                                this};
-  auto* closure = static_cast<Environment*>(environment);
-  closure->define("this", {instance});
-  return allocate_object<ObjFunction>(closure, function->declaration,
+  return allocate_object<ObjFunction>(function->closure, function->declaration,
                                       function->arity,
-                                      function->is_initializer);
+                                      function->is_initializer, instance);
+}
+
+Environment* Interpreter::create_frame(ObjFunction* function,
+                                       size_t slot_count,
+                                       ObjInstance* receiver,
+                                       Value* arguments, int arg_count) {
+  auto* frame = allocate_object<Environment>(function->closure, slot_count);
+
+  // The arguments are only valid until the body pushes arguments of its
+  // own, so they are copied into the frame first.
+  Value* slots = frame->get_slots();
+  if (function->declaration->is_method) {
+    *slots++ = receiver;
+  }
+  std::copy_n(arguments, arg_count, slots);
+  return frame;
+}
+
+Value Interpreter::call_at(size_t base, ObjFunction* method,
+                           const AstToken& token) {
+  Value* arguments = arguments_.data() + base + 1;
+  const auto arg_count = static_cast<int>(arguments_.size() - base - 1);
+
+  Value result;
+  if (method != nullptr) {
+    if (!check_arity(method->arity, arg_count, token)) {
+      return {};
+    }
+    result = call_function(method, AS_INSTANCE(arguments_[base]), arguments,
+                           arg_count);
+  } else {
+    result = call_value(arguments_[base], arguments, arg_count, token);
+  }
+
+  arguments_.resize(base);
+  return result;
 }
 
-Value Interpreter::call_class(ObjClass* class_, std::vector<Value> arguments) {
+bool Interpreter::check_arity(int arity, int arg_count,
+                              const AstToken& token) {
+  if (arity == arg_count) {
+    return true;
+  }
+
+  set_error(token, "Expected " + std::to_string(arity) +
+                       " arguments but got " + std::to_string(arg_count) +
+                       ".");
+  return false;
+}
+
+Value Interpreter::call_class(ObjClass* class_, Value* arguments,
+                              int arg_count) {
   const StackObject instance{allocate_object<ObjInstance>(class_), this};
 
-  if (ObjFunction* method = find_method(class_, "init")) {
-    const StackObject initializer{
-        bind_function(method, static_cast<ObjInstance*>(instance)), this};
-    call_function(static_cast<ObjFunction*>(initializer), std::move(arguments));
+  if (class_->initializer != nullptr) {
+    call_function(class_->initializer, static_cast<ObjInstance*>(instance),
+                  arguments, arg_count);
   }
 
   return static_cast<ObjInstance*>(instance);
 }
 
-Value Interpreter::call_function(ObjFunction* function,
-                                 std::vector<Value> arguments) {
-  const StackObject environment{allocate_object<Environment>(function->closure),
-                                this};
-
-  for (size_t i = 0; i < function->declaration->params.size(); i++) {
-    static_cast<Environment*>(environment)
-        ->define(function->declaration->params[i].lexeme, arguments[i]);
+Value Interpreter::call_function(ObjFunction* function, ObjInstance* receiver,
+                                 Value* arguments, int arg_count) {
+  if (const CompiledFunction* compiled = function->declaration->compiled) {
+    return call_compiled(function, *compiled, receiver, arguments, arg_count);
   }
 
-  // try {
+  const StackObject environment{
+      create_frame(function, function->declaration->slot_count, receiver,
+                   arguments, arg_count),
+      this};
+
   execute_block(function->declaration->body,
                 static_cast<Environment*>(environment));
-  // } catch (const Return& return_value) {
-  //   return return_value.value_;
-  // }
 
   if (function->is_initializer) {
-    return function->closure->get_at(0, {TOKEN_THIS, "this", 0});
+    return receiver;
   }
 
   if (!is_returning_) {
@@ -477,39 +660,61 @@ Value Interpreter::call_function(ObjFunction* function,
   return return_value_;
 }
 
-Value Interpreter::call_native(ObjNative* native,
-                               std::vector<Value> arguments) {
-  return native->function(static_cast<int>(arguments.size()), arguments.data());
+Value Interpreter::call_compiled(ObjFunction* function,
+                                 const CompiledFunction& compiled,
+                                 ObjInstance* receiver, Value* arguments,
+                                 int arg_count) {
+  const StackObject environment{
+      create_frame(function, compiled.slot_count, receiver, arguments,
+                   arg_count),
+      this};
+
+  Environment* previous = environment_;
+  environment_ = static_cast<Environment*>(environment);
+  const bool returned = compiled.body(*this);
+  environment_ = previous;
+
+  if (function->is_initializer) {
+    return receiver;
+  }
+
+  return returned ? return_value_ : Value{};
 }
 
-Value Interpreter::call_value(const Value& callee, std::vector<Value> arguments,
-                              const lox::Token& token) {
+Value Interpreter::call_native(ObjNative* native, Value* arguments,
+                               int arg_count) {
+  return native->function(arg_count, arguments);
+}
+
+Value Interpreter::call_value(Value callee, Value* arguments, int arg_count,
+                              const AstToken& token) {
   if (!IS_OBJ(callee)) {
-    throw RuntimeError{token, "Can only call functions and classes."};
+    set_error(token, "Can only call functions and classes.");
+    return {};
   }
 
-  auto check_arity = [&](int arity) {
-    if (arity != static_cast<int>(arguments.size())) {
-      throw RuntimeError{token, "Expected " + std::to_string(arity) +
-                                    " arguments but got " +
-                                    std::to_string(arguments.size()) + "."};
-    }
-  };
-
   const StackObject callable{AS_OBJ(callee), this};
 
   switch (AS_OBJ(callee)->type) {
     case OBJ_CLASS:
-      check_arity(AS_CLASS(callee)->arity);
-      return call_class(AS_CLASS(callee), arguments);
+      if (!check_arity(AS_CLASS(callee)->arity, arg_count, token)) {
+        return {};
+      }
+      return call_class(AS_CLASS(callee), arguments, arg_count);
     case OBJ_FUNCTION:
-      check_arity(AS_FUNCTION(callee)->arity);
-      return call_function(AS_FUNCTION(callee), arguments);
+      if (!check_arity(AS_FUNCTION(callee)->arity, arg_count, token)) {
+        return {};
+      }
+      return call_function(AS_FUNCTION(callee), AS_FUNCTION(callee)->receiver,
+                           arguments, arg_count);
     case OBJ_NATIVE:
-      check_arity(AS_NATIVE(callee)->arity);
-      return call_native(AS_NATIVE(callee), arguments);
+      if (!check_arity(AS_NATIVE(callee)->arity, arg_count, token)) {
+        return {};
+      }
+      return call_native(AS_NATIVE(callee), arguments, arg_count);
     default:
-      throw RuntimeError{token, "Can only call functions and classes."};
+      set_error(token, "Can only call functions and classes.");
+      return {};
   }
 }
 
@@ -518,12 +723,16 @@ void Interpreter::collect_garbage() {
   std::cout << "-- gc begin\n";
   const size_t before = bytes_allocated_;
 #endif
+  gc_stats_.begin_collection(bytes_allocated_);
 
   mark_roots();
   trace_references();
   sweep();
 
-  next_gc_ = bytes_allocated_ * GC_HEAP_GROW_FACTOR;
+  gc_stats_.end_collection(bytes_allocated_);
+  next_gc_ = gc_heuristics_.next_threshold(bytes_allocated_,
+                                           gc_stats_.last_gc_fraction());
+  gc_stats_.record_next_gc(next_gc_);
 
 #ifdef DEBUG_LOG_GC
   std::cout << "-- gc end\n";
@@ -571,6 +780,10 @@ void Interpreter::mark_environment(Environment* environment) {
   for (const auto& [_, value] : environment->get_values()) {
     mark_value(value);
   }
+  const Value* slots = environment->get_slots();
+  for (size_t i = 0; i < environment->get_slot_count(); i++) {
+    mark_value(slots[i]);
+  }
 
   mark_environment(environment->get_enclosing());
 }
@@ -589,15 +802,19 @@ void Interpreter::blacken_object(Obj* object) {
         auto& [_, method] = *class_->methods.begin();
         mark_environment(method.closure);
       }
+      // Inherited entries in the method table point into the superclass.
+      mark_object(class_->superclass);
       break;
     }
     case OBJ_FUNCTION: {
       auto* function = static_cast<ObjFunction*>(object);
       mark_environment(function->closure);
+      mark_object(function->receiver);
       break;
     }
     case OBJ_INSTANCE: {
       auto* instance = static_cast<ObjInstance*>(object);
+      mark_object(instance->class_);
       for (const auto& [_, field] : instance->fields) {
         mark_value(field);
       }
@@ -618,9 +835,15 @@ void Interpreter::mark_roots() {
 
   mark_value(return_value_);
 
+  for (const Value& value : arguments_) {
+    mark_value(value);
+  }
   for (Obj* object : stack_) {
     mark_object(object);
   }
+  for (Obj* object : constants_) {
+    mark_object(object);
+  }
 }
 
 void Interpreter::trace_references() {
@@ -648,22 +871,30 @@ void Interpreter::sweep() {
         objects_ = object;
       }
 
+      size_t size = 0;
       switch (unreached->type) {
         case OBJ_CLASS:
-          bytes_allocated_ -= sizeof(ObjClass);
+          size = sizeof(ObjClass);
           break;
         case OBJ_FUNCTION:
-          bytes_allocated_ -= sizeof(ObjFunction);
+          size = sizeof(ObjFunction);
           break;
         case OBJ_INSTANCE:
-          bytes_allocated_ -= sizeof(ObjInstance);
+          size = sizeof(ObjInstance);
           break;
         case OBJ_NATIVE:
-          bytes_allocated_ -= sizeof(ObjNative);
+          size = sizeof(ObjNative);
+          break;
+        case OBJ_STRING:
+          strings_.erase(static_cast<ObjString*>(unreached)->string);
+          size = sizeof(ObjString) +
+                 static_cast<ObjString*>(unreached)->string.size();
           break;
         case OBJ_ENVIRONMENT:
-          bytes_allocated_ -= sizeof(Environment);
+          size = sizeof(Environment);
       }
+      bytes_allocated_ -= size;
+      gc_stats_.record_free(unreached->type, size);
 
 #ifdef DEBUG_LOG_GC
       std::cout << static_cast<void*>(unreached) << " free type "
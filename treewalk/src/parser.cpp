@@ -3,18 +3,19 @@
 #include "treewalk.hpp"
 
 namespace lox::treewalk {
-Parser::Parser(std::vector<lox::Token> tokens) : tokens_{std::move(tokens)} {}
+Parser::Parser(std::vector<lox::Token> tokens, Arena& arena)
+    : tokens_{std::move(tokens)}, arena_{arena} {}
 
-std::vector<std::unique_ptr<Stmt>> Parser::parse() {
-  std::vector<std::unique_ptr<Stmt>> statements;
+NodeList<Stmt*> Parser::parse() {
+  std::vector<Stmt*> statements;
   while (!is_at_end()) {
     statements.push_back(declaration());
   }
 
-  return statements;
+  return arena_.copy(statements);
 }
 
-std::unique_ptr<Stmt> Parser::declaration() {
+Stmt* Parser::declaration() {
   try {
     if (match(TOKEN_CLASS)) {
       return class_declaration();
@@ -33,33 +34,33 @@ std::unique_ptr<Stmt> Parser::declaration() {
   }
 }
 
-std::unique_ptr<Stmt> Parser::class_declaration() {
-  const lox::Token& name = consume(TOKEN_IDENTIFIER, "Expect class name.");
+Stmt* Parser::class_declaration() {
+  const AstToken name = token(consume(TOKEN_IDENTIFIER, "Expect class name."));
 
-  std::optional<expr::Variable> superclass;
+  expr::Variable* superclass{};
   if (match(TOKEN_LESS)) {
     consume(TOKEN_IDENTIFIER, "Expect superclass name.");
-    superclass = expr::Variable{previous()};
+    superclass = arena_.make<expr::Variable>(token(previous()));
   }
 
   consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
 
-  std::vector<stmt::Function> methods;
+  std::vector<stmt::Function*> methods;
   while (!check(TOKEN_RIGHT_BRACE) && !is_at_end()) {
     methods.push_back(fun_declaration("method"));
+    methods.back()->is_method = true;
   }
 
   consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
 
-  return std::make_unique<stmt::Class>(name, std::move(superclass),
-                                       std::move(methods));
+  return arena_.make<stmt::Class>(name, superclass, arena_.copy(methods));
 }
 
-stmt::Function Parser::fun_declaration(const std::string& kind) {
-  const lox::Token& name =
-      consume(TOKEN_IDENTIFIER, "Expect " + kind + " name.");
+stmt::Function* Parser::fun_declaration(const std::string& kind) {
+  const AstToken name =
+      token(consume(TOKEN_IDENTIFIER, "Expect " + kind + " name."));
   consume(TOKEN_LEFT_PAREN, "Expect '(' after " + kind + " name.");
-  std::vector<lox::Token> parameters;
+  std::vector<AstToken> parameters;
   if (!check(TOKEN_RIGHT_PAREN)) {
     do {
       constexpr size_t max_parameter_count = 255;
@@ -67,33 +68,33 @@ stmt::Function Parser::fun_declaration(const std::string& kind) {
         error(peek(), "Can't have more than 255 parameters.");
       }
 
-      parameters.push_back(consume(TOKEN_IDENTIFIER, "Expect parameter name."));
+      parameters.push_back(
+          token(consume(TOKEN_IDENTIFIER, "Expect parameter name.")));
     } while (match(TOKEN_COMMA));
   }
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
 
   consume(TOKEN_LEFT_BRACE, "Expect '{' before " + kind + " body.");
   auto body = block();
-  return {name, std::move(parameters), std::move(body)};
+  return arena_.make<stmt::Function>(name, arena_.copy(parameters), body);
 }
 
-std::unique_ptr<Stmt> Parser::fun_declaration() {
-  return std::make_unique<stmt::Function>(fun_declaration("function"));
-}
+Stmt* Parser::fun_declaration() { return fun_declaration("function"); }
 
-std::unique_ptr<Stmt> Parser::var_declaration() {
-  const lox::Token& name = consume(TOKEN_IDENTIFIER, "Expect variable name.");
+Stmt* Parser::var_declaration() {
+  const AstToken name =
+      token(consume(TOKEN_IDENTIFIER, "Expect variable name."));
 
-  std::unique_ptr<Expr> initializer;
+  Expr* initializer{};
   if (match(TOKEN_EQUAL)) {
     initializer = expression();
   }
 
   consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
-  return std::make_unique<stmt::Var>(name, std::move(initializer));
+  return arena_.make<stmt::Var>(name, initializer);
 }
 
-std::unique_ptr<Stmt> Parser::statement() {
+Stmt* Parser::statement() {
   if (match(TOKEN_FOR)) {
     return for_statement();
   }
@@ -116,9 +117,9 @@ std::unique_ptr<Stmt> Parser::statement() {
   return expression_statement();
 }
 
-std::unique_ptr<Stmt> Parser::for_statement() {
+Stmt* Parser::for_statement() {
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
-  std::unique_ptr<Stmt> initializer;
+  Stmt* initializer{};
   if (match(TOKEN_SEMICOLON)) {
   } else if (match(TOKEN_VAR)) {
     initializer = var_declaration();
@@ -126,13 +127,13 @@ std::unique_ptr<Stmt> Parser::for_statement() {
     initializer = expression_statement();
   }
 
-  std::unique_ptr<Expr> condition;
+  Expr* condition{};
   if (!check(TOKEN_SEMICOLON)) {
     condition = expression();
   }
   consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
 
-  std::unique_ptr<Expr> increment;
+  Expr* increment{};
   if (!check(TOKEN_RIGHT_PAREN)) {
     increment = expression();
   }
@@ -140,92 +141,90 @@ std::unique_ptr<Stmt> Parser::for_statement() {
   auto body = statement();
 
   if (increment) {
-    std::vector<std::unique_ptr<Stmt>> loop_statements;
-    loop_statements.push_back(std::move(body));
-    loop_statements.push_back(
-        std::make_unique<stmt::Expression>(std::move(increment)));
-    body = std::make_unique<stmt::Block>(std::move(loop_statements));
+    std::vector<Stmt*> loop_statements;
+    loop_statements.push_back(body);
+    loop_statements.push_back(arena_.make<stmt::Expression>(increment));
+    body = arena_.make<stmt::Block>(arena_.copy(loop_statements));
   }
 
   if (!condition) {
-    condition = std::make_unique<expr::Literal>(true);
+    condition = arena_.make<expr::Literal>(true);
   }
-  body = std::make_unique<stmt::While>(std::move(condition), std::move(body));
+  body = arena_.make<stmt::While>(condition, body);
 
   if (initializer) {
-    std::vector<std::unique_ptr<Stmt>> block;
-    block.push_back(std::move(initializer));
-    block.push_back(std::move(body));
-    body = std::make_unique<stmt::Block>(std::move(block));
+    std::vector<Stmt*> block;
+    block.push_back(initializer);
+    block.push_back(body);
+    body = arena_.make<stmt::Block>(arena_.copy(block));
   }
 
   return body;
 }
 
-std::unique_ptr<Stmt> Parser::if_statement() {
+Stmt* Parser::if_statement() {
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
   auto condition = expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after if condition.");
 
   auto then_branch = statement();
-  std::unique_ptr<Stmt> else_branch;
+  Stmt* else_branch{};
   if (match(TOKEN_ELSE)) {
     else_branch = statement();
   }
 
-  return std::make_unique<stmt::If>(
-      std::move(condition), std::move(then_branch), std::move(else_branch));
+  return arena_.make<stmt::If>(condition, then_branch, else_branch);
 }
 
-std::unique_ptr<Stmt> Parser::print_statement() {
+Stmt* Parser::print_statement() {
   auto value = expression();
   consume(TOKEN_SEMICOLON, "Expect ';' after value.");
-  return std::make_unique<stmt::Print>(std::move(value));
+  return arena_.make<stmt::Print>(value);
 }
 
-std::unique_ptr<Stmt> Parser::return_statement() {
-  const lox::Token& keyword = previous();
-  std::unique_ptr<Expr> value;
+Stmt* Parser::return_statement() {
+  const AstToken keyword = token(previous());
+  Expr* value{};
   if (!check(TOKEN_SEMICOLON)) {
     value = expression();
   }
 
   consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
-  return std::make_unique<stmt::Return>(keyword, std::move(value));
+  return arena_.make<stmt::Return>(keyword, value);
 }
 
-std::unique_ptr<Stmt> Parser::while_statement() {
+Stmt* Parser::while_statement() {
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
   auto condition = expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
   auto body = statement();
 
-  return std::make_unique<stmt::While>(std::move(condition), std::move(body));
+  return arena_.make<stmt::While>(condition, body);
 }
 
-std::unique_ptr<Stmt> Parser::block_statement() {
-  return std::make_unique<stmt::Block>(block());
+Stmt* Parser::block_statement() {
+  return arena_.make<stmt::Block>(block());
 }
 
-std::unique_ptr<Stmt> Parser::expression_statement() {
+Stmt* Parser::expression_statement() {
   auto expr = expression();
   consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
-  return std::make_unique<stmt::Expression>(std::move(expr));
+  return arena_.make<stmt::Expression>(expr);
 }
 
-std::vector<std::unique_ptr<Stmt>> Parser::block() {
-  std::vector<std::unique_ptr<Stmt>> statements;
+NodeList<Stmt*> Parser::block() {
+  std::vector<Stmt*> statements;
 
   while (!check(TOKEN_RIGHT_BRACE) && !is_at_end()) {
     statements.push_back(declaration());
   }
 
   consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
-  return statements;
+  return arena_.copy(statements);
 }
 
-std::unique_ptr<Expr> Parser::finish_call(std::unique_ptr<Expr> callee) {
-  std::vector<std::unique_ptr<Expr>> arguments;
+Expr* Parser::finish_call(Expr* callee) {
+  std::vector<Expr*> arguments;
   if (!check(TOKEN_RIGHT_PAREN)) {
     do {
       constexpr size_t max_argument_count = 255;
@@ -236,33 +235,56 @@ std::unique_ptr<Expr> Parser::finish_call(std::unique_ptr<Expr> callee) {
     } while (match(TOKEN_COMMA));
   }
 
-  const lox::Token& paren =
-      consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+  const AstToken paren =
+      token(consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments."));
+
+  auto* call =
+      arena_.make<expr::Call>(callee, paren, arena_.copy(arguments));
+  call->property = dynamic_cast<expr::Get*>(callee);
+  return call;
+}
+
+Expr* Parser::list() {
+  std::vector<Expr*> elements;
+  if (!check(TOKEN_RIGHT_BRACKET)) {
+    do {
+      constexpr size_t max_element_count = 255;
+      if (elements.size() >= max_element_count) {
+        error(peek(), "Can't have more than 255 elements in a list literal.");
+      }
+      elements.push_back(expression());
+    } while (match(TOKEN_COMMA));
+  }
 
-  return std::make_unique<expr::Call>(std::move(callee), paren,
-                                      std::move(arguments));
+  const AstToken bracket = token(
+      consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list elements."));
+  return arena_.make<expr::List>(bracket, arena_.copy(elements));
 }
 
-std::unique_ptr<Expr> Parser::expression() { return assignment(); }
+Expr* Parser::expression() { return assignment(); }
 
-std::unique_ptr<Expr> Parser::assignment() {
+Expr* Parser::assignment() {
   auto expr = logic_or();
 
   if (match(TOKEN_EQUAL)) {
     const lox::Token& equals = previous();
     auto value = assignment();
 
-    if (auto* expr_ptr = dynamic_cast<expr::Variable*>(expr.get());
+    if (auto* expr_ptr = dynamic_cast<expr::Variable*>(expr);
         expr_ptr != nullptr) {
-      const lox::Token& name = expr_ptr->name;
-      return std::make_unique<expr::Assign>(name, std::move(value));
+      return arena_.make<expr::Assign>(expr_ptr->name, value);
     }
 
-    if (auto* expr_ptr = dynamic_cast<expr::Get*>(expr.get());
+    if (auto* expr_ptr = dynamic_cast<expr::Get*>(expr);
         expr_ptr != nullptr) {
-      const lox::Token& name = expr_ptr->name;
-      return std::make_unique<expr::Set>(std::move(expr_ptr->object), name,
-                                         std::move(value));
+      return arena_.make<expr::Set>(expr_ptr->object, expr_ptr->name,
+                                    value);
+    }
+
+    if (auto* expr_ptr = dynamic_cast<expr::GetIndex*>(expr);
+        expr_ptr != nullptr) {
+      return arena_.make<expr::SetIndex>(expr_ptr->object, expr_ptr->bracket,
+                                         expr_ptr->index, value);
     }
 
     error(equals, "Invalid assignment target.");
@@ -271,105 +293,104 @@ std::unique_ptr<Expr> Parser::assignment() {
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::logic_or() {
+Expr* Parser::logic_or() {
   auto expr = logic_and();
 
   while (match(TOKEN_OR)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = logic_and();
-    expr =
-        std::make_unique<expr::Logical>(std::move(expr), op, std::move(right));
+    expr = arena_.make<expr::Logical>(expr, op, right);
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::logic_and() {
+Expr* Parser::logic_and() {
   auto expr = equality();
 
   while (match(TOKEN_AND)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = equality();
-    expr =
-        std::make_unique<expr::Logical>(std::move(expr), op, std::move(right));
+    expr = arena_.make<expr::Logical>(expr, op, right);
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::equality() {
+Expr* Parser::equality() {
   auto expr = comparison();
 
   while (match(TOKEN_BANG_EQUAL) || match(TOKEN_EQUAL_EQUAL)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = comparison();
-    expr =
-        std::make_unique<expr::Binary>(std::move(expr), op, std::move(right));
+    expr = arena_.make<expr::Binary>(expr, op, right);
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::comparison() {
+Expr* Parser::comparison() {
   auto expr = term();
 
   while (match(TOKEN_GREATER) || match(TOKEN_GREATER_EQUAL) ||
          match(TOKEN_LESS) || match(TOKEN_LESS_EQUAL)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = term();
-    expr =
-        std::make_unique<expr::Binary>(std::move(expr), op, std::move(right));
+    expr = arena_.make<expr::Binary>(expr, op, right);
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::term() {
+Expr* Parser::term() {
   auto expr = factor();
 
   while (match(TOKEN_MINUS) || match(TOKEN_PLUS)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = factor();
-    expr =
-        std::make_unique<expr::Binary>(std::move(expr), op, std::move(right));
+    expr = arena_.make<expr::Binary>(expr, op, right);
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::factor() {
+Expr* Parser::factor() {
   auto expr = unary();
 
   while (match(TOKEN_SLASH) || match(TOKEN_STAR)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = unary();
-    expr =
-        std::make_unique<expr::Binary>(std::move(expr), op, std::move(right));
+    expr = arena_.make<expr::Binary>(expr, op, right);
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::unary() {
+Expr* Parser::unary() {
   if (match(TOKEN_BANG) || match(TOKEN_MINUS)) {
-    const lox::Token& op = previous();
+    const AstToken op = token(previous());
     auto right = unary();
-    return std::make_unique<expr::Unary>(op, std::move(right));
+    return arena_.make<expr::Unary>(op, right);
   }
 
   return call();
 }
 
-std::unique_ptr<Expr> Parser::call() {
+Expr* Parser::call() {
   auto expr = primary();
 
   while (true) {
     if (match(TOKEN_LEFT_PAREN)) {
-      expr = finish_call(std::move(expr));
+      expr = finish_call(expr);
     } else if (match(TOKEN_DOT)) {
-      const lox::Token& name =
-          consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-      expr = std::make_unique<expr::Get>(std::move(expr), name);
+      const AstToken name =
+          token(consume(TOKEN_IDENTIFIER, "Expect property name after '.'."));
+      expr = arena_.make<expr::Get>(expr, name);
+    } else if (match(TOKEN_LEFT_BRACKET)) {
+      auto index = expression();
+      const AstToken bracket =
+          token(consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index."));
+      expr = arena_.make<expr::GetIndex>(expr, bracket, index);
     } else {
       break;
     }
@@ -378,52 +399,60 @@ std::unique_ptr<Expr> Parser::call() {
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::primary() {
+Expr* Parser::primary() {
   if (match(TOKEN_FALSE)) {
-    return std::make_unique<expr::Literal>(false);
+    return arena_.make<expr::Literal>(false);
   }
   if (match(TOKEN_TRUE)) {
-    return std::make_unique<expr::Literal>(true);
+    return arena_.make<expr::Literal>(true);
   }
   if (match(TOKEN_NIL)) {
-    return std::make_unique<expr::Literal>(Value{});
+    return arena_.make<expr::Literal>(Value{});
   }
 
   if (match(TOKEN_NUMBER)) {
     double value = std::strtod(std::string{previous().lexeme}.c_str(), nullptr);
-    return std::make_unique<expr::Literal>(value);
+    return arena_.make<expr::Literal>(value);
   }
   if (match(TOKEN_STRING)) {
-    std::string value{previous().lexeme};
-    value.pop_back();
-    value.erase(value.begin());
-    return std::make_unique<expr::Literal>(std::move(value));
+    std::string_view value = previous().lexeme;
+    value.remove_prefix(1);
+    value.remove_suffix(1);
+    return arena_.make<expr::Literal>(arena_.copy(value));
   }
 
   if (match(TOKEN_SUPER)) {
-    const lox::Token& keyword = previous();
+    const AstToken keyword = token(previous());
     consume(TOKEN_DOT, "Expect '.' after 'super'.");
-    const lox::Token& method =
-        consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
-    return std::make_unique<expr::Super>(keyword, method);
+    const AstToken method =
+        token(consume(TOKEN_IDENTIFIER, "Expect superclass method name."));
+    return arena_.make<expr::Super>(keyword, method);
   }
 
   if (match(TOKEN_THIS)) {
-    return std::make_unique<expr::This>(previous());
+    return arena_.make<expr::This>(token(previous()));
   }
   if (match(TOKEN_IDENTIFIER)) {
-    return std::make_unique<expr::Variable>(previous());
+    return arena_.make<expr::Variable>(token(previous()));
   }
 
   if (match(TOKEN_LEFT_PAREN)) {
     auto expr = expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
-    return std::make_unique<expr::Grouping>(std::move(expr));
+    return arena_.make<expr::Grouping>(expr);
+  }
+
+  if (match(TOKEN_LEFT_BRACKET)) {
+    return list();
   }
 
   throw error(peek(), "Expect expression.");
 }
 
+AstToken Parser::token(const lox::Token& token) {
+  return {arena_.copy(token.lexeme), token.line, token.type};
+}
+
 bool Parser::match(TokenType type) {
   if (check(type)) {
     advance();
@@ -469,7 +498,7 @@ ParseError Parser::error(const lox::Token& token, const std::string& message) {
     return {};
   }
 
-  treewalk::error(token, message);
+  treewalk::error(AstToken{token.lexeme, token.line, token.type}, message);
   return {};
 }
 
@@ -3,31 +3,31 @@
 #include "treewalk.hpp"
 
 namespace lox::treewalk {
-void Resolver::resolve(const std::vector<std::unique_ptr<Stmt>>& statements) {
-  for (const auto& statement : statements) {
+void Resolver::resolve(NodeList<Stmt*> statements) {
+  for (Stmt* statement : statements) {
     resolve(statement);
   }
 }
 
-void Resolver::resolve(const std::unique_ptr<Stmt>& stmt) {
+void Resolver::resolve(Stmt* stmt) {
   stmt->accept(*this);
 }
 
 void Resolver::visit(stmt::Block& block) {
   begin_scope();
   resolve(block.statements);
-  end_scope();
+  block.slot_count = end_scope();
 }
 
 void Resolver::visit(stmt::Class& class_) {
   const ClassType enclosing_class = current_class_;
   current_class_ = ClassType::CLASS;
 
-  declare(class_.name);
+  class_.slot = declare(class_.name);
   define(class_.name);
 
-  if (class_.superclass) {
-    auto& superclass = class_.superclass.value();
+  if (class_.superclass != nullptr) {
+    expr::Variable& superclass = *class_.superclass;
     if (class_.name.lexeme == superclass.name.lexeme) {
       error(superclass.name, "A class can't inherit from itself.");
     }
@@ -37,26 +37,19 @@ void Resolver::visit(stmt::Class& class_) {
     visit(superclass);
 
     begin_scope();
-    scopes_.back().insert_or_assign("super", true);
+    scopes_.back().insert_or_assign("super", Local{true, 0});
   }
 
-  begin_scope();
-
-  ScopeMap& scope = scopes_.back();
-  scope.insert_or_assign("this", true);
-
-  for (const auto& method : class_.methods) {
+  for (stmt::Function* method : class_.methods) {
     FunctionType declaration = FunctionType::METHOD;
-    if (method.name.lexeme == "init") {
+    if (method->name.lexeme == "init") {
       declaration = FunctionType::INITIALIZER;
     }
 
-    resolve_function(method, declaration);
+    resolve_function(*method, declaration);
   }
 
-  end_scope();
-
-  if (class_.superclass) {
+  if (class_.superclass != nullptr) {
     end_scope();
   }
 
@@ -66,7 +59,7 @@ void Resolver::visit(stmt::Class& class_) {
 void Resolver::visit(stmt::Expression& expression) { resolve(expression.expr); }
 
 void Resolver::visit(stmt::Function& function) {
-  declare(function.name);
+  function.slot = declare(function.name);
   define(function.name);
 
   resolve_function(function, FunctionType::FUNCTION);
@@ -98,7 +91,7 @@ void Resolver::visit(stmt::Return& return_) {
 }
 
 void Resolver::visit(stmt::Var& var) {
-  declare(var.name);
+  var.slot = declare(var.name);
   if (var.initializer) {
     resolve(var.initializer);
   }
@@ -110,7 +103,7 @@ void Resolver::visit(stmt::While& while_) {
   resolve(while_.body);
 }
 
-void Resolver::resolve(const std::unique_ptr<Expr>& expr) {
+void Resolver::resolve(Expr* expr) {
   expr->accept(*this);
 }
 
@@ -134,8 +127,19 @@ void Resolver::visit(expr::Call& call) {
 
 void Resolver::visit(expr::Get& get) { resolve(get.object); }
 
+void Resolver::visit(expr::GetIndex& get_index) {
+  resolve(get_index.object);
+  resolve(get_index.index);
+}
+
 void Resolver::visit(expr::Grouping& grouping) { resolve(grouping.expr); }
 
+void Resolver::visit(expr::List& list) {
+  for (const auto& element : list.elements) {
+    resolve(element);
+  }
+}
+
 void Resolver::visit(expr::Literal& /*literal*/) {}
 
 void Resolver::visit(expr::Logical& logical) {
@@ -148,6 +152,12 @@ void Resolver::visit(expr::Set& set) {
   resolve(set.object);
 }
 
+void Resolver::visit(expr::SetIndex& set_index) {
+  resolve(set_index.object);
+  resolve(set_index.index);
+  resolve(set_index.value);
+}
+
 void Resolver::visit(expr::This& this_) {
   if (current_class_ == ClassType::NONE) {
     error(this_.keyword, "Can't use 'this' outside of a class.");
@@ -165,6 +175,7 @@ void Resolver::visit(expr::Super& super) {
   }
 
   resolve_local(super, super.keyword);
+  super.this_depth = depth_of("this");
 }
 
 void Resolver::visit(expr::Unary& unary) { resolve(unary.right); }
@@ -176,7 +187,7 @@ void Resolver::visit(expr::Variable& variable) {
 
   ScopeMap& scope = scopes_.back();
   if (auto it = scope.find(variable.name.lexeme);
-      it != scope.end() && !it->second) {
+      it != scope.end() && !it->second.is_defined) {
     error(variable.name, "Can't read local variable in its own initializer.");
   }
 
@@ -185,11 +196,15 @@ void Resolver::visit(expr::Variable& variable) {
 
 void Resolver::begin_scope() { scopes_.emplace_back(); }
 
-void Resolver::end_scope() { scopes_.pop_back(); }
+size_t Resolver::end_scope() {
+  const size_t slot_count = scopes_.back().size();
+  scopes_.pop_back();
+  return slot_count;
+}
 
-void Resolver::declare(const lox::Token& name) {
+int Resolver::declare(const AstToken& name) {
   if (scopes_.empty()) {
-    return;
+    return -1;
   }
 
   ScopeMap& scope = scopes_.back();
@@ -197,40 +212,56 @@ void Resolver::declare(const lox::Token& name) {
     error(name, "Already a variable with this name in this scope.");
   }
 
-  scope.insert_or_assign(name.lexeme, false);
+  const auto slot = static_cast<int>(scope.size());
+  scope.insert_or_assign(name.lexeme, Local{false, slot});
+  return slot;
 }
 
-void Resolver::define(const lox::Token& name) {
+void Resolver::define(const AstToken& name) {
   if (scopes_.empty()) {
     return;
   }
 
-  ScopeMap& scope = scopes_.back();
-  scope.insert_or_assign(name.lexeme, true);
+  scopes_.back().at(name.lexeme).is_defined = true;
 }
 
-void Resolver::resolve_local(expr::Expr& expr, const lox::Token& name) {
+void Resolver::resolve_local(expr::Expr& expr, const AstToken& name) {
   for (size_t i = scopes_.size(); i-- > 0;) {
-    if (scopes_[i].find(name.lexeme) != scopes_[i].end()) {
+    if (auto it = scopes_[i].find(name.lexeme); it != scopes_[i].end()) {
       expr.depth = static_cast<int>(scopes_.size() - 1 - i);
+      expr.slot = it->second.slot;
       return;
     }
   }
 }
 
-void Resolver::resolve_function(const stmt::Function& function,
+int Resolver::depth_of(std::string_view name) const {
+  for (size_t i = scopes_.size(); i-- > 0;) {
+    if (scopes_[i].find(name) != scopes_[i].end()) {
+      return static_cast<int>(scopes_.size() - 1 - i);
+    }
+  }
+  return -1;
+}
+
+void Resolver::resolve_function(stmt::Function& function,
                                 FunctionType type) {
   const FunctionType enclosing_function = current_function_;
   current_function_ = type;
   begin_scope();
 
+  // Methods receive the instance in slot 0 of their own frame.
+  if (type == FunctionType::METHOD || type == FunctionType::INITIALIZER) {
+    scopes_.back().insert_or_assign("this", Local{true, 0});
+  }
+
   for (const auto& param : function.params) {
     declare(param);
     define(param);
   }
   resolve(function.body);
 
-  end_scope();
+  function.slot_count = end_scope();
   current_function_ = enclosing_function;
 }
 }  // namespace lox::treewalk
@@ -15,6 +15,17 @@ bool g_had_error{};
 bool g_had_runtime_error{};
 
 void run(const std::string& source) {
+  Arena arena;
+  if (const auto statements = parse(source, arena)) {
+    g_interpreter.interpret(*statements, std::move(arena));
+  }
+}
+}  // namespace
+
+std::optional<NodeList<Stmt*>> parse(const std::string& source,
+                                     Arena& arena) {
+  g_had_error = false;
+
   Scanner scanner{source};
   std::vector<lox::Token> tokens = scanner.scan_tokens();
 
@@ -22,11 +33,11 @@ void run(const std::string& source) {
   //   std::cout << token.to_string() << '\n';
   // }
 
-  Parser parser{std::move(tokens)};
-  std::vector<std::unique_ptr<Stmt>> statements = parser.parse();
+  Parser parser{std::move(tokens), arena};
+  NodeList<Stmt*> statements = parser.parse();
 
   if (g_had_error) {
-    return;
+    return {};
   }
 
   // AstPrinter ast_printer;
@@ -36,20 +47,25 @@ void run(const std::string& source) {
   resolver.resolve(statements);
 
   if (g_had_error) {
-    return;
+    return {};
   }
 
-  g_interpreter.interpret(std::move(statements));
+  return statements;
 }
-}  // namespace
 
-int run_file(const std::string& path) {
+int run_file(const std::string& path, const Options& options) {
+  g_interpreter.configure_gc(options.gc);
+  g_interpreter.set_compiled(options.compiled);
+
   std::ifstream file_stream{path};
   file_stream.exceptions(std::ifstream::badbit | std::ifstream::failbit);
   const std::string source{std::istreambuf_iterator<char>{file_stream},
                            std::istreambuf_iterator<char>{}};
 
   run(source);
+  if (options.gc_stats) {
+    g_interpreter.print_gc_stats(std::cerr);
+  }
   g_interpreter.free_objects();
 
   if (g_had_error) {
@@ -62,7 +78,10 @@ int run_file(const std::string& path) {
   return 0;
 }
 
-void run_prompt() {
+void run_prompt(const Options& options) {
+  g_interpreter.configure_gc(options.gc);
+  g_interpreter.set_compiled(options.compiled);
+
   std::string source_line;
   for (;;) {
     std::cout << "> ";
@@ -73,7 +92,9 @@ void run_prompt() {
     }
 
     run(source_line);
-    g_had_error = false;
+  }
+  if (options.gc_stats) {
+    g_interpreter.print_gc_stats(std::cerr);
   }
   g_interpreter.free_objects();
 }
@@ -84,7 +105,12 @@ void runtime_error(const RuntimeError& error) {
   g_had_runtime_error = true;
 }
 
-void error(const lox::Token& token, const std::string& message) {
+void runtime_error(const HeapLimitError& error) {
+  std::cerr << error.what() << '\n';
+  g_had_runtime_error = true;
+}
+
+void error(const AstToken& token, const std::string& message) {
   if (token.type == TOKEN_EOF) {
     report(token.line, " at end", message);
   } else {
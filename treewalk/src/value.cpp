@@ -11,7 +11,7 @@ void print_value(const Value& value) {
     return;
   }
   if (IS_STRING(value)) {
-    std::cout << AS_STRING(value);
+    std::cout << AS_STRING(value)->string;
     return;
   }
   if (IS_NUMBER(value)) {